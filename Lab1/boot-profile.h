@@ -0,0 +1,41 @@
+#ifndef _BOOT_PROFILE_H_
+#define _BOOT_PROFILE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BOOT_PROFILE_MAX_PHASES 24
+
+typedef struct
+{
+    const char *name; // must point to a string literal
+    int64_t start_us; // esp_timer_get_time() when the phase began
+    int64_t end_us;   // 0 while the phase is still open; equal to start_us for marks
+} boot_profile_phase_t;
+
+/**
+ * @brief Open a named boot phase
+ *
+ * Safe to call from any task, so phases running in parallel can be
+ * recorded side by side. Returns the slot to pass to boot_profile_end(),
+ * or -1 once the table is full or boot_profile_finish() was called.
+ */
+int boot_profile_begin(const char *name);
+
+void boot_profile_end(int slot);
+
+// Record an instantaneous milestone (e.g. "wifi associated")
+void boot_profile_mark(const char *name);
+
+/**
+ * @brief Close the table and print the timeline
+ *
+ * Further begin/mark calls are ignored, so reconnects after boot do not
+ * show up as boot phases.
+ */
+void boot_profile_finish(void);
+
+// Serialize the table as JSON. Returns the length written (excluding the terminator).
+size_t boot_profile_to_json(char *buf, size_t buf_len);
+
+#endif
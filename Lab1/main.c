@@ -4,9 +4,11 @@
 #include "freertos/queue.h"
 #include "driver/gpio.h"
 
+#include "boot-profile.h"
+#include "led-pwm.h"
+
 #define GPIO_OUTPUT_IO 4
 #define GPIO_INPUT_IO 2
-#define GPIO_OUTPUT_PIN_SEL (1ULL << GPIO_OUTPUT_IO)
 #define GPIO_INPUT_PIN_SEL (1ULL << GPIO_INPUT_IO)
 #define ESP_INTR_FLAG_DEFAULT 0
 #define LONG_PRESS_DURATION 1000 // 1 second for long press
@@ -19,15 +21,11 @@ static uint32_t press_start_time = 0;
 static uint32_t last_press_time = 0;
 static int current_pattern = 0;
 
-// Blinking patterns (on_time, off_time) in ms
-static const struct
-{
-    int on_time;
-    int off_time;
-} blink_patterns[NUM_BLINK_PATTERNS] = {
-    {500, 500}, // Pattern 0: Regular blinking
-    {200, 800}, // Pattern 1: Quick blink, long pause
-    {1000, 200} // Pattern 2: Long on, quick off
+// Blinking patterns, played by the LEDC fade engine: {level %, ramp ms, hold ms}
+static const led_pwm_step_t blink_patterns[NUM_BLINK_PATTERNS][2] = {
+    {{100, 100, 400}, {0, 100, 400}}, // Pattern 0: Regular blinking
+    {{100, 50, 150}, {0, 100, 700}},  // Pattern 1: Quick blink, long pause
+    {{100, 100, 900}, {0, 50, 150}}   // Pattern 2: Long on, quick off
 };
 
 static void IRAM_ATTR gpio_isr_handler(void *arg)
@@ -36,6 +34,18 @@ static void IRAM_ATTR gpio_isr_handler(void *arg)
     xQueueSendFromISR(gpio_evt_queue, &gpio_num, NULL);
 }
 
+static void update_led(void)
+{
+    if (led_sequence_enabled)
+    {
+        led_pwm_play(blink_patterns[current_pattern], 2);
+    }
+    else
+    {
+        led_pwm_set(0, 0);
+    }
+}
+
 static void button_task(void *arg)
 {
     uint32_t io_num;
@@ -65,6 +75,7 @@ static void button_task(void *arg)
                     {
                         current_pattern = (current_pattern + 1) % NUM_BLINK_PATTERNS;
                         printf("Long press detected! New pattern: %d\n", current_pattern);
+                        update_led();
                     }
                 }
                 else if (press_duration >= 50) // Minimum press duration to avoid noise
@@ -74,6 +85,7 @@ static void button_task(void *arg)
                     led_sequence_enabled = !led_sequence_enabled;
                     printf("Short press! Count: %d, LED Sequence: %s\n",
                            button_presses, led_sequence_enabled ? "ON" : "OFF");
+                    update_led();
                 }
                 last_press_time = current_time;
             }
@@ -82,55 +94,28 @@ static void button_task(void *arg)
     }
 }
 
-static void led_task(void *arg)
-{
-    bool was_enabled = false;
-    while (1)
-    {
-        if (led_sequence_enabled)
-        {
-            was_enabled = true;
-            gpio_set_level(GPIO_OUTPUT_IO, 1);
-            vTaskDelay(blink_patterns[current_pattern].on_time / portTICK_PERIOD_MS);
-
-            gpio_set_level(GPIO_OUTPUT_IO, 0);
-            vTaskDelay(blink_patterns[current_pattern].off_time / portTICK_PERIOD_MS);
-        }
-        else
-        {
-            if (was_enabled)
-            {
-                gpio_set_level(GPIO_OUTPUT_IO, 0);
-                was_enabled = false;
-            }
-            vTaskDelay(100 / portTICK_PERIOD_MS);
-        }
-    }
-}
-
 void app_main()
 {
-    // Configure output pin
-    gpio_config_t io_conf = {};
-    io_conf.intr_type = GPIO_INTR_DISABLE;
-    io_conf.mode = GPIO_MODE_OUTPUT;
-    io_conf.pin_bit_mask = GPIO_OUTPUT_PIN_SEL;
-    io_conf.pull_down_en = 0;
-    io_conf.pull_up_en = 0;
-    gpio_config(&io_conf);
+    int phase = boot_profile_begin("gpio_config");
+    // Output pin is driven by LEDC, no CPU time is spent blinking
+    ESP_ERROR_CHECK(led_pwm_init(GPIO_OUTPUT_IO));
 
     // Configure input pin
+    gpio_config_t io_conf = {};
     io_conf.intr_type = GPIO_INTR_ANYEDGE;
     io_conf.pin_bit_mask = GPIO_INPUT_PIN_SEL;
     io_conf.mode = GPIO_MODE_INPUT;
     io_conf.pull_up_en = 1;
     gpio_config(&io_conf);
+    boot_profile_end(phase);
 
     // Create queue and install GPIO ISR service
+    phase = boot_profile_begin("isr_service");
     gpio_evt_queue = xQueueCreate(10, sizeof(uint32_t));
     gpio_install_isr_service(ESP_INTR_FLAG_DEFAULT);
     gpio_isr_handler_add(GPIO_INPUT_IO, gpio_isr_handler, (void *)GPIO_INPUT_IO);
+    boot_profile_end(phase);
 
     xTaskCreate(button_task, "button_task", 2048, NULL, 10, NULL);
-    xTaskCreate(led_task, "led_task", 2048, NULL, 10, NULL);
+    boot_profile_finish();
 }
\ No newline at end of file
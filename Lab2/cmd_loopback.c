@@ -0,0 +1,107 @@
+/* Host receiver for flood.py: the real cmd-queue.c behind a UDP socket.
+ *
+ * The receive loop is udp_task() from main.c and the handler answers
+ * STATUS? like handle_command(). An LED= command stands in for
+ * led_pwm_command() by holding the worker for --work-us. FreeRTOS is the
+ * pthread shim in host/, so the worker and the receiver really run in
+ * parallel here. The admission counters and the probe latency against
+ * the work time carry over to the board; the datagram rate a PC can push
+ * through loopback does not.
+ *
+ *   gcc -O2 -Ihost -I. -o cmd_loopback cmd_loopback.c cmd-queue.c host/freertos.c -lpthread
+ *   ./cmd_loopback [--port 10002] [--work-us 500]
+ *   python flood.py --board 127.0.0.1 --flood-from 127.0.1.1 --sources 32
+ *
+ * Every 127.x.y.z address reaches the loopback interface on Linux, so
+ * --sources gives each flood datagram a different sender address.
+ */
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "cmd-queue.h"
+
+static const char *TAG = "cmd_loopback";
+
+static int s_work_us = 500;
+static unsigned s_level = 0;
+
+static void handle_command(const cmd_item_t *cmd)
+{
+    if (strcmp(cmd->text, "STATUS?") == 0)
+    {
+        char reply[32];
+        snprintf(reply, sizeof(reply), "LED=%u", s_level);
+        cmd_queue_reply(cmd, reply);
+        return;
+    }
+    if (strncmp(cmd->text, "LED=", 4) == 0)
+    {
+        // Busy, like the LEDC calls on the worker
+        int64_t until = esp_timer_get_time() + s_work_us;
+        while (esp_timer_get_time() < until)
+        {
+        }
+        s_level = strtoul(cmd->text + 4, NULL, 10);
+        return;
+    }
+    ESP_LOGW(TAG, "%s not applied", cmd->text);
+}
+
+int main(int argc, char **argv)
+{
+    int port = 10002;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "--port") == 0)
+        {
+            port = atoi(argv[i + 1]);
+        }
+        else if (strcmp(argv[i], "--work-us") == 0)
+        {
+            s_work_us = atoi(argv[i + 1]);
+        }
+    }
+
+    if (cmd_queue_start(handle_command) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "cmd_queue_start failed");
+        return 1;
+    }
+
+    struct sockaddr_in local_addr = {0};
+    local_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    local_addr.sin_family = AF_INET;
+    local_addr.sin_port = htons(port);
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (sock < 0 || bind(sock, (struct sockaddr *)&local_addr, sizeof(local_addr)) < 0)
+    {
+        ESP_LOGE(TAG, "Socket unable to bind: errno %d", errno);
+        return 1;
+    }
+    ESP_LOGI(TAG, "Socket bound, port %d, %d us per LED= command", port, s_work_us);
+
+    while (1)
+    {
+        cmd_item_t cmd;
+        socklen_t socklen = sizeof(cmd.from);
+        int len = recvfrom(sock, cmd.text, sizeof(cmd.text) - 1, 0, (struct sockaddr *)&cmd.from, &socklen);
+        cmd.rx_us = esp_timer_get_time();
+        if (len < 0)
+        {
+            ESP_LOGE(TAG, "recvfrom failed: errno %d", errno);
+            return 1;
+        }
+        while (len > 0 && isspace((unsigned char)cmd.text[len - 1]))
+        {
+            len--;
+        }
+        cmd.text[len] = 0;
+        cmd.sock = sock;
+        cmd_queue_submit(&cmd);
+    }
+}
@@ -0,0 +1,100 @@
+"""Flood a board with actuation commands and time its answers to STATUS?.
+
+One socket per flooder sends LED= commands as fast as it can (or at --rate),
+while a separate socket, like a well-behaved controller, asks STATUS? every
+--probe-ms and times the reply. With admission control (cmd-queue.c) the
+probe latency should stay in the milliseconds however hard the flood.
+Ends with the board's own STATS? counters.
+
+    python flood.py [--board 192.168.89.45] [--port 10002] [--seconds 10] [--flooders 2]
+
+Without a board, cmd_loopback.c runs cmd-queue.c on this machine; point
+--board at 127.0.0.1. There --flood-from 127.0.1.1 --sources 32 sends each
+flood datagram from the next of 32 addresses, more than the board keeps
+buckets for.
+"""
+import argparse
+import ipaddress
+import socket
+import statistics
+import threading
+import time
+
+
+def flood(board, stop, rate, counter, source, sources):
+    socks = []
+    for i in range(sources):
+        sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        if source:
+            sock.bind((str(ipaddress.ip_address(source) + i), 0))
+        socks.append(sock)
+    level = 0
+    while not stop.is_set():
+        socks[level % len(socks)].sendto(f"LED={level % 101}".encode(), board)
+        level += 7
+        counter[0] += 1
+        if rate:
+            time.sleep(1 / rate)
+
+
+def query(sock, board, text, timeout):
+    sock.settimeout(timeout)
+    start = time.perf_counter()
+    sock.sendto(text.encode(), board)
+    try:
+        reply = sock.recv(256).decode()
+    except socket.timeout:
+        return None, None
+    return reply, time.perf_counter() - start
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--board", default="192.168.89.45")
+    parser.add_argument("--port", type=int, default=10002)
+    parser.add_argument("--seconds", type=float, default=10)
+    parser.add_argument("--flooders", type=int, default=2)
+    parser.add_argument("--rate", type=float, default=0, help="datagrams/s per flooder (0 = flat out)")
+    parser.add_argument("--probe-ms", type=float, default=50)
+    parser.add_argument("--flood-from", help="source address for the flood; rate limits are per "
+                        "source, so flooding from the probe's own address throttles the probe too")
+    parser.add_argument("--sources", type=int, default=1,
+                        help="rotate the flood over this many addresses from --flood-from on")
+    args = parser.parse_args()
+    board = (args.board, args.port)
+
+    probe = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    query(probe, board, "STATS=RESET", 1.0)
+
+    stop = threading.Event()
+    sent = [0]
+    flooders = [threading.Thread(target=flood, args=(board, stop, args.rate, sent, args.flood_from, args.sources))
+                for _ in range(args.flooders)]
+    for t in flooders:
+        t.start()
+
+    latencies = []
+    lost = 0
+    end = time.monotonic() + args.seconds
+    while time.monotonic() < end:
+        reply, latency = query(probe, board, "STATUS?", 0.5)
+        if reply is None:
+            lost += 1
+        else:
+            latencies.append(latency * 1000)
+        time.sleep(args.probe_ms / 1000)
+
+    stop.set()
+    for t in flooders:
+        t.join()
+    time.sleep(0.5)  # let the board drain
+
+    print(f"Flood: {sent[0]} datagrams in {args.seconds:.0f} s from {args.flooders} thread(s), "
+          f"{args.sources} source address(es)")
+    if latencies:
+        latencies.sort()
+        print(f"STATUS? latency ms: p50 {statistics.median(latencies):.1f}, "
+              f"p99 {latencies[int(0.99 * (len(latencies) - 1))]:.1f}, max {latencies[-1]:.1f}")
+    print(f"STATUS? answered {len(latencies)}, lost {lost}")
+    reply, _ = query(probe, board, "STATS?", 1.0)
+    print(f"Board counters: {reply}")
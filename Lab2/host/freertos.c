@@ -0,0 +1,125 @@
+// Host shim: FreeRTOS tasks, notifications and queues on POSIX threads
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+struct host_task
+{
+    pthread_t thread;
+    TaskFunction_t fn;
+    void *param;
+    pthread_mutex_t lock;
+    pthread_cond_t notified;
+    uint32_t notifications;
+};
+
+struct host_queue
+{
+    pthread_mutex_t lock;
+    UBaseType_t length, item_size, head, count;
+    uint8_t items[];
+};
+
+static __thread struct host_task *s_current;
+
+static void *trampoline(void *arg)
+{
+    s_current = arg;
+    s_current->fn(s_current->param);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *param,
+                       UBaseType_t priority, TaskHandle_t *created)
+{
+    struct host_task *task = calloc(1, sizeof(*task));
+    if (task == NULL)
+    {
+        return pdFALSE;
+    }
+    task->fn = fn;
+    task->param = param;
+    pthread_mutex_init(&task->lock, NULL);
+    pthread_cond_init(&task->notified, NULL);
+    if (created)
+    {
+        *created = task;
+    }
+    if (pthread_create(&task->thread, NULL, trampoline, task) != 0)
+    {
+        return pdFALSE;
+    }
+    pthread_detach(task->thread);
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait)
+{
+    struct host_task *task = s_current;
+    pthread_mutex_lock(&task->lock);
+    while (task->notifications == 0 && ticks_to_wait != 0)
+    {
+        pthread_cond_wait(&task->notified, &task->lock);
+    }
+    uint32_t value = task->notifications;
+    if (value > 0)
+    {
+        task->notifications = clear_on_exit ? 0 : value - 1;
+    }
+    pthread_mutex_unlock(&task->lock);
+    return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    pthread_mutex_lock(&task->lock);
+    task->notifications++;
+    pthread_cond_signal(&task->notified);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    struct host_queue *queue = calloc(1, sizeof(*queue) + (size_t)length * item_size);
+    if (queue)
+    {
+        pthread_mutex_init(&queue->lock, NULL);
+        queue->length = length;
+        queue->item_size = item_size;
+    }
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait)
+{
+    BaseType_t ret = pdFALSE;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->count < queue->length)
+    {
+        UBaseType_t tail = (queue->head + queue->count) % queue->length;
+        memcpy(queue->items + (size_t)tail * queue->item_size, item, queue->item_size);
+        queue->count++;
+        ret = pdTRUE;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return ret;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks_to_wait)
+{
+    BaseType_t ret = pdFALSE;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->count > 0)
+    {
+        memcpy(item, queue->items + (size_t)queue->head * queue->item_size, queue->item_size);
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        ret = pdTRUE;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return ret;
+}
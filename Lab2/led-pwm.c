@@ -0,0 +1,360 @@
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "driver/ledc.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+#include "led-pwm.h"
+
+#define LEDC_MODE LEDC_LOW_SPEED_MODE
+#define LEDC_TIMER LEDC_TIMER_0
+#define LEDC_CHANNEL LEDC_CHANNEL_0
+#define LEDC_RESOLUTION LEDC_TIMER_13_BIT
+#define LEDC_MAX_DUTY ((1 << 13) - 1)
+
+static const char *TAG = "led-pwm";
+
+typedef enum
+{
+    MSG_PLAY,     // new command, replaces whatever is playing
+    MSG_FADE_END, // from the LEDC fade-end interrupt
+} led_msg_type_t;
+
+typedef struct
+{
+    led_msg_type_t type;
+    uint32_t gen;    // MSG_FADE_END: ramp that ended
+    int64_t rx_us;   // MSG_PLAY: when the command was received
+    bool loop;       // MSG_PLAY: repeat steps until the next command
+    uint8_t num_steps;
+    led_pwm_step_t steps[LED_PWM_MAX_STEPS];
+} led_msg_t;
+
+static QueueHandle_t s_queue = NULL;
+static volatile uint32_t s_gen = 0;    // bumped for every ramp started
+static volatile int64_t s_isr_us = 0; // time spent in the fade-end interrupt for the current ramp
+
+static IRAM_ATTR bool fade_end_cb(const ledc_cb_param_t *param, void *user_arg)
+{
+    int64_t t0 = esp_timer_get_time();
+    BaseType_t woken = pdFALSE;
+    if (param->event == LEDC_FADE_END_EVT)
+    {
+        led_msg_t msg = {.type = MSG_FADE_END, .gen = s_gen};
+        xQueueSendFromISR(s_queue, &msg, &woken);
+    }
+    s_isr_us += esp_timer_get_time() - t0;
+    return woken == pdTRUE;
+}
+
+static uint32_t level_to_duty(uint8_t level)
+{
+    // Perceived brightness is roughly quadratic in duty, so 50 % looks like half
+    if (level > 100)
+    {
+        level = 100;
+    }
+    return (uint32_t)LEDC_MAX_DUTY * level * level / 10000;
+}
+
+// Rounded up, so a short wait still blocks instead of polling the queue
+static TickType_t ms_to_ticks(uint32_t ms)
+{
+    TickType_t ticks = pdMS_TO_TICKS(ms);
+    return ticks == 0 && ms > 0 ? 1 : ticks;
+}
+
+// Returns true when a hardware ramp was started and its fade-end event is pending
+static bool start_step(const led_pwm_step_t *step)
+{
+    uint32_t duty = level_to_duty(step->level);
+    s_gen++;
+    if (step->fade_ms > 0 && duty != ledc_get_duty(LEDC_MODE, LEDC_CHANNEL))
+    {
+        s_isr_us = 0;
+        ledc_set_fade_time_and_start(LEDC_MODE, LEDC_CHANNEL, duty, step->fade_ms, LEDC_FADE_NO_WAIT);
+        return true;
+    }
+    ledc_set_duty_and_update(LEDC_MODE, LEDC_CHANNEL, duty, 0);
+    return false;
+}
+
+static void led_task(void *pvParameters)
+{
+    led_msg_t cur = {0}; // what is playing; num_steps == 0 when idle
+    int index = 0;
+    bool ramping = false;
+    int64_t ramp_start_us = 0;
+    int64_t ramp_cpu_us = 0;
+    TickType_t wait = portMAX_DELAY;
+    led_msg_t msg;
+
+    while (1)
+    {
+        bool got = xQueueReceive(s_queue, &msg, wait) == pdTRUE;
+        int64_t t0 = esp_timer_get_time();
+        bool advance = true;
+
+        if (got && msg.type == MSG_FADE_END)
+        {
+            if (!ramping || msg.gen != s_gen)
+            {
+                continue; // a ramp that a newer command cut short
+            }
+            ramping = false;
+            int64_t now = esp_timer_get_time();
+            ESP_LOGI(TAG, "Ramp to %u%% done in %lld ms (asked %u), CPU %lld us", cur.steps[index].level,
+                     (now - ramp_start_us) / 1000, cur.steps[index].fade_ms, ramp_cpu_us + s_isr_us + (now - t0));
+            if (cur.steps[index].hold_ms > 0)
+            {
+                wait = ms_to_ticks(cur.steps[index].hold_ms);
+                continue;
+            }
+        }
+        else if (got)
+        {
+            if (ramping)
+            {
+                ledc_fade_stop(LEDC_MODE, LEDC_CHANNEL);
+                ramping = false;
+            }
+            cur = msg;
+            index = 0;
+            advance = false;
+        }
+        // else: the hold of the current step ran out
+
+        wait = portMAX_DELAY;
+        while (cur.num_steps > 0)
+        {
+            if (advance && ++index == cur.num_steps)
+            {
+                if (!cur.loop)
+                {
+                    cur.num_steps = 0;
+                    break;
+                }
+                index = 0;
+            }
+            advance = true;
+
+            const led_pwm_step_t *step = &cur.steps[index];
+            ramping = start_step(step);
+            if (cur.rx_us)
+            {
+                ESP_LOGI(TAG, "Command applied %lld us after it was received", esp_timer_get_time() - cur.rx_us);
+                cur.rx_us = 0;
+            }
+            if (ramping)
+            {
+                ramp_start_us = esp_timer_get_time();
+                ramp_cpu_us = ramp_start_us - t0;
+                break;
+            }
+            // A fade to the level the LED is already at still takes its time,
+            // otherwise PATTERN=0,500,0 with the LED off would never block
+            if (step->fade_ms + step->hold_ms > 0)
+            {
+                wait = ms_to_ticks(step->fade_ms + step->hold_ms);
+                break;
+            }
+        }
+    }
+}
+
+esp_err_t led_pwm_init(int gpio)
+{
+    ledc_timer_config_t timer = {
+        .speed_mode = LEDC_MODE,
+        .duty_resolution = LEDC_RESOLUTION,
+        .timer_num = LEDC_TIMER,
+        .freq_hz = LED_PWM_FREQ_HZ,
+        .clk_cfg = LEDC_AUTO_CLK};
+    esp_err_t err = ledc_timer_config(&timer);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    ledc_channel_config_t channel = {
+        .gpio_num = gpio,
+        .speed_mode = LEDC_MODE,
+        .channel = LEDC_CHANNEL,
+        .intr_type = LEDC_INTR_DISABLE,
+        .timer_sel = LEDC_TIMER,
+        .duty = 0,
+        .hpoint = 0};
+    err = ledc_channel_config(&channel);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    err = ledc_fade_func_install(0);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    ledc_cbs_t callbacks = {.fade_cb = fade_end_cb};
+    ledc_cb_register(LEDC_MODE, LEDC_CHANNEL, &callbacks, NULL);
+
+    s_queue = xQueueCreate(LED_PWM_QUEUE_LEN, sizeof(led_msg_t));
+    if (s_queue == NULL ||
+        xTaskCreate(led_task, "led_pwm", LED_PWM_TASK_STACK, NULL, LED_PWM_TASK_PRIORITY, NULL) != pdPASS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+uint8_t led_pwm_get_level(void)
+{
+    // Inverse of level_to_duty(); mid-ramp this is where the ramp has got to
+    uint32_t duty = ledc_get_duty(LEDC_MODE, LEDC_CHANNEL);
+    uint8_t level = 0;
+    while (level < 100 && level_to_duty(level + 1) <= duty)
+    {
+        level++;
+    }
+    return level;
+}
+
+static esp_err_t post(led_msg_t *msg)
+{
+    if (s_queue == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    msg->type = MSG_PLAY;
+    return xQueueSend(s_queue, msg, 0) == pdTRUE ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+static esp_err_t set_at(uint8_t level, uint32_t fade_ms, int64_t rx_us)
+{
+    if (level > 100)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    led_msg_t msg = {.rx_us = rx_us, .num_steps = 1};
+    msg.steps[0].level = level;
+    msg.steps[0].fade_ms = fade_ms > UINT16_MAX ? UINT16_MAX : fade_ms;
+    return post(&msg);
+}
+
+esp_err_t led_pwm_set(uint8_t level, uint32_t fade_ms)
+{
+    return set_at(level, fade_ms, esp_timer_get_time());
+}
+
+static esp_err_t play_at(const led_pwm_step_t *steps, size_t num_steps, int64_t rx_us)
+{
+    if (num_steps == 0 || num_steps > LED_PWM_MAX_STEPS)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    led_msg_t msg = {.rx_us = rx_us, .loop = true, .num_steps = num_steps};
+    uint32_t period_ms = 0;
+    for (size_t i = 0; i < num_steps; i++)
+    {
+        if (steps[i].level > 100)
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+        msg.steps[i] = steps[i];
+        period_ms += steps[i].fade_ms + steps[i].hold_ms;
+    }
+    // A loop with no time in it would keep the driver task spinning
+    if (period_ms == 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return post(&msg);
+}
+
+esp_err_t led_pwm_play(const led_pwm_step_t *steps, size_t num_steps)
+{
+    return play_at(steps, num_steps, esp_timer_get_time());
+}
+
+static bool at_end(const char *p)
+{
+    while (isspace((unsigned char)*p))
+    {
+        p++;
+    }
+    return *p == '\0';
+}
+
+// Parse "<n>" into *value, checking it is within 0..max
+static const char *parse_num(const char *p, long max, long *value)
+{
+    char *end;
+    if (!isdigit((unsigned char)*p))
+    {
+        return NULL;
+    }
+    *value = strtol(p, &end, 10);
+    return *value > max ? NULL : end;
+}
+
+esp_err_t led_pwm_command(const char *cmd, int64_t rx_us)
+{
+    long level, fade_ms = 0, hold_ms;
+    const char *p;
+
+    if (strncmp(cmd, "GPIO4=", 6) == 0 && (cmd[6] == '0' || cmd[6] == '1') && at_end(cmd + 7))
+    {
+        return set_at(cmd[6] == '1' ? 100 : 0, 0, rx_us);
+    }
+
+    if (strncmp(cmd, "LED=", 4) == 0)
+    {
+        p = parse_num(cmd + 4, 100, &level);
+        if (p && *p == ',')
+        {
+            p = parse_num(p + 1, UINT16_MAX, &fade_ms);
+        }
+        if (p == NULL || !at_end(p))
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+        ESP_LOGI(TAG, "LED to %ld%% over %ld ms", level, fade_ms);
+        return set_at(level, fade_ms, rx_us);
+    }
+
+    if (strncmp(cmd, "PATTERN=", 8) == 0)
+    {
+        led_pwm_step_t steps[LED_PWM_MAX_STEPS];
+        size_t num_steps = 0;
+        p = cmd + 8;
+        while (p && num_steps < LED_PWM_MAX_STEPS)
+        {
+            p = parse_num(p, 100, &level);
+            p = p && *p == ',' ? parse_num(p + 1, UINT16_MAX, &fade_ms) : NULL;
+            p = p && *p == ',' ? parse_num(p + 1, UINT16_MAX, &hold_ms) : NULL;
+            if (p == NULL)
+            {
+                break;
+            }
+            steps[num_steps++] = (led_pwm_step_t){.level = level, .fade_ms = fade_ms, .hold_ms = hold_ms};
+            if (*p != ';')
+            {
+                break;
+            }
+            p++;
+        }
+        if (p == NULL || !at_end(p))
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+        ESP_LOGI(TAG, "Playing %u step pattern", (unsigned)num_steps);
+        return play_at(steps, num_steps, rx_us);
+    }
+
+    return ESP_ERR_NOT_SUPPORTED;
+}
@@ -6,7 +6,9 @@
    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
    CONDITIONS OF ANY KIND, either express or implied.
 */
+#include <stdio.h>
 #include <string.h>
+#include <ctype.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
@@ -14,6 +16,7 @@
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "nvs_flash.h"
 
 #include "lwip/err.h"
@@ -24,9 +27,15 @@
 
 #include "driver/gpio.h"
 
+#include "wifi-manager.h"
+#include "boot-profile.h"
+#include "led-pwm.h"
+#include "time-sync.h"
+#include "cmd-queue.h"
+
 #define CONFIG_ESP_WIFI_SSID "lab-iot"
 #define CONFIG_ESP_WIFI_PASS "IoT-IoT-IoT"
-#define CONFIG_ESP_MAXIMUM_RETRY 5
+#define CONFIG_NTP_SERVER "192.168.89.35" // lab PC, running an NTP server
 #define CONFIG_LOCAL_PORT 10002
 
 #define LED_GPIO 4
@@ -34,118 +43,51 @@
 #define PEER_PORT 10002
 #define PEER_IP "192.168.89.40"
 
-/* FreeRTOS event group to signal when we are connected*/
-static EventGroupHandle_t s_wifi_event_group;
-
-/* The event group allows multiple bits for each event, but we only care about two events:
- * - we are connected to the AP with an IP
- * - we failed to connect after the maximum amount of retries */
-#define WIFI_CONNECTED_BIT BIT0
-#define WIFI_FAIL_BIT BIT1
-
 static const char *TAG = "wifi station";
 
-static int s_retry_num = 0;
-
-static void event_handler(void *arg, esp_event_base_t event_base,
-                          int32_t event_id, void *event_data)
+static void link_state_cb(bool link_up, void *ctx)
 {
-    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START)
-    {
-        esp_wifi_connect();
-    }
-    else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED)
-    {
-        if (s_retry_num < CONFIG_ESP_MAXIMUM_RETRY)
-        {
-            esp_wifi_connect();
-            s_retry_num++;
-            ESP_LOGI(TAG, "retry to connect to the AP");
-        }
-        else
-        {
-            xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
-        }
-        ESP_LOGI(TAG, "connect to the AP fail");
-    }
-    else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP)
+    ESP_LOGI(TAG, "link %s", link_up ? "up" : "down");
+    if (link_up)
     {
-        ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
-        ESP_LOGI(TAG, "got ip:" IPSTR, IP2STR(&event->ip_info.ip));
-        s_retry_num = 0;
-        xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+        // The device is serving once the first lease is held; later calls are no-ops
+        boot_profile_finish();
     }
 }
 
-bool wifi_init_sta(void)
+// Runs AT=<epoch_ms>;<command> commands at their instant, from the esp_timer task
+static void run_scheduled(const char *cmd, int64_t late_us)
 {
-    s_wifi_event_group = xEventGroupCreate();
-
-    ESP_ERROR_CHECK(esp_netif_init());
+    esp_err_t err = led_pwm_command(cmd, esp_timer_get_time());
+    ESP_LOGI(TAG, "Scheduled %s ran %lld us late: %s", cmd, late_us, esp_err_to_name(err));
+}
 
-    ESP_ERROR_CHECK(esp_event_loop_create_default());
-    esp_netif_create_default_wifi_sta();
-
-    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
-    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
-
-    esp_event_handler_instance_t instance_any_id;
-    esp_event_handler_instance_t instance_got_ip;
-    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,
-                                                        ESP_EVENT_ANY_ID,
-                                                        &event_handler,
-                                                        NULL,
-                                                        &instance_any_id));
-    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT,
-                                                        IP_EVENT_STA_GOT_IP,
-                                                        &event_handler,
-                                                        NULL,
-                                                        &instance_got_ip));
-
-    wifi_config_t wifi_config = {
-        .sta = {
-            .ssid = CONFIG_ESP_WIFI_SSID,
-            .password = CONFIG_ESP_WIFI_PASS,
-        },
-    };
-    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
-    ESP_ERROR_CHECK(esp_wifi_start());
-
-    ESP_LOGI(TAG, "wifi_init_sta finished.");
-
-    /* Waiting until either the connection is established (WIFI_CONNECTED_BIT) or connection failed for the maximum
-     * number of re-tries (WIFI_FAIL_BIT). The bits are set by event_handler() (see above) */
-    EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group,
-                                           WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
-                                           pdFALSE,
-                                           pdFALSE,
-                                           portMAX_DELAY);
-
-    /* xEventGroupWaitBits() returns the bits before the call returned, hence we can test which event actually
-     * happened. */
-    if (bits & WIFI_CONNECTED_BIT)
+// Runs on the cmd-queue worker, STATUS? ahead of any queued actuation
+static void handle_command(const cmd_item_t *cmd)
+{
+    if (strcmp(cmd->text, "STATUS?") == 0)
     {
-        ESP_LOGI(TAG, "connected to ap SSID:%s password:%s",
-                 CONFIG_ESP_WIFI_SSID, CONFIG_ESP_WIFI_PASS);
-        return true;
+        char reply[32];
+        snprintf(reply, sizeof(reply), "LED=%u", led_pwm_get_level());
+        cmd_queue_reply(cmd, reply);
+        return;
     }
-    else if (bits & WIFI_FAIL_BIT)
+
+    // AT=<epoch_ms>;<command> waits for its instant (time-sync.h), the rest go
+    // straight to the LEDC driver (led-pwm.h)
+    esp_err_t err = time_sync_command(cmd->text);
+    if (err == ESP_ERR_NOT_SUPPORTED)
     {
-        ESP_LOGI(TAG, "Failed to connect to SSID:%s, password:%s",
-                 CONFIG_ESP_WIFI_SSID, CONFIG_ESP_WIFI_PASS);
+        err = led_pwm_command(cmd->text, cmd->rx_us);
     }
-    else
+    if (err != ESP_OK)
     {
-        ESP_LOGE(TAG, "UNEXPECTED EVENT");
+        ESP_LOGW(TAG, "%s not applied: %s", cmd->text, esp_err_to_name(err));
     }
-    return false;
 }
 
 static void udp_task(void *pvParameters)
 {
-    char rx_buffer[128];
-    char addr_str[128];
     int addr_family = 0;
     int ip_protocol = 0;
 
@@ -156,11 +98,6 @@ static void udp_task(void *pvParameters)
     ip_protocol = IPPROTO_IP;
     addr_family = AF_INET;
 
-    // Initialize LED GPIO
-    gpio_reset_pin(LED_GPIO);
-    gpio_set_direction(LED_GPIO, GPIO_MODE_OUTPUT);
-    gpio_set_level(LED_GPIO, 0); // Start with LED off
-
     while (1)
     {
         int sock = socket(addr_family, SOCK_DGRAM, ip_protocol);
@@ -181,9 +118,10 @@ static void udp_task(void *pvParameters)
         while (1)
         {
 
-            struct sockaddr source_addr;
-            socklen_t socklen = sizeof(source_addr);
-            int len = recvfrom(sock, rx_buffer, sizeof(rx_buffer) - 1, 0, &source_addr, &socklen);
+            cmd_item_t cmd;
+            socklen_t socklen = sizeof(cmd.from);
+            int len = recvfrom(sock, cmd.text, sizeof(cmd.text) - 1, 0, (struct sockaddr *)&cmd.from, &socklen);
+            cmd.rx_us = esp_timer_get_time();
 
             // Error occurred during receiving
             if (len < 0)
@@ -191,28 +129,16 @@ static void udp_task(void *pvParameters)
                 ESP_LOGE(TAG, "recvfrom failed: errno %d", errno);
                 break;
             }
-            // Data received
-            else
+
+            // No logging per datagram: rate limits and queueing are in cmd-queue.c,
+            // which logs a summary, and the worker task runs handle_command()
+            while (len > 0 && isspace((unsigned char)cmd.text[len - 1]))
             {
-                inet_ntoa_r(((struct sockaddr_in *)&source_addr)->sin_addr, addr_str, sizeof(addr_str) - 1);
-                rx_buffer[len] = 0; // Null-terminate whatever we received
-                ESP_LOGI(TAG, "Received %d bytes from %s:", len, addr_str);
-                ESP_LOGI(TAG, "%s", rx_buffer);
-
-                // Handle LED control commands
-                if (strcmp(rx_buffer, "GPIO4=0") == 0)
-                {
-                    gpio_set_level(LED_GPIO, 0);
-                    ESP_LOGI(TAG, "LED OFF");
-                }
-                else if (strcmp(rx_buffer, "GPIO4=1") == 0)
-                {
-                    gpio_set_level(LED_GPIO, 1);
-                    ESP_LOGI(TAG, "LED ON");
-                }
+                len--;
             }
-
-            vTaskDelay(200 / portTICK_PERIOD_MS);
+            cmd.text[len] = 0;
+            cmd.sock = sock;
+            cmd_queue_submit(&cmd);
         }
 
         if (sock != -1)
@@ -253,7 +179,11 @@ static void button_task(void *pvParameters)
         bool current_state = gpio_get_level(BUTTON_GPIO);
 
         // Button press detected (active low)
-        if (current_state == 0 && last_state == 1)
+        if (current_state == 0 && last_state == 1 && !wifi_manager_is_connected())
+        {
+            ESP_LOGW(TAG, "Link down, press ignored");
+        }
+        else if (current_state == 0 && last_state == 1)
         {
             const char *message = toggle_state ? "GPIO4=1" : "GPIO4=0";
             int err = sendto(sock, message, strlen(message), 0,
@@ -278,20 +208,41 @@ static void button_task(void *pvParameters)
 void app_main(void)
 {
     // Initialize NVS
+    int phase = boot_profile_begin("nvs_init");
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND)
     {
+        int erase_phase = boot_profile_begin("nvs_erase_retry");
         ESP_ERROR_CHECK(nvs_flash_erase());
         ret = nvs_flash_init();
+        boot_profile_end(erase_phase);
     }
     ESP_ERROR_CHECK(ret);
+    boot_profile_end(phase);
 
-    ESP_LOGI(TAG, "ESP_WIFI_MODE_STA");
-    bool connected = wifi_init_sta();
+    phase = boot_profile_begin("led_init");
+    ESP_ERROR_CHECK(led_pwm_init(LED_GPIO)); // LED starts off
+    boot_profile_end(phase);
 
-    if (connected)
-    {
-        xTaskCreate(udp_task, "udp_task", 4096, NULL, 5, NULL);
-        xTaskCreate(button_task, "button_task", 4096, NULL, 5, NULL);
-    }
+    phase = boot_profile_begin("netif_init");
+    ESP_ERROR_CHECK(esp_netif_init());
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+    boot_profile_end(phase);
+
+    ESP_LOGI(TAG, "ESP_WIFI_MODE_STA");
+    phase = boot_profile_begin("wifi_start");
+    ESP_ERROR_CHECK(wifi_manager_start(CONFIG_ESP_WIFI_SSID, CONFIG_ESP_WIFI_PASS));
+    boot_profile_end(phase);
+    wifi_manager_subscribe(link_state_cb, NULL);
+
+    // Shared clock, so AT= commands fanned out to many boards land together
+    phase = boot_profile_begin("time_sync_init");
+    ESP_ERROR_CHECK(time_sync_start(CONFIG_NTP_SERVER, run_scheduled));
+    boot_profile_end(phase);
+
+    // Tasks start right away; the UDP socket binds without a link and
+    // button_task checks the link before sending
+    ESP_ERROR_CHECK(cmd_queue_start(handle_command));
+    xTaskCreate(udp_task, "udp_task", 4096, NULL, 5, NULL);
+    xTaskCreate(button_task, "button_task", 4096, NULL, 5, NULL);
 }
\ No newline at end of file
@@ -0,0 +1,83 @@
+"""Skew between boards applying the same fanned-out command.
+
+Compares applying on arrival (what udp_task did) with AT=<epoch_ms>;<command>
+against an NTP-synced clock, once with a single exchange per sync (lwIP SNTP)
+and once keeping the shortest of TIME_SYNC_BURST round trips (time-sync.c).
+Every board has a crystal off by up to --drift-ppm and syncs every
+TIME_SYNC_INTERVAL_MS; each network leg gets a base delay plus exponential
+jitter and the odd power-save spike.
+
+    python sync_sim.py [--boards 20] [--trials 2000] [--lead-ms 200]
+"""
+import argparse
+import random
+import statistics
+
+# Keep in sync with TIME_SYNC_INTERVAL_MS / TIME_SYNC_BURST in time-sync.h
+SYNC_INTERVAL_S = 5 * 60
+SYNC_BURST = 8
+BASE_DELAY_S = 0.001
+SPIKE_PROBABILITY = 0.02  # DTIM / power-save wakeups
+SPIKE_S = 0.1
+TIMER_LATENESS_S = (20e-6, 80e-6)  # esp_timer task dispatch
+
+
+def leg(jitter_s):
+    delay = BASE_DELAY_S + random.expovariate(1 / jitter_s)
+    if random.random() < SPIKE_PROBABILITY:
+        delay += random.uniform(0, SPIKE_S)
+    return delay
+
+
+def clock_error(jitter_s, drift_ppm, burst):
+    """Board clock minus true time when a command arrives."""
+    # NTP is off by half the asymmetry of the exchange it trusts, the shortest one
+    out, back = min(((leg(jitter_s), leg(jitter_s)) for _ in range(burst)), key=sum)
+    sync_error = (out - back) / 2
+    since_sync = random.uniform(0, SYNC_INTERVAL_S)
+    return sync_error + random.uniform(-drift_ppm, drift_ppm) * 1e-6 * since_sync
+
+
+def scheduled(arrivals, jitter_s, drift_ppm, lead_s, burst):
+    applied = []
+    late = 0
+    for arrival in arrivals:
+        # The board fires when its own clock reads lead_s
+        at = lead_s - clock_error(jitter_s, drift_ppm, burst) + random.uniform(*TIMER_LATENESS_S)
+        if at < arrival:
+            at = arrival
+            late += 1
+        applied.append(at)
+    return max(applied) - min(applied), late
+
+
+def trial(boards, jitter_s, drift_ppm, lead_s):
+    arrivals = [leg(jitter_s) for _ in range(boards)]
+    single, _ = scheduled(arrivals, jitter_s, drift_ppm, lead_s, 1)
+    burst, late = scheduled(arrivals, jitter_s, drift_ppm, lead_s, SYNC_BURST)
+    return max(arrivals) - min(arrivals), single, burst, late
+
+
+def percentile(values, p):
+    return sorted(values)[int(p / 100 * (len(values) - 1))]
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--boards", type=int, default=20)
+    parser.add_argument("--trials", type=int, default=2000)
+    parser.add_argument("--lead-ms", type=float, default=200, help="how far ahead AT= is set")
+    parser.add_argument("--drift-ppm", type=float, default=20)
+    args = parser.parse_args()
+
+    print(f"{args.boards} boards, AT= set {args.lead_ms:.0f} ms ahead, skew in ms (p50 / p95 / max)")
+    print(f"{'jitter ms':>9} {'on arrival':>22} {'AT=, 1 exchange':>22} {f'AT=, best of {SYNC_BURST}':>22} {'late':>6}")
+    for jitter_ms in (1, 5, 20, 50):
+        results = [trial(args.boards, jitter_ms / 1000, args.drift_ppm, args.lead_ms / 1000)
+                   for _ in range(args.trials)]
+        columns = []
+        for skews in list(zip(*results))[:3]:
+            ms = [s * 1000 for s in skews]
+            columns.append(f"{statistics.median(ms):6.1f} / {percentile(ms, 95):5.1f} / {max(ms):5.1f}")
+        late = sum(r[3] for r in results) / (args.trials * args.boards)
+        print(f"{jitter_ms:>9} {columns[0]:>22} {columns[1]:>22} {columns[2]:>22} {late:>6.1%}")
@@ -1,3 +1,4 @@
+import argparse
 import socket
 import time
 
@@ -5,16 +6,29 @@ import time
 PEER_IP = "192.168.89.45"
 PEER_PORT = 10001
 
-commands = ["GPIO4=0", "GPIO4=1"]
+# Commands are sent in turn, one per second. Besides GPIO4=0/1 the board takes
+#   LED=<level>[,<fade_ms>]                  e.g. python udp_sender.py LED=100,800 LED=0,800
+#   PATTERN=<level>,<fade_ms>,<hold_ms>;...  e.g. python udp_sender.py "PATTERN=100,500,0;0,500,200"
+# With --at-ms every command is wrapped as AT=<epoch_ms>;<command>, so all
+# --peer boards apply it at the same instant. This PC must be their NTP server.
+parser = argparse.ArgumentParser()
+parser.add_argument("commands", nargs="*", default=["GPIO4=0", "GPIO4=1"])
+parser.add_argument("--peer", action="append", help="board IP, repeat to fan out (default PEER_IP)")
+parser.add_argument("--at-ms", type=int, default=0, help="apply this many ms after sending")
+args = parser.parse_args()
+peers = args.peer or [PEER_IP]
 i = 0
 
 sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
 while 1:
     try:
-        command = commands[i % 2]
-        sock.sendto(command.encode(), (PEER_IP, PEER_PORT))
+        command = args.commands[i % len(args.commands)]
+        if args.at_ms:
+            command = f"AT={int(time.time() * 1000) + args.at_ms};{command}"
+        for peer in peers:
+            sock.sendto(command.encode(), (peer, PEER_PORT))
         print(f"Sent command: {command}")
         i += 1
         time.sleep(1)
     except KeyboardInterrupt:
-        break
\ No newline at end of file
+        break
@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+#include "boot-profile.h"
+
+static const char *TAG = "boot-profile";
+
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static boot_profile_phase_t s_phases[BOOT_PROFILE_MAX_PHASES];
+static int s_phase_count = 0;
+static bool s_finished = false;
+static int64_t s_finish_us = 0;
+
+static int alloc_slot(const char *name, int64_t now)
+{
+    int slot = -1;
+    taskENTER_CRITICAL(&s_lock);
+    if (!s_finished && s_phase_count < BOOT_PROFILE_MAX_PHASES)
+    {
+        slot = s_phase_count++;
+        s_phases[slot].name = name;
+        s_phases[slot].start_us = now;
+        s_phases[slot].end_us = 0;
+    }
+    taskEXIT_CRITICAL(&s_lock);
+    return slot;
+}
+
+int boot_profile_begin(const char *name)
+{
+    return alloc_slot(name, esp_timer_get_time());
+}
+
+void boot_profile_end(int slot)
+{
+    if (slot < 0 || slot >= BOOT_PROFILE_MAX_PHASES)
+    {
+        return;
+    }
+    int64_t now = esp_timer_get_time();
+    taskENTER_CRITICAL(&s_lock);
+    s_phases[slot].end_us = now;
+    taskEXIT_CRITICAL(&s_lock);
+}
+
+void boot_profile_mark(const char *name)
+{
+    int64_t now = esp_timer_get_time();
+    int slot = alloc_slot(name, now);
+    if (slot >= 0)
+    {
+        s_phases[slot].end_us = now;
+    }
+}
+
+void boot_profile_finish(void)
+{
+    taskENTER_CRITICAL(&s_lock);
+    if (s_finished)
+    {
+        taskEXIT_CRITICAL(&s_lock);
+        return;
+    }
+    s_finished = true;
+    s_finish_us = esp_timer_get_time();
+    taskEXIT_CRITICAL(&s_lock);
+
+    ESP_LOGI(TAG, "Boot timeline (%d phases, ready at %lld ms):", s_phase_count, s_finish_us / 1000);
+    for (int i = 0; i < s_phase_count; i++)
+    {
+        const boot_profile_phase_t *p = &s_phases[i];
+        if (p->end_us == p->start_us)
+        {
+            ESP_LOGI(TAG, "  %8lld us  * %s", p->start_us, p->name);
+        }
+        else if (p->end_us == 0)
+        {
+            ESP_LOGI(TAG, "  %8lld us  %-20s (still running)", p->start_us, p->name);
+        }
+        else
+        {
+            ESP_LOGI(TAG, "  %8lld us  %-20s %8lld us", p->start_us, p->name, p->end_us - p->start_us);
+        }
+    }
+}
+
+size_t boot_profile_to_json(char *buf, size_t buf_len)
+{
+    size_t len = 0;
+    int n = snprintf(buf, buf_len, "{\"ready_us\":%lld,\"phases\":[", s_finish_us);
+    if (n < 0 || (size_t)n >= buf_len)
+    {
+        return 0;
+    }
+    len = n;
+
+    for (int i = 0; i < s_phase_count; i++)
+    {
+        n = snprintf(buf + len, buf_len - len,
+                     "%s{\"name\":\"%s\",\"start_us\":%lld,\"end_us\":%lld}",
+                     i ? "," : "", s_phases[i].name, s_phases[i].start_us, s_phases[i].end_us);
+        if (n < 0 || (size_t)n >= buf_len - len)
+        {
+            return 0;
+        }
+        len += n;
+    }
+
+    n = snprintf(buf + len, buf_len - len, "]}");
+    if (n < 0 || (size_t)n >= buf_len - len)
+    {
+        return 0;
+    }
+    return len + n;
+}
@@ -0,0 +1,103 @@
+"""Copy/insert binary delta used for OTA updates.
+
+Patch layout (little endian), applied by ota-delta.c on the device:
+
+    "EDP1"  magic
+    u32     target size
+    then a sequence of ops until target size bytes have been produced:
+    0x01 u32 src_offset u32 length   copy from the running partition
+    0x02 u32 length <length bytes>   insert literal bytes
+"""
+import struct
+import sys
+import time
+
+MAGIC = b"EDP1"
+OP_COPY = 0x01
+OP_INSERT = 0x02
+
+# Source is indexed in aligned blocks of this size; shorter matches are sent as literals
+BLOCK = 32
+
+
+def make_patch(source: bytes, target: bytes) -> bytes:
+    index = {}
+    for off in range(0, len(source) - BLOCK + 1, BLOCK):
+        index.setdefault(source[off : off + BLOCK], off)
+
+    out = bytearray(MAGIC + struct.pack("<I", len(target)))
+    literal_start = 0
+    i = 0
+    n = len(target)
+
+    def flush_literal(end):
+        if end > literal_start:
+            out.extend(struct.pack("<BI", OP_INSERT, end - literal_start))
+            out.extend(target[literal_start:end])
+
+    while i + BLOCK <= n:
+        src = index.get(target[i : i + BLOCK])
+        if src is None:
+            i += 1
+            continue
+
+        # Grow the match backwards into the pending literal, then forwards
+        back = 0
+        while back < src and i - back > literal_start and source[src - back - 1] == target[i - back - 1]:
+            back += 1
+        length = BLOCK + back
+        src -= back
+        start = i - back
+        while start + length < n and src + length < len(source) and source[src + length] == target[start + length]:
+            length += 1
+
+        flush_literal(start)
+        out.extend(struct.pack("<BII", OP_COPY, src, length))
+        i = start + length
+        literal_start = i
+
+    flush_literal(n)
+    return bytes(out)
+
+
+def apply_patch(source: bytes, patch: bytes) -> bytes:
+    if patch[:4] != MAGIC:
+        raise ValueError("bad patch magic")
+    (size,) = struct.unpack_from("<I", patch, 4)
+    pos = 8
+    out = bytearray()
+    while len(out) < size:
+        op = patch[pos]
+        if op == OP_COPY:
+            src, length = struct.unpack_from("<II", patch, pos + 1)
+            out.extend(source[src : src + length])
+            pos += 9
+        elif op == OP_INSERT:
+            (length,) = struct.unpack_from("<I", patch, pos + 1)
+            out.extend(patch[pos + 5 : pos + 5 + length])
+            pos += 5 + length
+        else:
+            raise ValueError(f"bad op {op:#x} at {pos}")
+    return bytes(out)
+
+
+if __name__ == "__main__":
+    # python delta.py old.bin new.bin [more pairs...] -- reports size and timing per pair
+    if len(sys.argv) < 3 or len(sys.argv) % 2 == 0:
+        print("usage: delta.py OLD NEW [OLD NEW ...]")
+        sys.exit(1)
+
+    for old_path, new_path in zip(sys.argv[1::2], sys.argv[2::2]):
+        with open(old_path, "rb") as f:
+            old = f.read()
+        with open(new_path, "rb") as f:
+            new = f.read()
+
+        t0 = time.perf_counter()
+        patch = make_patch(old, new)
+        t1 = time.perf_counter()
+        assert apply_patch(old, patch) == new
+        t2 = time.perf_counter()
+
+        print(f"{old_path} -> {new_path}: full {len(new)} B, patch {len(patch)} B "
+              f"({100.0 * len(patch) / len(new):.1f}%), diff {t1 - t0:.2f} s, apply {1000 * (t2 - t1):.1f} ms")
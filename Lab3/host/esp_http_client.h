@@ -0,0 +1,12 @@
+// Host stand-in for the ESP-IDF header; the test provides the functions
+#ifndef _HOST_ESP_HTTP_CLIENT_H_
+#define _HOST_ESP_HTTP_CLIENT_H_
+
+#include "esp_err.h"
+
+typedef struct esp_http_client *esp_http_client_handle_t;
+
+int esp_http_client_read(esp_http_client_handle_t client, char *buffer, int len);
+esp_err_t esp_http_client_close(esp_http_client_handle_t client);
+
+#endif
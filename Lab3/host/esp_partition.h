@@ -0,0 +1,14 @@
+// Host stand-in for the ESP-IDF header
+#ifndef _HOST_ESP_PARTITION_H_
+#define _HOST_ESP_PARTITION_H_
+
+#include "esp_err.h"
+
+typedef struct
+{
+    uint32_t address;
+    uint32_t size;
+    char label[17];
+} esp_partition_t;
+
+#endif
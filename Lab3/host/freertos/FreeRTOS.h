@@ -0,0 +1,5 @@
+// Host stand-in: the code built by the host tests uses no FreeRTOS calls
+#ifndef _HOST_FREERTOS_H_
+#define _HOST_FREERTOS_H_
+
+#endif
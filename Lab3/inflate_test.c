@@ -0,0 +1,309 @@
+/* Host test for the compressed OTA path: the real ota-inflate.c against miniz.
+ *
+ * ota_inflate_download() runs unchanged. The HTTP client hands out a zlib
+ * stream made the way server.py makes /firmware.bin.zz, in whatever chunk
+ * size a case asks for, and esp_ota_write() collects the inflated image so
+ * it can be compared with the original. The stream is then broken in each
+ * way the device must catch. Streams are made with the host's zlib, since
+ * tdefl cannot be held to a 4 KiB window.
+ *
+ * miniz is the single-file release (miniz.c/miniz.h from the amalgamation
+ * zip); the ROM inflater on the ESP32 is the same tinfl code. Without zlib's
+ * names miniz.h and zlib.h can share this file:
+ *
+ *   gcc -O2 -DMINIZ_NO_ZLIB_COMPATIBLE_NAMES -Ihost -I. -I$MINIZ -o inflate_test \
+ *       inflate_test.c $MINIZ/miniz.c -lz -lcrypto
+ *   ./inflate_test [firmware.bin]
+ *
+ * Without an argument a 1 MiB firmware-like image is generated. Sizes are
+ * the host's; build with -m32 for the ESP32 figure.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "ota-inflate.c"
+
+#define COMPRESS_WBITS 12 // server.py COMPRESS_WBITS
+#define TCP_SEGMENT 1460
+
+static esp_partition_t next_partition = {.label = "ota_1"};
+
+// What the fake server sends and the fake partition receives
+static const uint8_t *stream;
+static size_t stream_len, stream_pos, read_chunk;
+static uint8_t *written;
+static size_t written_len, written_cap;
+static bool ota_begun, boot_set;
+
+int esp_http_client_read(esp_http_client_handle_t client, char *buffer, int len)
+{
+    size_t n = stream_len - stream_pos;
+    if (n > read_chunk)
+    {
+        n = read_chunk;
+    }
+    if (n > (size_t)len)
+    {
+        n = len;
+    }
+    memcpy(buffer, stream + stream_pos, n);
+    stream_pos += n;
+    return (int)n;
+}
+
+esp_err_t esp_http_client_close(esp_http_client_handle_t client)
+{
+    return ESP_OK;
+}
+
+esp_err_t ota_http_get(esp_http_client_handle_t client, uint32_t offset, int *status_code)
+{
+    stream_pos = offset;
+    *status_code = 200;
+    return ESP_OK;
+}
+
+void ota_http_finish(esp_http_client_handle_t client)
+{
+}
+
+void ota_download_clear_progress(void)
+{
+}
+
+esp_err_t ota_check_sha256(const uint8_t digest[32], const char *expected)
+{
+    char hex[65];
+    for (int i = 0; i < 32; i++)
+    {
+        sprintf(hex + 2 * i, "%02x", digest[i]);
+    }
+    if (strcmp(hex, expected) != 0)
+    {
+        ESP_LOGE("ota", "SHA-256 mismatch");
+        return ESP_ERR_INVALID_CRC;
+    }
+    return ESP_OK;
+}
+
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from)
+{
+    return &next_partition;
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t image_size, esp_ota_handle_t *out_handle)
+{
+    ota_begun = true;
+    *out_handle = 1;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size)
+{
+    if (written_len + size > written_cap)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(written + written_len, data, size);
+    written_len += size;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition)
+{
+    boot_set = true;
+    return ESP_OK;
+}
+
+static uint32_t rng_state;
+
+static uint32_t rng(void)
+{
+    // xorshift32, only needs to be repeatable
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static uint32_t rng_range(uint32_t lo, uint32_t hi)
+{
+    return lo + rng() % (hi - lo + 1);
+}
+
+// Code-ish data: repeats at all distances, some of them beyond the window
+static uint8_t *firmware_like(size_t size, uint32_t seed)
+{
+    uint8_t *out = malloc(size + 64);
+    size_t len = 0;
+    rng_state = seed ? seed : 1;
+    while (len < size)
+    {
+        if (len && rng() % 10 < 6)
+        {
+            size_t dist = rng() & 1 ? rng_range(1, 512) : rng_range(512, 64 * 1024);
+            size_t start = len > dist ? len - dist : 0;
+            size_t n = rng_range(4, 64);
+            for (size_t i = 0; i < n; i++)
+            {
+                out[len + i] = out[start + i];
+            }
+            len += n;
+        }
+        else
+        {
+            size_t n = rng_range(1, 24);
+            for (size_t i = 0; i < n; i++)
+            {
+                out[len + i] = (uint8_t)rng();
+            }
+            len += n;
+        }
+    }
+    return out;
+}
+
+// As get_compressed_path() in server.py
+static uint8_t *compress_image(const uint8_t *image, size_t len, int wbits, size_t *out_len)
+{
+    z_stream z = {0};
+    deflateInit2(&z, 9, Z_DEFLATED, wbits, 8, Z_DEFAULT_STRATEGY);
+    size_t cap = deflateBound(&z, len) + 64; // room for the trailing data case
+    uint8_t *out = malloc(cap);
+    z.next_in = (Bytef *)image;
+    z.avail_in = len;
+    z.next_out = out;
+    z.avail_out = cap;
+    deflate(&z, Z_FINISH);
+    *out_len = z.total_out;
+    deflateEnd(&z);
+    return out;
+}
+
+static void sha256_hex(const uint8_t *data, size_t len, char hex[65])
+{
+    uint8_t digest[32];
+    SHA256(data, len, digest);
+    for (int i = 0; i < 32; i++)
+    {
+        sprintf(hex + 2 * i, "%02x", digest[i]);
+    }
+}
+
+static double now_s(void)
+{
+    return esp_timer_get_time() / 1e6;
+}
+
+static int run(const char *name, const uint8_t *data, size_t len, size_t chunk,
+               const uint8_t *image, uint32_t size, const char *sha256, bool should_fail)
+{
+    ota_manifest_t manifest = {.size = size};
+    strcpy(manifest.sha256, sha256);
+    stream = data;
+    stream_len = len;
+    read_chunk = chunk;
+    written_len = 0;
+    ota_begun = boot_set = false;
+
+    double start = now_s();
+    esp_err_t err = ota_inflate_download(NULL, &manifest);
+    double elapsed = now_s() - start;
+
+    bool ok;
+    if (should_fail)
+    {
+        // A bad stream must never make the partition bootable
+        ok = err != ESP_OK && !boot_set;
+    }
+    else
+    {
+        ok = err == ESP_OK && boot_set && written_len == size && memcmp(written, image, size) == 0;
+    }
+    printf("%-7s %-21s ", ok ? "ok" : "FAILED", name);
+    if (err != ESP_OK)
+    {
+        printf("%s%s\n", esp_err_to_name(err), ota_begun ? "" : ", partition untouched");
+    }
+    else
+    {
+        printf("verified, %.1f MiB/s on this host\n", size / 1048576.0 / elapsed);
+    }
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    uint8_t *image;
+    size_t size = 1024 * 1024;
+    if (argc > 1)
+    {
+        FILE *f = fopen(argv[1], "rb");
+        if (!f)
+        {
+            perror(argv[1]);
+            return 1;
+        }
+        fseek(f, 0, SEEK_END);
+        size = ftell(f);
+        rewind(f);
+        image = malloc(size);
+        size = fread(image, 1, size, f);
+        fclose(f);
+    }
+    else
+    {
+        image = firmware_like(size, 1);
+    }
+    written_cap = size;
+    written = malloc(written_cap);
+
+    char sha256[65], other_sha256[65];
+    sha256_hex(image, size, sha256);
+    sha256_hex((const uint8_t *)"x", 1, other_sha256);
+
+    size_t len, wide_len;
+    uint8_t *data = compress_image(image, size, COMPRESS_WBITS, &len);
+    uint8_t *wide = compress_image(image, size, 15, &wide_len);
+    printf("image %zu bytes, compressed %zu bytes (%.0f%%)\n", size, len, 100.0 * len / size);
+
+    // One byte per read is slow, so that case inflates the first 256 KiB only
+    size_t small = size < 256 * 1024 ? size : 256 * 1024;
+    size_t small_len;
+    char small_sha256[65];
+    uint8_t *small_data = compress_image(image, small, COMPRESS_WBITS, &small_len);
+    sha256_hex(image, small, small_sha256);
+
+    int failed = 0;
+    failed += run("whole image", data, len, OTA_DOWNLOAD_BUF_SIZE, image, size, sha256, false);
+    failed += run("1-byte reads", small_data, small_len, 1, image, small, small_sha256, false);
+    failed += run("TCP segments", data, len, TCP_SEGMENT, image, size, sha256, false);
+    failed += run("truncated", data, len * 3 / 4, OTA_DOWNLOAD_BUF_SIZE, image, size, sha256, true);
+    data[len / 2] ^= 0x01;
+    failed += run("corrupted", data, len, OTA_DOWNLOAD_BUF_SIZE, image, size, sha256, true);
+    data[len / 2] ^= 0x01;
+    memset(data + len, 0, 16);
+    failed += run("trailing data", data, len + 16, OTA_DOWNLOAD_BUF_SIZE, image, size, sha256, true);
+    failed += run("32 KiB window", wide, wide_len, OTA_DOWNLOAD_BUF_SIZE, image, size, sha256, true);
+    failed += run("larger than manifest", data, len, OTA_DOWNLOAD_BUF_SIZE, image, size - 1, sha256, true);
+    failed += run("other image's hash", data, len, OTA_DOWNLOAD_BUF_SIZE, image, size, other_sha256, true);
+
+    // inflate_ctx_t is the only allocation, so this is the RAM for any image size
+    printf("\nRAM: inflate_ctx_t %zu bytes (tinfl_decompressor %zu, window %d, SHA-256 %zu)"
+           " + %d bytes of receive buffer on the stack\n",
+           sizeof(inflate_ctx_t), sizeof(tinfl_decompressor), OTA_INFLATE_DICT_SIZE,
+           sizeof(mbedtls_sha256_context), OTA_DOWNLOAD_BUF_SIZE);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,393 @@
+#include <string.h>
+
+#include "json-stream.h"
+
+enum
+{
+    JS_VALUE,  // expecting a value (or ']' right after '[')
+    JS_KEY,    // expecting a key (or '}' right after '{')
+    JS_COLON,
+    JS_STRING, // inside a key or string value
+    JS_LITERAL, // inside true, false or null
+    JS_NUMBER,
+    JS_AFTER,  // after a value: ',' or a closing bracket
+    JS_DONE,
+};
+
+// Where a number is in -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+enum
+{
+    NUM_SIGN,     // after '-'
+    NUM_ZERO,     // a leading 0, no more integer digits may follow
+    NUM_INT,
+    NUM_POINT,    // after '.'
+    NUM_FRACTION,
+    NUM_EXP,      // after 'e' or 'E'
+    NUM_EXP_SIGN,
+    NUM_EXP_DIGITS,
+};
+
+static bool is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+// Next number state after c, or -1 if c cannot continue the number
+static int number_next(uint8_t state, char c)
+{
+    if (is_digit(c))
+    {
+        switch (state)
+        {
+        case NUM_SIGN:
+            return c == '0' ? NUM_ZERO : NUM_INT;
+        case NUM_INT:
+            return NUM_INT;
+        case NUM_POINT:
+        case NUM_FRACTION:
+            return NUM_FRACTION;
+        case NUM_EXP:
+        case NUM_EXP_SIGN:
+        case NUM_EXP_DIGITS:
+            return NUM_EXP_DIGITS;
+        default:
+            return -1;
+        }
+    }
+    if (c == '.')
+    {
+        return state == NUM_ZERO || state == NUM_INT ? NUM_POINT : -1;
+    }
+    if (c == 'e' || c == 'E')
+    {
+        return state == NUM_ZERO || state == NUM_INT || state == NUM_FRACTION ? NUM_EXP : -1;
+    }
+    if (c == '+' || c == '-')
+    {
+        return state == NUM_EXP ? NUM_EXP_SIGN : -1;
+    }
+    return -1;
+}
+
+static bool number_complete(uint8_t state)
+{
+    return state == NUM_ZERO || state == NUM_INT || state == NUM_FRACTION || state == NUM_EXP_DIGITS;
+}
+
+static bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static bool top_is_object(const json_stream_t *js)
+{
+    return js->depth > 0 && (js->is_object & (1u << (js->depth - 1)));
+}
+
+static bool push(json_stream_t *js, bool object)
+{
+    if (js->depth >= JSON_STREAM_MAX_DEPTH)
+    {
+        return false;
+    }
+    if (object)
+    {
+        js->is_object |= 1u << js->depth;
+    }
+    else
+    {
+        js->is_object &= ~(1u << js->depth);
+    }
+    js->depth++;
+    js->opened = true;
+    return true;
+}
+
+static void capture_char(json_stream_t *js, char c)
+{
+    json_stream_field_t *f = js->capture;
+    if (f == NULL)
+    {
+        return;
+    }
+    if (js->value_len + 1 < f->value_size)
+    {
+        f->value[js->value_len++] = c;
+    }
+    else
+    {
+        js->capture = NULL; // does not fit: leave found false
+    }
+}
+
+static void capture_end(json_stream_t *js)
+{
+    if (js->capture)
+    {
+        js->capture->value[js->value_len] = 0;
+        js->capture->found = true;
+        js->capture = NULL;
+    }
+}
+
+static void end_value(json_stream_t *js)
+{
+    capture_end(js);
+    js->state = js->depth == 0 ? JS_DONE : JS_AFTER;
+}
+
+static void end_key(json_stream_t *js)
+{
+    js->match = -1;
+    if (js->depth == 1 && js->key_len <= JSON_STREAM_MAX_KEY)
+    {
+        js->key[js->key_len] = 0;
+        for (size_t i = 0; i < js->field_count; i++)
+        {
+            if (strcmp(js->key, js->fields[i].key) == 0)
+            {
+                js->match = i;
+                break;
+            }
+        }
+    }
+    js->state = JS_COLON;
+}
+
+static void string_char(json_stream_t *js, char c)
+{
+    if (js->in_key)
+    {
+        if (js->key_len < JSON_STREAM_MAX_KEY)
+        {
+            js->key[js->key_len] = c;
+        }
+        js->key_len++;
+    }
+    else
+    {
+        capture_char(js, c);
+    }
+}
+
+static bool step(json_stream_t *js, char c)
+{
+    switch (js->state)
+    {
+    case JS_STRING:
+        if (js->escape >= 2)
+        {
+            // Skip the hex digits of \uXXXX, the manifest never needs them
+            if (++js->escape == 6)
+            {
+                js->escape = 0;
+                string_char(js, '?');
+            }
+        }
+        else if (js->escape == 1)
+        {
+            js->escape = 0;
+            switch (c)
+            {
+            case 'n':
+                string_char(js, '\n');
+                break;
+            case 't':
+                string_char(js, '\t');
+                break;
+            case 'r':
+                string_char(js, '\r');
+                break;
+            case 'b':
+                string_char(js, '\b');
+                break;
+            case 'f':
+                string_char(js, '\f');
+                break;
+            case 'u':
+                js->escape = 2;
+                break;
+            default:
+                string_char(js, c); // \" \\ \/
+                break;
+            }
+        }
+        else if (c == '\\')
+        {
+            js->escape = 1;
+        }
+        else if (c == '"')
+        {
+            if (js->in_key)
+            {
+                end_key(js);
+            }
+            else
+            {
+                end_value(js);
+            }
+        }
+        else
+        {
+            string_char(js, c);
+        }
+        return true;
+
+    case JS_LITERAL:
+        if (*js->literal)
+        {
+            if (c != *js->literal++)
+            {
+                return false;
+            }
+            capture_char(js, c);
+            return true;
+        }
+        end_value(js);
+        return step(js, c); // the terminator belongs to the enclosing container
+
+    case JS_NUMBER:
+    {
+        int next = number_next(js->number, c);
+        if (next >= 0)
+        {
+            js->number = next;
+            capture_char(js, c);
+            return true;
+        }
+        if (!number_complete(js->number))
+        {
+            return false;
+        }
+        end_value(js);
+        return step(js, c);
+    }
+
+    default:
+        break;
+    }
+
+    if (is_space(c))
+    {
+        return true;
+    }
+
+    switch (js->state)
+    {
+    case JS_VALUE:
+        // Only values directly under a selected top-level key are captured
+        js->capture = js->depth == 1 && js->match >= 0 ? &js->fields[js->match] : NULL;
+        js->value_len = 0;
+        js->match = -1;
+        if (c == '{' || c == '[')
+        {
+            js->capture = NULL;
+            js->state = c == '{' ? JS_KEY : JS_VALUE;
+            return push(js, c == '{');
+        }
+        if (c == ']' && js->opened)
+        {
+            js->depth--;
+            end_value(js);
+            return true;
+        }
+        js->opened = false;
+        if (c == '"')
+        {
+            js->in_key = false;
+            js->state = JS_STRING;
+            return true;
+        }
+        if (c == '-' || is_digit(c))
+        {
+            js->state = JS_NUMBER;
+            js->number = c == '-' ? NUM_SIGN : number_next(NUM_SIGN, c);
+            capture_char(js, c);
+            return true;
+        }
+        if (c == 't' || c == 'f' || c == 'n')
+        {
+            js->state = JS_LITERAL;
+            js->literal = c == 't' ? "rue" : c == 'f' ? "alse" : "ull";
+            capture_char(js, c);
+            return true;
+        }
+        return false;
+
+    case JS_KEY:
+        if (c == '}' && js->opened)
+        {
+            js->depth--;
+            end_value(js);
+            return true;
+        }
+        js->opened = false;
+        if (c == '"')
+        {
+            js->in_key = true;
+            js->key_len = 0;
+            js->state = JS_STRING;
+            return true;
+        }
+        return false;
+
+    case JS_COLON:
+        if (c == ':')
+        {
+            js->state = JS_VALUE;
+            return true;
+        }
+        return false;
+
+    case JS_AFTER:
+        if (c == ',')
+        {
+            js->state = top_is_object(js) ? JS_KEY : JS_VALUE;
+            return true;
+        }
+        if ((c == '}' && top_is_object(js)) || (c == ']' && !top_is_object(js)))
+        {
+            js->depth--;
+            end_value(js);
+            return true;
+        }
+        return false;
+
+    default: // JS_DONE: only whitespace may follow
+        return false;
+    }
+}
+
+void json_stream_init(json_stream_t *js, json_stream_field_t *fields, size_t field_count)
+{
+    memset(js, 0, sizeof(*js));
+    js->fields = fields;
+    js->field_count = field_count;
+    js->state = JS_VALUE;
+    js->match = -1;
+    for (size_t i = 0; i < field_count; i++)
+    {
+        fields[i].found = false;
+    }
+}
+
+bool json_stream_feed(json_stream_t *js, const char *data, size_t len)
+{
+    for (size_t i = 0; i < len && !js->error; i++)
+    {
+        js->error = !step(js, data[i]);
+    }
+    return !js->error;
+}
+
+bool json_stream_done(const json_stream_t *js)
+{
+    if (js->error)
+    {
+        return false;
+    }
+    // A bare top-level number or literal has no terminator of its own
+    return js->state == JS_DONE ||
+           (js->depth == 0 && js->state == JS_NUMBER && number_complete(js->number)) ||
+           (js->depth == 0 && js->state == JS_LITERAL && *js->literal == 0);
+}
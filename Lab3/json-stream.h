@@ -0,0 +1,62 @@
+#ifndef _JSON_STREAM_H_
+#define _JSON_STREAM_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// json_bench.c measures this tokenizer against cJSON on the host
+
+// Keys longer than this never match a field
+#define JSON_STREAM_MAX_KEY 24
+// Nesting depth the tokenizer can track (one bit per level)
+#define JSON_STREAM_MAX_DEPTH 32
+
+// A top-level key to capture. Strings are unescaped, numbers and literals
+// are copied as text. found stays false if the value did not fit.
+typedef struct
+{
+    const char *key;
+    char *value;
+    size_t value_size;
+    bool found;
+} json_stream_field_t;
+
+typedef struct
+{
+    json_stream_field_t *fields;
+    size_t field_count;
+    uint8_t state;
+    uint8_t depth;
+    uint32_t is_object; // bit n set: level n+1 is an object, else an array
+    bool error;
+    bool opened;         // just after '{' or '[', the only place a closing bracket may follow
+    bool in_key;
+    uint8_t escape;      // 1 after a backslash, 2..5 inside a \uXXXX escape
+    uint8_t number;      // how far into a number, see number_next()
+    const char *literal; // rest of true, false or null still expected
+    char key[JSON_STREAM_MAX_KEY + 1];
+    size_t key_len;
+    int match;           // field the current key selects, -1 if none
+    json_stream_field_t *capture;
+    size_t value_len;
+} json_stream_t;
+
+/**
+ * @brief Start tokenizing a new document
+ *
+ * Nothing is allocated: the caller owns the fields and their value buffers,
+ * and json_stream_t lives wherever the caller puts it.
+ */
+void json_stream_init(json_stream_t *js, json_stream_field_t *fields, size_t field_count);
+
+/**
+ * @brief Feed the next chunk of the document, in whatever pieces it arrives
+ * @return false once a syntax error has been seen
+ */
+bool json_stream_feed(json_stream_t *js, const char *data, size_t len);
+
+// True when a complete top-level value was read without error
+bool json_stream_done(const json_stream_t *js);
+
+#endif
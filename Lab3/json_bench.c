@@ -0,0 +1,300 @@
+/* Host benchmark: json-stream against cJSON on the /version manifest.
+ *
+ * The cJSON side is what check_firmware_version() did before json-stream:
+ * collect the body in a 256-byte buffer, cJSON_Parse() it, copy the fields
+ * out and cJSON_Delete() the tree. Its heap is counted through cJSON_InitHooks().
+ * The json-stream side is the current code, fed the same body whole and in
+ * the small pieces HTTP_EVENT_ON_DATA can hand out. It never calls malloc,
+ * so its heap stays at 0. Before timing, json-stream must reject a set of
+ * malformed literals and numbers and accept their valid forms. Heap sizes are the host's: cJSON nodes are about
+ * half as large on the 32-bit ESP32.
+ *
+ *   gcc -O2 -I. -I$IDF_PATH/components/json/cJSON -o json_bench json_bench.c \
+ *       json-stream.c $IDF_PATH/components/json/cJSON/cJSON.c
+ *   ./json_bench [manifest.json]
+ *
+ * Without an argument the body is what server.py /version sends, e.g.
+ *   curl -k https://127.0.0.1:5000/version > manifest.json
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "cJSON.h"
+#include "json-stream.h"
+
+#define ITERATIONS 200000
+
+// Same sizes as ota_manifest_t and the old response_buffer
+#define VERSION_SIZE 32
+#define SHA256_SIZE 65
+#define URL_SIZE 128
+#define RESPONSE_BUF_SIZE 256
+
+static const char default_manifest[] =
+    "{\"sha256\":\"9f2c4e0b7d5a1c3e8f6b2d4a0c9e7f5b3d1a8c6e4f2b0d9a7c5e3f1b8d6a4c2e\","
+    "\"size\":1048576,\"url\":\"https://192.168.1.10:5000/firmware.bin\",\"version\":\"1.0.3\"}\n";
+
+typedef struct
+{
+    char version[VERSION_SIZE];
+    char sha256[SHA256_SIZE];
+    char url[URL_SIZE];
+    unsigned long size;
+} manifest_t;
+
+static size_t heap_now, heap_peak, heap_calls;
+
+static void *counting_malloc(size_t size)
+{
+    max_align_t *block = malloc(sizeof(max_align_t) + size);
+    if (!block)
+    {
+        return NULL;
+    }
+    *(size_t *)block = size;
+    heap_now += size;
+    heap_calls++;
+    if (heap_now > heap_peak)
+    {
+        heap_peak = heap_now;
+    }
+    return block + 1;
+}
+
+static void counting_free(void *ptr)
+{
+    if (ptr)
+    {
+        max_align_t *block = (max_align_t *)ptr - 1;
+        heap_now -= *(size_t *)block;
+        free(block);
+    }
+}
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void copy_string(char *dst, size_t size, const cJSON *item)
+{
+    strncpy(dst, item->valuestring, size - 1);
+    dst[size - 1] = 0;
+}
+
+// The old path: buffer the chunks, then parse the whole body
+static int parse_cjson(const char *body, size_t len, size_t chunk, manifest_t *m)
+{
+    char response_buffer[RESPONSE_BUF_SIZE];
+    size_t response_len = 0;
+    for (size_t pos = 0; pos < len; pos += chunk)
+    {
+        size_t n = len - pos < chunk ? len - pos : chunk;
+        if (n >= sizeof(response_buffer) - response_len)
+        {
+            return -1;
+        }
+        memcpy(response_buffer + response_len, body + pos, n);
+        response_len += n;
+        response_buffer[response_len] = 0;
+    }
+
+    cJSON *root = cJSON_Parse(response_buffer);
+    if (!root)
+    {
+        return -1;
+    }
+    cJSON *version = cJSON_GetObjectItem(root, "version");
+    cJSON *size = cJSON_GetObjectItem(root, "size");
+    cJSON *sha256 = cJSON_GetObjectItem(root, "sha256");
+    cJSON *url = cJSON_GetObjectItem(root, "url");
+    int ret = -1;
+    if (version && version->valuestring && cJSON_IsNumber(size) && sha256 && sha256->valuestring)
+    {
+        copy_string(m->version, sizeof(m->version), version);
+        copy_string(m->sha256, sizeof(m->sha256), sha256);
+        m->size = (unsigned long)size->valuedouble;
+        if (url && url->valuestring)
+        {
+            copy_string(m->url, sizeof(m->url), url);
+        }
+        ret = 0;
+    }
+    cJSON_Delete(root);
+    return ret;
+}
+
+// The current path, as in check_firmware_version()
+static int parse_stream(const char *body, size_t len, size_t chunk, manifest_t *m)
+{
+    char size[12];
+    json_stream_field_t fields[] = {
+        {.key = "version", .value = m->version, .value_size = sizeof(m->version)},
+        {.key = "size", .value = size, .value_size = sizeof(size)},
+        {.key = "sha256", .value = m->sha256, .value_size = sizeof(m->sha256)},
+        {.key = "url", .value = m->url, .value_size = sizeof(m->url)},
+    };
+    json_stream_t js;
+    json_stream_init(&js, fields, sizeof(fields) / sizeof(fields[0]));
+    for (size_t pos = 0; pos < len; pos += chunk)
+    {
+        size_t n = len - pos < chunk ? len - pos : chunk;
+        json_stream_feed(&js, body + pos, n);
+    }
+    if (!json_stream_done(&js) || !fields[0].found || !fields[1].found || !fields[2].found)
+    {
+        return -1;
+    }
+    m->size = strtoul(size, NULL, 10);
+    return 0;
+}
+
+// Documents json-stream must reject, whole and a byte at a time
+static const char *const malformed[] = {
+    "{\"size\":tru}",
+    "{\"size\":nul}",
+    "{\"size\":falsey}",
+    "{\"size\":True}",
+    "{\"size\":01}",
+    "{\"size\":-}",
+    "{\"size\":1.}",
+    "{\"size\":.5}",
+    "{\"size\":+1}",
+    "{\"size\":1e}",
+    "{\"size\":1e+}",
+    "{\"size\":1E-+5}",
+    "{\"size\":1.5e3.2}",
+    "{\"size\":1.2.3}",
+    "{\"size\":0x10}",
+    "{\"size\":12abc}",
+    "{\"size\":1048576",
+    "{\"size\" 1}",
+    "{\"size\":1,}",
+    "[1 2]",
+    "1e",
+    "tru",
+};
+
+// And documents it must accept
+static const char *const wellformed[] = {
+    "{\"size\":0,\"a\":[true,false,null],\"b\":-0.5e+3,\"c\":1E9}",
+    "{\"size\":-12.25E-2}",
+    "[0,1,-0,10e0]",
+    "1e5",
+    "true",
+};
+
+static bool stream_accepts(const char *doc, size_t chunk)
+{
+    json_stream_t js;
+    json_stream_init(&js, NULL, 0);
+    size_t len = strlen(doc);
+    for (size_t pos = 0; pos < len; pos += chunk)
+    {
+        json_stream_feed(&js, doc + pos, len - pos < chunk ? len - pos : chunk);
+    }
+    return json_stream_done(&js);
+}
+
+static int check_syntax(void)
+{
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(malformed) / sizeof(malformed[0]); i++)
+    {
+        if (stream_accepts(malformed[i], strlen(malformed[i])) || stream_accepts(malformed[i], 1))
+        {
+            printf("json-stream accepts malformed %s\n", malformed[i]);
+            failed++;
+        }
+    }
+    for (size_t i = 0; i < sizeof(wellformed) / sizeof(wellformed[0]); i++)
+    {
+        if (!stream_accepts(wellformed[i], strlen(wellformed[i])) || !stream_accepts(wellformed[i], 1))
+        {
+            printf("json-stream rejects %s\n", wellformed[i]);
+            failed++;
+        }
+    }
+    printf("syntax: %zu malformed and %zu well-formed documents, %d wrong\n\n",
+           sizeof(malformed) / sizeof(malformed[0]), sizeof(wellformed) / sizeof(wellformed[0]), failed);
+    return failed;
+}
+
+static int run(const char *name, int (*parse)(const char *, size_t, size_t, manifest_t *),
+               const char *body, size_t len, size_t chunk, const manifest_t *expect)
+{
+    manifest_t m = {0};
+    heap_now = heap_peak = heap_calls = 0;
+    if (parse(body, len, chunk, &m) != 0)
+    {
+        printf("%-12s %5zu-byte chunks: parse failed\n", name, chunk);
+        return 1;
+    }
+    size_t peak = heap_peak, calls = heap_calls;
+    if (expect && (strcmp(m.version, expect->version) || strcmp(m.sha256, expect->sha256) ||
+                   strcmp(m.url, expect->url) || m.size != expect->size))
+    {
+        printf("%-12s %5zu-byte chunks: fields differ from cJSON\n", name, chunk);
+        return 1;
+    }
+
+    double start = now_us();
+    for (int i = 0; i < ITERATIONS; i++)
+    {
+        parse(body, len, chunk, &m);
+    }
+    double per_parse = (now_us() - start) / ITERATIONS;
+
+    printf("%-12s %5zu-byte chunks: %7.3f us/parse, peak heap %4zu bytes in %2zu allocations\n",
+           name, chunk, per_parse, peak, calls);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    static char body[4096];
+    size_t len = strlen(default_manifest);
+    memcpy(body, default_manifest, len + 1);
+    if (argc > 1)
+    {
+        FILE *f = fopen(argv[1], "rb");
+        if (!f)
+        {
+            perror(argv[1]);
+            return 1;
+        }
+        len = fread(body, 1, sizeof(body) - 1, f);
+        body[len] = 0;
+        fclose(f);
+    }
+
+    cJSON_Hooks hooks = {.malloc_fn = counting_malloc, .free_fn = counting_free};
+    cJSON_InitHooks(&hooks);
+
+    printf("manifest: %zu bytes\n", len);
+    manifest_t expect = {0};
+    int failed = check_syntax();
+    if (parse_cjson(body, len, len, &expect) != 0)
+    {
+        printf("cJSON cannot parse the manifest\n");
+        return 1;
+    }
+
+    static const size_t chunks[] = {0, 64, 16, 1};
+    for (size_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++)
+    {
+        size_t chunk = chunks[i] ? chunks[i] : len;
+        failed += run("cJSON", parse_cjson, body, len, chunk, NULL);
+        failed += run("json-stream", parse_stream, body, len, chunk, &expect);
+    }
+
+    // The device keeps RESPONSE_BUF_SIZE bytes for cJSON's input on top of its heap
+    printf("\nstatic RAM: cJSON path %d bytes of response buffer, json-stream %zu bytes of state\n",
+           RESPONSE_BUF_SIZE, sizeof(json_stream_t));
+    return failed ? 1 : 0;
+}
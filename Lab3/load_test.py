@@ -0,0 +1,80 @@
+import collections
+import ssl
+import sys
+import threading
+import time
+import urllib.error
+import urllib.request
+
+# Adresa PC-ului pe care ruleaza server.py
+SERVER_URL = "https://127.0.0.1:5000"
+CLIENTS = 100
+
+# Optional: PID-ul procesului server.py, pentru a urmari memoria (Linux)
+SERVER_PID = int(sys.argv[1]) if len(sys.argv) > 1 else None
+
+context = ssl.create_default_context()
+context.check_hostname = False
+context.verify_mode = ssl.CERT_NONE  # self-signed ca_cert.pem
+
+results = []
+statuses = collections.Counter()
+lock = threading.Lock()
+
+
+def get(path, device_id):
+    request = urllib.request.Request(SERVER_URL + path, headers={"X-Device-Id": device_id})
+    try:
+        return urllib.request.urlopen(request, context=context)
+    except urllib.error.HTTPError as e:
+        return e
+
+
+def device(n):
+    # Behaves like one board: ask for the manifest, then fetch the image if offered
+    device_id = f"load-{n:04d}"
+    start = time.perf_counter()
+    received = 0
+    try:
+        with get("/version", device_id) as response:
+            status = f"version {response.status}"
+            response.read()
+        if status == "version 200":
+            with get("/firmware.bin", device_id) as response:
+                status = f"firmware {response.status}"
+                for chunk in iter(lambda: response.read(64 * 1024), b""):
+                    received += len(chunk)
+    except Exception as e:
+        status = f"error {type(e).__name__}"
+    with lock:
+        statuses[status] += 1
+        results.append((received, time.perf_counter() - start))
+
+
+def server_rss_kib():
+    with open(f"/proc/{SERVER_PID}/status") as f:
+        for line in f:
+            if line.startswith("VmRSS:"):
+                return int(line.split()[1])
+    return 0
+
+
+threads = [threading.Thread(target=device, args=(n,)) for n in range(CLIENTS)]
+start = time.perf_counter()
+for t in threads:
+    t.start()
+
+peak_rss = 0
+while any(t.is_alive() for t in threads):
+    if SERVER_PID:
+        peak_rss = max(peak_rss, server_rss_kib())
+    time.sleep(0.05)
+elapsed = time.perf_counter() - start
+
+total = sum(r[0] for r in results)
+print(f"{CLIENTS} devices, {total} bytes in {elapsed:.2f} s ({total / elapsed / 1e6:.1f} MB/s)")
+print(f"Slowest device: {max(r[1] for r in results):.2f} s")
+for status, count in sorted(statuses.items()):
+    print(f"  {status}: {count}")
+if SERVER_PID:
+    print(f"Server peak RSS: {peak_rss} KiB")
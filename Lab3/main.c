@@ -7,6 +7,8 @@
    CONDITIONS OF ANY KIND, either express or implied.
 */
 #include <string.h>
+#include <strings.h>
+#include <stdlib.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
@@ -15,12 +17,11 @@
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_random.h"
 #include "nvs_flash.h"
 #include "esp_http_client.h"
-#include "esp_https_ota.h"
-#include "esp_tls.h"
 #include "version.h"
-#include "cJSON.h"
 
 #include "lwip/err.h"
 #include "lwip/sys.h"
@@ -28,35 +29,59 @@
 #include "lwip/sockets.h"
 #include "lwip/netdb.h"
 
+#include "wifi-manager.h"
+#include "boot-profile.h"
+#include "ota-download.h"
+#include "ota-delta.h"
+#include "ota-inflate.h"
+#include "ota-peer.h"
+#include "json-stream.h"
+
 #define CONFIG_ESP_WIFI_SSID "lab-iot"
 #define CONFIG_ESP_WIFI_PASS "IoT-IoT-IoT"
-#define CONFIG_ESP_MAXIMUM_RETRY 5
 #define CONFIG_LOCAL_PORT 10001
 
 // TODO: Modificati adresa IP de mai jos pentru a coincide cu cea a PC-ul pe care rulati scriptul python
+#define CONFIG_EXAMPLE_VERSION_URL "https://192.168.89.35:5000/version"
 #define CONFIG_EXAMPLE_FIRMWARE_UPGRADE_URL "https://192.168.89.35:5000/firmware.bin"
+#define CONFIG_EXAMPLE_FIRMWARE_PATCH_URL "https://192.168.89.35:5000/firmware.patch"
+#define CONFIG_EXAMPLE_FIRMWARE_COMPRESSED_URL "https://192.168.89.35:5000/firmware.bin.zz"
 
 #define GPIO_OUTPUT_IO 4
 #define GPIO_OUTPUT_PIN_SEL (1ULL << GPIO_OUTPUT_IO)
 #define GPIO_INPUT_IO 2
 #define GPIO_INPUT_PIN_SEL (1ULL << GPIO_INPUT_IO)
 
-/* FreeRTOS event group to signal when we are connected*/
-static EventGroupHandle_t s_wifi_event_group;
-#define WIFI_CONNECTED_BIT BIT0
-#define WIFI_FAIL_BIT BIT1
+// Background update checks: every interval +/- jitter, backing off on errors
+#define OTA_POLL_INTERVAL_MS (15 * 60 * 1000)
+#define OTA_POLL_JITTER_PERCENT 25
+#define OTA_BACKOFF_MIN_MS (30 * 1000)
+#define OTA_BACKOFF_MAX_MS (60 * 60 * 1000)
 
 static EventGroupHandle_t s_event_start_ota;
-#define BIT_BTN_PRESSED BIT0
+#define BIT_BTN_PRESSED BIT0 // check right away instead of waiting for the next poll
 
 static const char *TAG = "simple_ota_example";
 extern const uint8_t server_cert_pem_start[] asm("_binary_ca_cert_pem_start");
 extern const uint8_t server_cert_pem_end[] asm("_binary_ca_cert_pem_end");
 
-static int s_retry_num = 0;
-
-static char response_buffer[100]; // Add this as a global or static variable
+// /version is tokenized as it arrives, straight into the caller's manifest
+static json_stream_t s_manifest_json;
 static int response_len = 0;
+static int response_header_bytes = 0;
+
+static bool s_in_version_check = false;
+
+// ETag of the last manifest that said we are up to date, sent back as If-None-Match
+static char s_manifest_etag[96];
+static char s_response_etag[96];
+
+// Seconds from the last Retry-After header, 0 if none
+static uint32_t s_retry_after_s = 0;
+
+// The whole OTA flow shares one client; every new connection costs a TLS handshake
+static int s_tls_handshakes = 0;
+static int64_t s_first_image_byte_us = 0;
 
 esp_err_t _http_event_handler(esp_http_client_event_t *evt)
 {
@@ -66,23 +91,35 @@ esp_err_t _http_event_handler(esp_http_client_event_t *evt)
         ESP_LOGI(TAG, "HTTP_EVENT_ERROR");
         break;
     case HTTP_EVENT_ON_CONNECTED:
-        response_len = 0; // Reset buffer when connection starts
-        ESP_LOGI(TAG, "HTTP_EVENT_ON_CONNECTED");
+        s_tls_handshakes++;
+        ESP_LOGI(TAG, "HTTP_EVENT_ON_CONNECTED, handshake #%d", s_tls_handshakes);
         break;
     case HTTP_EVENT_HEADER_SENT:
         ESP_LOGI(TAG, "HTTP_EVENT_HEADER_SENT");
         break;
     case HTTP_EVENT_ON_HEADER:
         ESP_LOGI(TAG, "HTTP_EVENT_ON_HEADER, key=%s, value=%s", evt->header_key, evt->header_value);
+        response_header_bytes += strlen(evt->header_key) + strlen(evt->header_value) + 4; // ": " and CRLF
+        if (strcasecmp(evt->header_key, "ETag") == 0)
+        {
+            strlcpy(s_response_etag, evt->header_value, sizeof(s_response_etag));
+        }
+        else if (strcasecmp(evt->header_key, "Retry-After") == 0)
+        {
+            s_retry_after_s = strtoul(evt->header_value, NULL, 10);
+        }
         break;
     case HTTP_EVENT_ON_DATA:
-        if (evt->data_len < (100 - response_len))
+        if (s_in_version_check)
         {
-            memcpy(response_buffer + response_len, evt->data, evt->data_len);
+            json_stream_feed(&s_manifest_json, evt->data, evt->data_len);
             response_len += evt->data_len;
-            response_buffer[response_len] = 0; // Null terminate
+            ESP_LOGI(TAG, "HTTP_EVENT_ON_DATA, len=%d, data=%.*s", evt->data_len, evt->data_len, (char *)evt->data);
+        }
+        else if (s_first_image_byte_us == 0 && esp_http_client_get_status_code(evt->client) / 100 == 2)
+        {
+            s_first_image_byte_us = esp_timer_get_time();
         }
-        ESP_LOGI(TAG, "HTTP_EVENT_ON_DATA, len=%d, data=%s", evt->data_len, (char *)evt->data);
         break;
     case HTTP_EVENT_ON_FINISH:
         ESP_LOGI(TAG, "HTTP_EVENT_ON_FINISH");
@@ -97,220 +134,233 @@ esp_err_t _http_event_handler(esp_http_client_event_t *evt)
     return ESP_OK;
 }
 
-static void event_handler(void *arg, esp_event_base_t event_base,
-                          int32_t event_id, void *event_data)
+/* Returns ESP_OK with *update_needed set, ESP_ERR_NOT_FINISHED when the server
+ * asks us to come back later, or another error */
+static esp_err_t check_firmware_version(esp_http_client_handle_t client, ota_manifest_t *manifest,
+                                        bool *update_needed)
 {
-    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START)
+    *update_needed = false;
+    esp_http_client_set_url(client, CONFIG_EXAMPLE_VERSION_URL);
+    if (s_manifest_etag[0])
     {
-        esp_wifi_connect();
+        esp_http_client_set_header(client, "If-None-Match", s_manifest_etag);
     }
-    else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED)
-    {
-        if (s_retry_num < CONFIG_ESP_MAXIMUM_RETRY)
-        {
-            esp_wifi_connect();
-            s_retry_num++;
-            ESP_LOGI(TAG, "retry to connect to the AP");
-        }
-        else
-        {
-            xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
-        }
-        ESP_LOGI(TAG, "connect to the AP fail");
-    }
-    else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP)
+    response_len = 0;
+    response_header_bytes = 0;
+    s_response_etag[0] = 0;
+
+    char size[12];
+    json_stream_field_t fields[] = {
+        {.key = "version", .value = manifest->version, .value_size = sizeof(manifest->version)},
+        {.key = "size", .value = size, .value_size = sizeof(size)},
+        {.key = "sha256", .value = manifest->sha256, .value_size = sizeof(manifest->sha256)},
+        {.key = "url", .value = manifest->url, .value_size = sizeof(manifest->url)},
+    };
+    json_stream_init(&s_manifest_json, fields, sizeof(fields) / sizeof(fields[0]));
+
+    int64_t start_us = esp_timer_get_time();
+    s_in_version_check = true;
+    esp_err_t err = esp_http_client_perform(client);
+    s_in_version_check = false;
+    int status_code = esp_http_client_get_status_code(client);
+    esp_http_client_delete_header(client, "If-None-Match");
+    if (err != ESP_OK)
     {
-        ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
-        ESP_LOGI(TAG, "got ip:" IPSTR, IP2STR(&event->ip_info.ip));
-        s_retry_num = 0;
-        xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+        ESP_LOGE(TAG, "HTTP GET request failed: %s", esp_err_to_name(err));
+        return err;
     }
-}
 
-bool wifi_init_sta(void)
-{
-    s_wifi_event_group = xEventGroupCreate();
-
-    ESP_ERROR_CHECK(esp_netif_init());
+    ESP_LOGI(TAG, "Version check: HTTP %d, %d header + %d body bytes in %lld ms",
+             status_code, response_header_bytes, response_len, (esp_timer_get_time() - start_us) / 1000);
 
-    ESP_ERROR_CHECK(esp_event_loop_create_default());
-    esp_netif_create_default_wifi_sta();
-
-    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
-    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
-
-    esp_event_handler_instance_t instance_any_id;
-    esp_event_handler_instance_t instance_got_ip;
-    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,
-                                                        ESP_EVENT_ANY_ID,
-                                                        &event_handler,
-                                                        NULL,
-                                                        &instance_any_id));
-    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT,
-                                                        IP_EVENT_STA_GOT_IP,
-                                                        &event_handler,
-                                                        NULL,
-                                                        &instance_got_ip));
-
-    wifi_config_t wifi_config = {
-        .sta = {
-            .ssid = CONFIG_ESP_WIFI_SSID,
-            .password = CONFIG_ESP_WIFI_PASS,
-        },
-    };
-    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
-    ESP_ERROR_CHECK(esp_wifi_start());
-
-    ESP_LOGI(TAG, "wifi_init_sta finished.");
-
-    /* Waiting until either the connection is established (WIFI_CONNECTED_BIT) or connection failed for the maximum
-     * number of re-tries (WIFI_FAIL_BIT). The bits are set by event_handler() (see above) */
-    EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group,
-                                           WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
-                                           pdFALSE,
-                                           pdFALSE,
-                                           portMAX_DELAY);
-
-    /* xEventGroupWaitBits() returns the bits before the call returned, hence we can test which event actually
-     * happened. */
-    if (bits & WIFI_CONNECTED_BIT)
+    if (status_code == 304)
     {
-        ESP_LOGI(TAG, "connected to ap SSID:%s password:%s",
-                 CONFIG_ESP_WIFI_SSID, CONFIG_ESP_WIFI_PASS);
-        return true;
+        // Same manifest as the last check, which already said we are up to date
+        return ESP_OK;
     }
-    else if (bits & WIFI_FAIL_BIT)
+    if (status_code == 204)
     {
-        ESP_LOGI(TAG, "Failed to connect to SSID:%s, password:%s",
-                 CONFIG_ESP_WIFI_SSID, CONFIG_ESP_WIFI_PASS);
+        ESP_LOGI(TAG, "Staged rollout has not reached this device yet");
+        return ESP_OK;
     }
-    else
+    if (status_code == 503)
     {
-        ESP_LOGE(TAG, "UNEXPECTED EVENT");
+        return ESP_ERR_NOT_FINISHED;
     }
-    return false;
-}
-
-static bool check_firmware_version(void)
-{
-    // Initialize global CA store first
-    esp_err_t esp_ret = esp_tls_init_global_ca_store();
-    if (esp_ret != ESP_OK)
+    if (status_code != 200 || !json_stream_done(&s_manifest_json) ||
+        !fields[0].found || !fields[1].found || !fields[2].found)
     {
-        ESP_LOGE(TAG, "Failed to initialize global CA store: %d", esp_ret);
-        return false;
+        ESP_LOGE(TAG, "Invalid manifest (HTTP %d)", status_code);
+        return ESP_ERR_INVALID_RESPONSE;
     }
-
-    esp_ret = esp_tls_set_global_ca_store((unsigned char *)server_cert_pem_start,
-                                          server_cert_pem_end - server_cert_pem_start);
-    if (esp_ret != ESP_OK)
+    manifest->size = strtoul(size, NULL, 10);
+    if (!fields[3].found)
     {
-        ESP_LOGE(TAG, "Failed to set global CA store: %d", esp_ret);
-        return false;
+        manifest->url[0] = 0;
     }
 
-    bool update_needed = false;
+    ESP_LOGI(TAG, "Current firmware version: %s", VERSION_SHORT);
+    ESP_LOGI(TAG, "Server firmware version: %s", manifest->version);
+
+    *update_needed = ota_version_compare(VERSION_SHORT, manifest->version) < 0;
+    ESP_LOGI(TAG, "Update needed: %s", *update_needed ? "Yes" : "No");
+    // Only an up-to-date answer may be short-circuited next time: if the
+    // update fails we must still see the manifest again
+    strlcpy(s_manifest_etag, *update_needed ? "" : s_response_etag, sizeof(s_manifest_etag));
+    return ESP_OK;
+}
+
+static void link_state_cb(bool link_up, void *ctx)
+{
+    if (link_up)
+    {
+        boot_profile_finish();
+    }
+}
 
+/* One check, and the update if there is one. Only returns when no new image was
+ * installed: ESP_OK if there was nothing to do, otherwise why it failed */
+static esp_err_t run_update_check(void)
+{
+    // One client, and so one TLS session, for the version check and every download
     esp_http_client_config_t config = {
-        .url = "https://192.168.89.35:5000/version",
+        .url = CONFIG_EXAMPLE_VERSION_URL,
         .cert_pem = (char *)server_cert_pem_start,
         .cert_len = server_cert_pem_end - server_cert_pem_start,
         .event_handler = _http_event_handler,
         .keep_alive_enable = true,
-        .use_global_ca_store = true,
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+        // Reconnects (e.g. after a dropped download) resume the session instead of a full handshake
+        .save_client_session = true,
+#endif
         .skip_cert_common_name_check = true};
-
     esp_http_client_handle_t client = esp_http_client_init(&config);
     if (client == NULL)
     {
         ESP_LOGE(TAG, "Failed to initialize HTTP client");
-        return false;
-    }
-
-    esp_err_t err = esp_http_client_perform(client);
-    if (err == ESP_OK)
-    {
-        int status_code = esp_http_client_get_status_code(client);
-        ESP_LOGI(TAG, "HTTP Status = %d, Response = %s", status_code, response_buffer);
-
-        if (status_code == 200 && response_len > 0)
-        {
-            cJSON *root = cJSON_Parse(response_buffer);
-            if (root)
-            {
-                cJSON *version = cJSON_GetObjectItem(root, "version");
-                if (version && version->valuestring)
-                {
-                    ESP_LOGI(TAG, "Current firmware version: %s", VERSION_SHORT);
-                    ESP_LOGI(TAG, "Server firmware version: %s", version->valuestring);
-
-                    update_needed = strcmp(VERSION_SHORT, version->valuestring) < 0;
-                    ESP_LOGI(TAG, "Update needed: %s", update_needed ? "Yes" : "No");
-                    cJSON_Delete(root);
-                    esp_http_client_cleanup(client);
-                    return update_needed;
-                }
-                cJSON_Delete(root);
-            }
-            else
-            {
-                ESP_LOGE(TAG, "Failed to parse JSON: %s", response_buffer);
-            }
-        }
-    }
-    else
-    {
-        ESP_LOGE(TAG, "HTTP GET request failed: %s", esp_err_to_name(err));
+        return ESP_ERR_NO_MEM;
     }
 
-    esp_http_client_cleanup(client);
-    return false;
-}
+    // The server picks our rollout group and slot from this
+    uint8_t mac[6];
+    char device_id[18];
+    esp_wifi_get_mac(WIFI_IF_STA, mac);
+    snprintf(device_id, sizeof(device_id), "%02x:%02x:%02x:%02x:%02x:%02x",
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    esp_http_client_set_header(client, "X-Device-Id", device_id);
 
-static void ota_task(void *pvParameters)
-{
-    xEventGroupWaitBits(s_event_start_ota, BIT_BTN_PRESSED, pdTRUE, pdTRUE, portMAX_DELAY);
+    ota_manifest_t manifest = {0};
+    bool update_needed = false;
+    s_tls_handshakes = 0;
 
+    int64_t start_us = esp_timer_get_time();
     ESP_LOGI(TAG, "Checking for firmware updates...");
-    if (!check_firmware_version())
+    esp_err_t ret = check_firmware_version(client, &manifest, &update_needed);
+    if (ret != ESP_OK || !update_needed)
     {
-        ESP_LOGI(TAG, "Current firmware is up to date");
-        vTaskDelete(NULL);
-        return;
+        esp_http_client_cleanup(client);
+        return ret;
     }
 
     ESP_LOGI(TAG, "Starting OTA update");
-    esp_http_client_config_t config = {
-        .url = CONFIG_EXAMPLE_FIRMWARE_UPGRADE_URL,
-        .cert_pem = (char *)server_cert_pem_start,
-        .cert_len = 1422,
-        .event_handler = _http_event_handler,
-        .keep_alive_enable = true,
-        .use_global_ca_store = true,
-        .skip_cert_common_name_check = true};
+    s_first_image_byte_us = 0;
 
-    esp_https_ota_config_t ota_config = {
-        .http_config = &config,
-    };
+    // A neighbour that already installed this image costs the server nothing.
+    // The manifest (and its hash) still comes from the server, so a peer cannot lie.
+    ret = ota_peer_download(&manifest);
+    if (ret != ESP_OK && ret != ESP_ERR_NOT_FOUND)
+    {
+        ESP_LOGW(TAG, "Peer download failed (%s), falling back to the server", esp_err_to_name(ret));
+    }
 
-    ESP_ERROR_CHECK(esp_tls_init_global_ca_store());
-    ESP_ERROR_CHECK(esp_tls_set_global_ca_store((unsigned char *)server_cert_pem_start, server_cert_pem_end - server_cert_pem_start));
+    // Ask for a patch against the version we are running first, then the compressed
+    // image, and only then the raw one (the only path that survives a dropped link).
+    // A busy server (ESP_ERR_NOT_FINISHED) ends the chain, we come back after Retry-After.
+    // A raw download of this image that was cut short goes on where it stopped instead.
+    bool resuming = ret != ESP_OK && ota_download_has_progress(&manifest);
+    if (resuming)
+    {
+        ESP_LOGI(TAG, "Interrupted download of this image found, resuming it");
+    }
+    if (ret != ESP_OK && !resuming)
+    {
+        char patch_url[128];
+        snprintf(patch_url, sizeof(patch_url), "%s?from=%s", CONFIG_EXAMPLE_FIRMWARE_PATCH_URL, VERSION_SHORT);
+        esp_http_client_set_url(client, patch_url);
 
-    ESP_LOGI(TAG, "Attempting to download update from %s", config.url);
-    esp_err_t ret = esp_https_ota(&ota_config);
+        ESP_LOGI(TAG, "Attempting delta update from %s", patch_url);
+        ret = ota_delta_apply(client, &manifest);
+    }
+    if (ret != ESP_OK && ret != ESP_ERR_NOT_FINISHED && !resuming)
+    {
+        ESP_LOGW(TAG, "Delta update not applied (%s), downloading compressed image", esp_err_to_name(ret));
+        esp_http_client_set_url(client, CONFIG_EXAMPLE_FIRMWARE_COMPRESSED_URL);
+        ret = ota_inflate_download(client, &manifest);
+    }
+    if (ret != ESP_OK && ret != ESP_ERR_NOT_FINISHED)
+    {
+        ESP_LOGW(TAG, "Compressed update not applied (%s), downloading full image", esp_err_to_name(ret));
+        const char *url = manifest.url[0] ? manifest.url : CONFIG_EXAMPLE_FIRMWARE_UPGRADE_URL;
+        esp_http_client_set_url(client, url);
+        ESP_LOGI(TAG, "Attempting to download %lu bytes from %s", (unsigned long)manifest.size, url);
+        ret = ota_download_resumable(client, &manifest);
+    }
+    esp_http_client_cleanup(client);
+    ESP_LOGI(TAG, "%d TLS handshake(s), first firmware byte after %lld ms",
+             s_tls_handshakes, s_first_image_byte_us ? (s_first_image_byte_us - start_us) / 1000 : -1);
+    ESP_LOGI(TAG, "Update finished in %lld ms", (esp_timer_get_time() - start_us) / 1000);
     if (ret == ESP_OK)
     {
         ESP_LOGI(TAG, "OTA Succeed, Rebooting...");
+        ota_peer_remember(&manifest);
         esp_restart();
     }
-    else
-    {
-        ESP_LOGE(TAG, "Firmware upgrade failed");
-    }
+    ESP_LOGE(TAG, "Firmware upgrade failed: %s", esp_err_to_name(ret));
+    return ret;
+}
+
+static uint32_t random_between(uint32_t lo, uint32_t hi)
+{
+    return lo + esp_random() % (hi - lo + 1);
+}
+
+static void ota_task(void *pvParameters)
+{
+    // A whole fleet powering on together must not check in the same second:
+    // the first check lands anywhere in the first interval
+    uint32_t delay_ms = random_between(0, OTA_POLL_INTERVAL_MS);
+    uint32_t backoff_ms = OTA_BACKOFF_MIN_MS;
+
+    // Offer the running image to neighbours if it came from an update
+    wifi_manager_wait_connected(portMAX_DELAY);
+    ota_peer_start();
+
     while (1)
     {
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
+        ESP_LOGI(TAG, "Next update check in %lu s", (unsigned long)delay_ms / 1000);
+        xEventGroupWaitBits(s_event_start_ota, BIT_BTN_PRESSED, pdTRUE, pdTRUE, pdMS_TO_TICKS(delay_ms));
+        wifi_manager_wait_connected(portMAX_DELAY);
+
+        s_retry_after_s = 0;
+        esp_err_t err = run_update_check();
+
+        if (err == ESP_OK)
+        {
+            backoff_ms = OTA_BACKOFF_MIN_MS;
+            uint32_t jitter = OTA_POLL_INTERVAL_MS / 100 * OTA_POLL_JITTER_PERCENT;
+            delay_ms = random_between(OTA_POLL_INTERVAL_MS - jitter, OTA_POLL_INTERVAL_MS + jitter);
+        }
+        else if (s_retry_after_s > 0)
+        {
+            // Wait at least as long as asked, spread so refused devices do not return together
+            uint32_t retry_ms = s_retry_after_s > OTA_BACKOFF_MAX_MS / 1000 ? OTA_BACKOFF_MAX_MS : s_retry_after_s * 1000;
+            delay_ms = random_between(retry_ms, retry_ms + retry_ms / 100 * OTA_POLL_JITTER_PERCENT);
+        }
+        else
+        {
+            delay_ms = random_between(backoff_ms / 2, backoff_ms);
+            backoff_ms = backoff_ms * 2 > OTA_BACKOFF_MAX_MS ? OTA_BACKOFF_MAX_MS : backoff_ms * 2;
+        }
     }
 }
 
@@ -368,23 +418,34 @@ void gpio_init()
 void app_main(void)
 {
     // Initialize NVS
+    int phase = boot_profile_begin("nvs_init");
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND)
     {
+        int erase_phase = boot_profile_begin("nvs_erase_retry");
         ESP_ERROR_CHECK(nvs_flash_erase());
         ret = nvs_flash_init();
+        boot_profile_end(erase_phase);
     }
     ESP_ERROR_CHECK(ret);
+    boot_profile_end(phase);
 
+    phase = boot_profile_begin("gpio_init");
     gpio_init();
+    boot_profile_end(phase);
 
-    ESP_LOGI(TAG, "ESP_WIFI_MODE_STA");
-    bool connected = wifi_init_sta();
+    phase = boot_profile_begin("netif_init");
+    ESP_ERROR_CHECK(esp_netif_init());
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+    boot_profile_end(phase);
 
-    if (connected)
-    {
-        s_event_start_ota = xEventGroupCreate();
-        xTaskCreate(ota_task, "ota_task", 8192, NULL, 5, NULL);
-        xTaskCreate(button_task, "button_task", 4096, NULL, 5, NULL);
-    }
+    ESP_LOGI(TAG, "ESP_WIFI_MODE_STA");
+    phase = boot_profile_begin("wifi_start");
+    ESP_ERROR_CHECK(wifi_manager_start(CONFIG_ESP_WIFI_SSID, CONFIG_ESP_WIFI_PASS));
+    boot_profile_end(phase);
+    wifi_manager_subscribe(link_state_cb, NULL);
+
+    s_event_start_ota = xEventGroupCreate();
+    xTaskCreate(ota_task, "ota_task", 8192, NULL, 5, NULL);
+    xTaskCreate(button_task, "button_task", 4096, NULL, 5, NULL);
 }
\ No newline at end of file
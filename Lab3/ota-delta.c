@@ -0,0 +1,275 @@
+#include <string.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_http_client.h"
+#include "mbedtls/sha256.h"
+
+#include "ota-delta.h"
+#include "ota-download.h"
+
+#define DELTA_MAGIC "EDP1"
+#define DELTA_OP_COPY 0x01
+#define DELTA_OP_INSERT 0x02
+
+static const char *TAG = "ota-delta";
+
+typedef enum
+{
+    DELTA_HEADER, // collecting magic + target size
+    DELTA_OP,     // collecting an op byte and its parameters
+    DELTA_INSERT, // passing literal bytes through
+    DELTA_DONE,
+} delta_state_t;
+
+typedef struct
+{
+    delta_state_t state;
+    uint8_t hdr[9]; // largest header: COPY op + two u32
+    size_t hdr_len;
+    size_t hdr_need;
+    uint32_t target_size;
+    uint32_t produced;
+    uint32_t insert_left;
+    const esp_partition_t *source;
+    const esp_partition_t *partition;
+    esp_ota_handle_t ota_handle; // 0 until the first image byte
+    mbedtls_sha256_context sha;
+    uint8_t copy_buf[OTA_DELTA_COPY_BUF_SIZE];
+} delta_ctx_t;
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static esp_err_t emit(delta_ctx_t *ctx, const uint8_t *data, size_t len)
+{
+    if (ctx->produced + len > ctx->target_size)
+    {
+        ESP_LOGE(TAG, "Patch produces more than %lu bytes", (unsigned long)ctx->target_size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (ctx->ota_handle == 0)
+    {
+        // First image byte: only now does the passive partition get overwritten,
+        // so a patch that is missing or breaks early leaves a resumable download alone
+        ota_download_clear_progress();
+        esp_err_t err = esp_ota_begin(ctx->partition, OTA_WITH_SEQUENTIAL_WRITES, &ctx->ota_handle);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+    }
+    mbedtls_sha256_update(&ctx->sha, data, len);
+    ctx->produced += len;
+    return esp_ota_write(ctx->ota_handle, data, len);
+}
+
+static esp_err_t copy_from_source(delta_ctx_t *ctx, uint32_t src_offset, uint32_t length)
+{
+    if (src_offset + length > ctx->source->size || src_offset + length < src_offset)
+    {
+        ESP_LOGE(TAG, "Copy 0x%lx+%lu outside running partition", (unsigned long)src_offset, (unsigned long)length);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    while (length > 0)
+    {
+        size_t n = length < sizeof(ctx->copy_buf) ? length : sizeof(ctx->copy_buf);
+        esp_err_t err = esp_partition_read(ctx->source, src_offset, ctx->copy_buf, n);
+        if (err == ESP_OK)
+        {
+            err = emit(ctx, ctx->copy_buf, n);
+        }
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+        src_offset += n;
+        length -= n;
+    }
+    return ESP_OK;
+}
+
+/* Called once hdr holds hdr_need bytes */
+static esp_err_t handle_header(delta_ctx_t *ctx)
+{
+    esp_err_t err = ESP_OK;
+
+    if (ctx->state == DELTA_HEADER)
+    {
+        if (memcmp(ctx->hdr, DELTA_MAGIC, 4) != 0)
+        {
+            ESP_LOGE(TAG, "Bad patch magic");
+            return ESP_ERR_INVALID_VERSION;
+        }
+        ctx->target_size = get_u32(ctx->hdr + 4);
+        ctx->state = DELTA_OP;
+        ctx->hdr_need = 1;
+    }
+    else if (ctx->hdr_len == 1)
+    {
+        // Op byte alone: now we know how many parameter bytes follow
+        if (ctx->hdr[0] == DELTA_OP_COPY)
+        {
+            ctx->hdr_need = 9;
+        }
+        else if (ctx->hdr[0] == DELTA_OP_INSERT)
+        {
+            ctx->hdr_need = 5;
+        }
+        else
+        {
+            ESP_LOGE(TAG, "Bad patch op 0x%02x", ctx->hdr[0]);
+            return ESP_ERR_INVALID_ARG;
+        }
+        return ESP_OK;
+    }
+    else if (ctx->hdr[0] == DELTA_OP_COPY)
+    {
+        err = copy_from_source(ctx, get_u32(ctx->hdr + 1), get_u32(ctx->hdr + 5));
+        ctx->hdr_need = 1;
+    }
+    else
+    {
+        ctx->insert_left = get_u32(ctx->hdr + 1);
+        ctx->state = ctx->insert_left ? DELTA_INSERT : DELTA_OP;
+        ctx->hdr_need = 1;
+    }
+
+    ctx->hdr_len = 0;
+    if (ctx->produced == ctx->target_size && ctx->state != DELTA_INSERT)
+    {
+        ctx->state = DELTA_DONE;
+    }
+    return err;
+}
+
+static esp_err_t delta_feed(delta_ctx_t *ctx, const uint8_t *data, size_t len)
+{
+    while (len > 0)
+    {
+        esp_err_t err = ESP_OK;
+        size_t n;
+
+        switch (ctx->state)
+        {
+        case DELTA_HEADER:
+        case DELTA_OP:
+            n = ctx->hdr_need - ctx->hdr_len;
+            n = n < len ? n : len;
+            memcpy(ctx->hdr + ctx->hdr_len, data, n);
+            ctx->hdr_len += n;
+            if (ctx->hdr_len == ctx->hdr_need)
+            {
+                err = handle_header(ctx);
+            }
+            break;
+
+        case DELTA_INSERT:
+            n = ctx->insert_left < len ? ctx->insert_left : len;
+            err = emit(ctx, data, n);
+            ctx->insert_left -= n;
+            if (ctx->insert_left == 0)
+            {
+                ctx->state = ctx->produced == ctx->target_size ? DELTA_DONE : DELTA_OP;
+            }
+            break;
+
+        default:
+            ESP_LOGE(TAG, "Trailing data after end of patch");
+            return ESP_ERR_INVALID_SIZE;
+        }
+
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+        data += n;
+        len -= n;
+    }
+    return ESP_OK;
+}
+
+esp_err_t ota_delta_apply(esp_http_client_handle_t client,
+                          const ota_manifest_t *manifest)
+{
+    int64_t start_us = esp_timer_get_time();
+    uint32_t patch_bytes = 0;
+
+    int status_code;
+    esp_err_t err = ota_http_get(client, 0, &status_code);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    if (status_code != 200)
+    {
+        ESP_LOGI(TAG, "No patch available (HTTP %d)", status_code);
+        ota_http_finish(client);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    delta_ctx_t *ctx = calloc(1, sizeof(delta_ctx_t));
+    if (ctx == NULL)
+    {
+        esp_http_client_close(client);
+        return ESP_ERR_NO_MEM;
+    }
+    ctx->state = DELTA_HEADER;
+    ctx->hdr_need = 8;
+    ctx->source = esp_ota_get_running_partition();
+    ctx->partition = esp_ota_get_next_update_partition(NULL);
+    mbedtls_sha256_init(&ctx->sha);
+    mbedtls_sha256_starts(&ctx->sha, 0);
+
+    char buf[OTA_DOWNLOAD_BUF_SIZE];
+    while (err == ESP_OK && ctx->state != DELTA_DONE)
+    {
+        int len = esp_http_client_read(client, buf, sizeof(buf));
+        if (len <= 0)
+        {
+            ESP_LOGE(TAG, "Patch stream ended at %lu bytes", (unsigned long)patch_bytes);
+            err = ESP_FAIL;
+            break;
+        }
+        patch_bytes += len;
+        err = delta_feed(ctx, (const uint8_t *)buf, len);
+    }
+
+    ota_http_finish(client);
+
+    if (err == ESP_OK)
+    {
+        uint8_t digest[32];
+        mbedtls_sha256_finish(&ctx->sha, digest);
+        err = ota_check_sha256(digest, manifest->sha256);
+    }
+    if (err == ESP_OK)
+    {
+        err = esp_ota_end(ctx->ota_handle);
+    }
+    else if (ctx->ota_handle)
+    {
+        esp_ota_abort(ctx->ota_handle);
+    }
+    if (err == ESP_OK)
+    {
+        err = esp_ota_set_boot_partition(ctx->partition);
+    }
+
+    if (err == ESP_OK)
+    {
+        ESP_LOGI(TAG, "Delta applied: %lu patch bytes -> %lu image bytes in %lld ms",
+                 (unsigned long)patch_bytes, (unsigned long)ctx->produced,
+                 (esp_timer_get_time() - start_us) / 1000);
+    }
+
+    mbedtls_sha256_free(&ctx->sha);
+    free(ctx);
+    return err;
+}
@@ -0,0 +1,28 @@
+#ifndef _OTA_DELTA_H_
+#define _OTA_DELTA_H_
+
+#include "esp_err.h"
+#include "esp_http_client.h"
+#include "ota-download.h"
+
+// Chunk size used when copying ranges out of the running partition
+#define OTA_DELTA_COPY_BUF_SIZE 1024
+
+/**
+ * @brief Rebuild the new image from a delta patch (see delta.py for the format)
+ *
+ * The patch is streamed from the client's current URL and applied against the
+ * running partition straight into the passive OTA partition, so RAM use is bounded by
+ * one receive buffer and one copy buffer regardless of the image size. The
+ * rebuilt image is hashed on the fly and checked against manifest->sha256.
+ * The passive partition, and with it the progress of an interrupted full
+ * download, is only given up once the patch produces its first image byte.
+ *
+ * @return ESP_OK when the new partition is set as boot partition,
+ *         ESP_ERR_NOT_FOUND when the server has no patch for our version
+ *         (the caller should fall back to a full download), or another error
+ */
+esp_err_t ota_delta_apply(esp_http_client_handle_t client,
+                          const ota_manifest_t *manifest);
+
+#endif
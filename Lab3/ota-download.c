@@ -0,0 +1,398 @@
+#include <string.h>
+#include <stdio.h>
+#include <strings.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_http_client.h"
+#include "nvs_flash.h"
+#include "nvs.h"
+#include "mbedtls/sha256.h"
+
+#include "ota-download.h"
+
+#define NVS_NAMESPACE "ota_dl"
+#define FLASH_SECTOR_SIZE 4096
+#define ALIGN_UP_SECTOR(x) (((x) + FLASH_SECTOR_SIZE - 1) & ~(FLASH_SECTOR_SIZE - 1))
+
+static const char *TAG = "ota-download";
+
+typedef struct
+{
+    const esp_partition_t *partition;
+    uint32_t size;         // total image size from the manifest
+    uint32_t offset;       // bytes written so far
+    uint32_t erased_to;    // first byte of the partition not erased yet
+    uint32_t saved_offset; // last offset persisted to NVS
+    bool hash_valid;       // sha covers [0, offset), i.e. nothing came from a previous boot
+    mbedtls_sha256_context sha;
+} ota_progress_t;
+
+static void save_progress(ota_progress_t *p)
+{
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle) != ESP_OK)
+    {
+        return;
+    }
+    nvs_set_u32(nvs_handle, "offset", p->offset);
+    nvs_commit(nvs_handle);
+    nvs_close(nvs_handle);
+    p->saved_offset = p->offset;
+}
+
+/* Returns the offset to resume from, or 0 when the saved progress belongs to
+ * another image or another partition */
+static uint32_t load_progress(const ota_manifest_t *manifest, const esp_partition_t *partition)
+{
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle) != ESP_OK)
+    {
+        return 0;
+    }
+
+    char sha256[65];
+    size_t sha256_len = sizeof(sha256);
+    uint32_t address = 0;
+    uint32_t offset = 0;
+    bool same_image = nvs_get_str(nvs_handle, "sha256", sha256, &sha256_len) == ESP_OK &&
+                      strcasecmp(sha256, manifest->sha256) == 0 &&
+                      nvs_get_u32(nvs_handle, "part", &address) == ESP_OK &&
+                      address == partition->address &&
+                      nvs_get_u32(nvs_handle, "offset", &offset) == ESP_OK &&
+                      offset <= manifest->size;
+
+    if (!same_image)
+    {
+        offset = 0;
+        nvs_set_str(nvs_handle, "sha256", manifest->sha256);
+        nvs_set_u32(nvs_handle, "part", partition->address);
+        nvs_set_u32(nvs_handle, "offset", 0);
+        nvs_commit(nvs_handle);
+    }
+    nvs_close(nvs_handle);
+    return offset;
+}
+
+bool ota_download_has_progress(const ota_manifest_t *manifest)
+{
+    const esp_partition_t *partition = esp_ota_get_next_update_partition(NULL);
+    nvs_handle_t nvs_handle;
+    if (partition == NULL || nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle) != ESP_OK)
+    {
+        return false;
+    }
+
+    char sha256[65];
+    size_t sha256_len = sizeof(sha256);
+    uint32_t address = 0;
+    uint32_t offset = 0;
+    bool resumable = nvs_get_str(nvs_handle, "sha256", sha256, &sha256_len) == ESP_OK &&
+                     strcasecmp(sha256, manifest->sha256) == 0 &&
+                     nvs_get_u32(nvs_handle, "part", &address) == ESP_OK &&
+                     address == partition->address &&
+                     nvs_get_u32(nvs_handle, "offset", &offset) == ESP_OK &&
+                     offset > 0 && offset <= manifest->size;
+    nvs_close(nvs_handle);
+    return resumable;
+}
+
+int ota_version_compare(const char *a, const char *b)
+{
+    while (*a || *b)
+    {
+        char *end_a, *end_b;
+        unsigned long part_a = strtoul(a, &end_a, 10);
+        unsigned long part_b = strtoul(b, &end_b, 10);
+        if (part_a != part_b)
+        {
+            return part_a < part_b ? -1 : 1;
+        }
+        // Anything after a component that is not a '.' (e.g. "-rc1") is ignored
+        a = *end_a == '.' ? end_a + 1 : end_a + strlen(end_a);
+        b = *end_b == '.' ? end_b + 1 : end_b + strlen(end_b);
+    }
+    return 0;
+}
+
+void ota_download_clear_progress(void)
+{
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle) == ESP_OK)
+    {
+        nvs_erase_all(nvs_handle);
+        nvs_commit(nvs_handle);
+        nvs_close(nvs_handle);
+    }
+}
+
+static esp_err_t write_chunk(ota_progress_t *p, const char *data, size_t len)
+{
+    uint32_t end = p->offset + len;
+    if (end > p->size)
+    {
+        ESP_LOGE(TAG, "Server sent more than the advertised %lu bytes", (unsigned long)p->size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // Erase lazily, one sector ahead of the data, so resuming never wipes what is already written
+    if (end > p->erased_to)
+    {
+        uint32_t erase_end = ALIGN_UP_SECTOR(end);
+        esp_err_t err = esp_partition_erase_range(p->partition, p->erased_to, erase_end - p->erased_to);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+        p->erased_to = erase_end;
+    }
+
+    esp_err_t err = esp_partition_write(p->partition, p->offset, data, len);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    p->offset = end;
+
+    if (p->offset - p->saved_offset >= OTA_PROGRESS_SAVE_BYTES)
+    {
+        save_progress(p);
+    }
+    return ESP_OK;
+}
+
+esp_err_t ota_http_get(esp_http_client_handle_t client, uint32_t offset, int *status_code)
+{
+    if (offset > 0)
+    {
+        char range[32];
+        snprintf(range, sizeof(range), "bytes=%lu-", (unsigned long)offset);
+        esp_http_client_set_header(client, "Range", range);
+    }
+    else
+    {
+        esp_http_client_delete_header(client, "Range");
+    }
+    esp_http_client_set_method(client, HTTP_METHOD_GET);
+
+    esp_err_t err = ESP_FAIL;
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        err = esp_http_client_open(client, 0);
+        // Everything server.py sends has a Content-Length, so < 0 means no response
+        if (err == ESP_OK && esp_http_client_fetch_headers(client) >= 0)
+        {
+            *status_code = esp_http_client_get_status_code(client);
+            if (*status_code == 503)
+            {
+                ESP_LOGW(TAG, "Server busy, try again later");
+                ota_http_finish(client);
+                return ESP_ERR_NOT_FINISHED;
+            }
+            return ESP_OK;
+        }
+        esp_http_client_close(client);
+        err = err != ESP_OK ? err : ESP_FAIL;
+    }
+    return err;
+}
+
+void ota_http_finish(esp_http_client_handle_t client)
+{
+    if (esp_http_client_is_complete_data_received(client))
+    {
+        return;
+    }
+    // Error pages are short, draining one is cheaper than a new handshake
+    if (esp_http_client_get_status_code(client) >= 300 &&
+        esp_http_client_flush_response(client, NULL) == ESP_OK)
+    {
+        return;
+    }
+    esp_http_client_close(client);
+}
+
+static void restart_hash(ota_progress_t *p)
+{
+    mbedtls_sha256_free(&p->sha);
+    mbedtls_sha256_init(&p->sha);
+    mbedtls_sha256_starts(&p->sha, 0);
+    p->hash_valid = true;
+}
+
+static esp_err_t fetch_from_offset(esp_http_client_handle_t client, ota_progress_t *p)
+{
+    int status_code;
+    esp_err_t err = ota_http_get(client, p->offset, &status_code);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    if (status_code == 200 && p->offset > 0)
+    {
+        ESP_LOGW(TAG, "Server ignored the Range request, restarting from 0");
+        p->offset = 0;
+        p->erased_to = 0;
+        save_progress(p);
+        restart_hash(p);
+    }
+    else if (status_code != 200 && status_code != 206)
+    {
+        ESP_LOGE(TAG, "Unexpected HTTP status %d", status_code);
+        ota_http_finish(client);
+        return ESP_FAIL;
+    }
+
+    // Flash erase dominates the download time, and the TCP window covers only a
+    // fraction of one erase, so a separate writer task saves no more than a few
+    // percent (pipeline_sim.py); read, hash and write in this task
+    char buf[OTA_DOWNLOAD_BUF_SIZE];
+    while (p->offset < p->size)
+    {
+        int len = esp_http_client_read(client, buf, sizeof(buf));
+        if (len <= 0)
+        {
+            // Connection dropped or timed out before the image was complete
+            err = ESP_FAIL;
+            break;
+        }
+        err = write_chunk(p, buf, len);
+        if (err != ESP_OK)
+        {
+            break;
+        }
+        // Only once written, so the hash keeps covering [0, offset)
+        mbedtls_sha256_update(&p->sha, (const uint8_t *)buf, len);
+    }
+
+    ota_http_finish(client);
+    return err;
+}
+
+esp_err_t ota_check_sha256(const uint8_t digest[32], const char *expected)
+{
+    char hex[65];
+    for (int i = 0; i < 32; i++)
+    {
+        sprintf(hex + i * 2, "%02x", digest[i]);
+    }
+    if (strcasecmp(hex, expected) != 0)
+    {
+        ESP_LOGE(TAG, "SHA-256 mismatch: got %s, expected %s", hex, expected);
+        return ESP_ERR_INVALID_CRC;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t verify_sha256(const esp_partition_t *partition, uint32_t size, const char *expected)
+{
+    mbedtls_sha256_context ctx;
+    uint8_t buf[1024];
+    uint8_t digest[32];
+    esp_err_t err = ESP_OK;
+
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts(&ctx, 0);
+    for (uint32_t offset = 0; offset < size; offset += sizeof(buf))
+    {
+        size_t len = size - offset < sizeof(buf) ? size - offset : sizeof(buf);
+        err = esp_partition_read(partition, offset, buf, len);
+        if (err != ESP_OK)
+        {
+            break;
+        }
+        mbedtls_sha256_update(&ctx, buf, len);
+    }
+    mbedtls_sha256_finish(&ctx, digest);
+    mbedtls_sha256_free(&ctx);
+
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    return ota_check_sha256(digest, expected);
+}
+
+esp_err_t ota_download_resumable(esp_http_client_handle_t client,
+                                 const ota_manifest_t *manifest)
+{
+    const esp_partition_t *partition = esp_ota_get_next_update_partition(NULL);
+    if (partition == NULL)
+    {
+        ESP_LOGE(TAG, "No passive OTA partition");
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (manifest->size == 0 || manifest->size > partition->size)
+    {
+        ESP_LOGE(TAG, "Image size %lu does not fit partition", (unsigned long)manifest->size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    ota_progress_t p = {
+        .partition = partition,
+        .size = manifest->size};
+    p.offset = load_progress(manifest, partition);
+    p.saved_offset = p.offset;
+    mbedtls_sha256_init(&p.sha);
+    if (p.offset == 0)
+    {
+        restart_hash(&p);
+    }
+    // The sector holding `offset` was erased when its first byte was written
+    p.erased_to = ALIGN_UP_SECTOR(p.offset);
+
+    if (p.offset > 0)
+    {
+        ESP_LOGI(TAG, "Resuming download at %lu/%lu bytes", (unsigned long)p.offset, (unsigned long)p.size);
+    }
+
+    esp_err_t err = ESP_OK;
+    for (int attempt = 0; attempt < OTA_DOWNLOAD_MAX_ATTEMPTS && p.offset < p.size; attempt++)
+    {
+        err = fetch_from_offset(client, &p);
+        save_progress(&p);
+        if (err == ESP_ERR_NOT_FINISHED)
+        {
+            break; // the caller honours Retry-After, hammering a full server helps nobody
+        }
+        if (p.offset < p.size)
+        {
+            ESP_LOGW(TAG, "Download interrupted at %lu/%lu bytes (%s), retrying",
+                     (unsigned long)p.offset, (unsigned long)p.size, esp_err_to_name(err));
+            vTaskDelay(pdMS_TO_TICKS(1000 << attempt));
+        }
+    }
+
+    if (p.offset < p.size)
+    {
+        // Progress stays in NVS, the next call picks up from here
+        mbedtls_sha256_free(&p.sha);
+        return err != ESP_OK ? err : ESP_FAIL;
+    }
+
+    if (p.hash_valid)
+    {
+        uint8_t digest[32];
+        mbedtls_sha256_finish(&p.sha, digest);
+        err = ota_check_sha256(digest, manifest->sha256);
+    }
+    else
+    {
+        // Part of the image was written before a reboot, hash it back from flash
+        err = verify_sha256(partition, p.size, manifest->sha256);
+    }
+    mbedtls_sha256_free(&p.sha);
+    if (err != ESP_OK)
+    {
+        ota_download_clear_progress();
+        return err;
+    }
+
+    err = esp_ota_set_boot_partition(partition);
+    ota_download_clear_progress();
+    return err;
+}
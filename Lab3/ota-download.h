@@ -0,0 +1,75 @@
+#ifndef _OTA_DOWNLOAD_H_
+#define _OTA_DOWNLOAD_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_http_client.h"
+
+// Progress is written to NVS every OTA_PROGRESS_SAVE_BYTES of image data
+#define OTA_PROGRESS_SAVE_BYTES (64 * 1024)
+// Connection drops tolerated inside one ota_download_resumable() call
+#define OTA_DOWNLOAD_MAX_ATTEMPTS 5
+#define OTA_DOWNLOAD_BUF_SIZE 2048
+
+// What the server advertises on /version for the current build
+typedef struct
+{
+    char version[32];
+    uint32_t size;
+    char sha256[65]; // lowercase hex
+    char url[128];   // full image location, empty to use the built-in one
+} ota_manifest_t;
+
+// Compare dotted versions numerically ("1.10.0" > "1.9.3"): <0, 0 or >0 like strcmp
+int ota_version_compare(const char *a, const char *b);
+
+/**
+ * @brief Send a GET for the client's current URL and read the response headers
+ *
+ * All OTA requests go through one client so the TLS session and the keep-alive
+ * connection are reused. If the server closed a kept-alive connection in the
+ * meantime, the request is retried once on a fresh one.
+ *
+ * @param offset      When > 0, only ask for the resource from this byte on (Range)
+ * @param status_code HTTP status of the response
+ * @return ESP_ERR_NOT_FINISHED when the server answered 503 (busy, see Retry-After)
+ */
+esp_err_t ota_http_get(esp_http_client_handle_t client, uint32_t offset, int *status_code);
+
+// End a request from ota_http_get(), keeping the connection when it can be reused
+void ota_http_finish(esp_http_client_handle_t client);
+
+/**
+ * @brief Download the image described by manifest into the passive OTA partition
+ *
+ * Progress is persisted in NVS, keyed by the manifest hash. If a previous
+ * attempt (even before a reboot) was interrupted, the download continues from
+ * the last saved offset with an HTTP Range request instead of starting over.
+ * The image is hashed as it arrives (or read back from flash if part of it
+ * was written before a reboot) and compared with manifest->sha256 before the
+ * partition is made bootable.
+ *
+ * The partition is written directly (esp_partition_erase_range/write, then
+ * esp_ota_set_boot_partition, which checks the image) rather than through
+ * esp_https_ota's partial-download mode: resuming needs the write offset
+ * under this code's control, saved in NVS across reboots.
+ *
+ * @param client   Shared client, its URL already pointing at the raw image
+ * @param manifest Expected size and hash of the image
+ * @return ESP_OK when the new partition is set as boot partition,
+ *         ESP_ERR_INVALID_CRC on hash mismatch, or the underlying error
+ */
+esp_err_t ota_download_resumable(esp_http_client_handle_t client,
+                                 const ota_manifest_t *manifest);
+
+// Compare a finished SHA-256 digest with the manifest hex string (logs on mismatch)
+esp_err_t ota_check_sha256(const uint8_t digest[32], const char *expected);
+
+// Forget any saved progress, e.g. when the server publishes a different build
+void ota_download_clear_progress(void);
+
+// True when an interrupted download of this image can be resumed from NVS
+bool ota_download_has_progress(const ota_manifest_t *manifest);
+
+#endif
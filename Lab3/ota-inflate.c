@@ -0,0 +1,180 @@
+#include <string.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_ota_ops.h"
+#include "esp_http_client.h"
+#include "mbedtls/sha256.h"
+#include "miniz.h"
+
+#include "ota-inflate.h"
+#include "ota-download.h"
+
+#define INFLATE_FLAGS (TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_HAS_MORE_INPUT | TINFL_FLAG_COMPUTE_ADLER32)
+
+static const char *TAG = "ota-inflate";
+
+typedef struct
+{
+    tinfl_decompressor inflator;
+    uint8_t dict[OTA_INFLATE_DICT_SIZE]; // circular output window
+    size_t dict_ofs;
+    bool done;
+    uint32_t target_size;
+    uint32_t produced;
+    const esp_partition_t *partition;
+    esp_ota_handle_t ota_handle; // 0 until the first image byte
+    mbedtls_sha256_context sha;
+} inflate_ctx_t;
+
+static esp_err_t emit(inflate_ctx_t *ctx, const uint8_t *data, size_t len)
+{
+    if (ctx->produced + len > ctx->target_size)
+    {
+        ESP_LOGE(TAG, "Stream inflates to more than %lu bytes", (unsigned long)ctx->target_size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (ctx->ota_handle == 0)
+    {
+        // First image byte: only now does the passive partition get overwritten,
+        // so a missing or broken stream leaves a resumable download alone
+        ota_download_clear_progress();
+        esp_err_t err = esp_ota_begin(ctx->partition, OTA_WITH_SEQUENTIAL_WRITES, &ctx->ota_handle);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+    }
+    mbedtls_sha256_update(&ctx->sha, data, len);
+    ctx->produced += len;
+    return esp_ota_write(ctx->ota_handle, data, len);
+}
+
+static esp_err_t inflate_feed(inflate_ctx_t *ctx, const uint8_t *data, size_t len)
+{
+    tinfl_status status;
+    do
+    {
+        size_t in_bytes = len;
+        size_t out_bytes = OTA_INFLATE_DICT_SIZE - ctx->dict_ofs;
+        status = tinfl_decompress(&ctx->inflator, data, &in_bytes,
+                                  ctx->dict, ctx->dict + ctx->dict_ofs, &out_bytes, INFLATE_FLAGS);
+        data += in_bytes;
+        len -= in_bytes;
+
+        if (out_bytes > 0)
+        {
+            esp_err_t err = emit(ctx, ctx->dict + ctx->dict_ofs, out_bytes);
+            if (err != ESP_OK)
+            {
+                return err;
+            }
+            ctx->dict_ofs = (ctx->dict_ofs + out_bytes) & (OTA_INFLATE_DICT_SIZE - 1);
+        }
+
+        if (status < TINFL_STATUS_DONE)
+        {
+            // Also covers a zlib header asking for a larger window than we have
+            ESP_LOGE(TAG, "Inflate failed (%d)", status);
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        if (status == TINFL_STATUS_DONE)
+        {
+            ctx->done = true;
+            if (len > 0)
+            {
+                ESP_LOGE(TAG, "Trailing data after end of stream");
+                return ESP_ERR_INVALID_SIZE;
+            }
+            return ESP_OK;
+        }
+    } while (status == TINFL_STATUS_HAS_MORE_OUTPUT || len > 0);
+
+    return ESP_OK;
+}
+
+esp_err_t ota_inflate_download(esp_http_client_handle_t client,
+                               const ota_manifest_t *manifest)
+{
+    int64_t start_us = esp_timer_get_time();
+    uint32_t compressed_bytes = 0;
+
+    int status_code;
+    esp_err_t err = ota_http_get(client, 0, &status_code);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    if (status_code != 200)
+    {
+        ESP_LOGI(TAG, "No compressed image available (HTTP %d)", status_code);
+        ota_http_finish(client);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    inflate_ctx_t *ctx = calloc(1, sizeof(inflate_ctx_t));
+    if (ctx == NULL)
+    {
+        esp_http_client_close(client);
+        return ESP_ERR_NO_MEM;
+    }
+    tinfl_init(&ctx->inflator);
+    ctx->target_size = manifest->size;
+    mbedtls_sha256_init(&ctx->sha);
+    mbedtls_sha256_starts(&ctx->sha, 0);
+    ctx->partition = esp_ota_get_next_update_partition(NULL);
+
+    char buf[OTA_DOWNLOAD_BUF_SIZE];
+    while (err == ESP_OK && !ctx->done)
+    {
+        int len = esp_http_client_read(client, buf, sizeof(buf));
+        if (len <= 0)
+        {
+            ESP_LOGE(TAG, "Compressed stream ended at %lu bytes", (unsigned long)compressed_bytes);
+            err = ESP_FAIL;
+            break;
+        }
+        compressed_bytes += len;
+        err = inflate_feed(ctx, (const uint8_t *)buf, len);
+    }
+
+    ota_http_finish(client);
+
+    if (err == ESP_OK && ctx->produced != ctx->target_size)
+    {
+        ESP_LOGE(TAG, "Inflated %lu bytes, expected %lu", (unsigned long)ctx->produced, (unsigned long)ctx->target_size);
+        err = ESP_ERR_INVALID_SIZE;
+    }
+    if (err == ESP_OK)
+    {
+        uint8_t digest[32];
+        mbedtls_sha256_finish(&ctx->sha, digest);
+        err = ota_check_sha256(digest, manifest->sha256);
+    }
+    if (err == ESP_OK)
+    {
+        err = esp_ota_end(ctx->ota_handle);
+    }
+    else if (ctx->ota_handle)
+    {
+        esp_ota_abort(ctx->ota_handle);
+    }
+    if (err == ESP_OK)
+    {
+        err = esp_ota_set_boot_partition(ctx->partition);
+    }
+
+    if (err == ESP_OK)
+    {
+        int64_t elapsed_ms = (esp_timer_get_time() - start_us) / 1000;
+        ESP_LOGI(TAG, "Inflated %lu -> %lu bytes in %lld ms (%lld KiB/s), %u bytes of inflater state",
+                 (unsigned long)compressed_bytes, (unsigned long)ctx->produced, elapsed_ms,
+                 elapsed_ms ? (int64_t)ctx->produced * 1000 / 1024 / elapsed_ms : 0,
+                 (unsigned)sizeof(inflate_ctx_t));
+    }
+
+    mbedtls_sha256_free(&ctx->sha);
+    free(ctx);
+    return err;
+}
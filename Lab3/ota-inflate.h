@@ -0,0 +1,33 @@
+#ifndef _OTA_INFLATE_H_
+#define _OTA_INFLATE_H_
+
+#include "esp_err.h"
+#include "esp_http_client.h"
+#include "ota-download.h"
+
+// inflate_test.c runs this file against miniz on the host
+
+// Sliding window the server compresses with (server.py COMPRESS_WBITS = 12).
+// Must be a power of two, and at least as large as the window in the zlib header.
+#define OTA_INFLATE_DICT_SIZE 4096
+
+/**
+ * @brief Download a zlib-compressed image and inflate it into the passive OTA partition
+ *
+ * The stream is fetched from the client's current URL and decompressed as it
+ * arrives using the ROM inflater, with a
+ * circular output window of OTA_INFLATE_DICT_SIZE bytes. RAM use is fixed
+ * (window + decompressor state + one receive buffer), whatever the image size.
+ * The inflated image is hashed on the fly and checked against manifest->sha256.
+ *
+ * Unlike ota_download_resumable() a dropped connection cannot be resumed, the
+ * inflater state is not persisted. The progress of an interrupted full
+ * download is only given up once the first inflated byte is written.
+ *
+ * @return ESP_OK when the new partition is set as boot partition,
+ *         ESP_ERR_NOT_FOUND when the server has no compressed image, or another error
+ */
+esp_err_t ota_inflate_download(esp_http_client_handle_t client,
+                               const ota_manifest_t *manifest);
+
+#endif
@@ -0,0 +1,283 @@
+#include <ctype.h>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_wifi.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_http_server.h"
+#include "esp_http_client.h"
+#include "nvs.h"
+#include "mdns.h"
+#include "version.h"
+
+#include "ota-peer.h"
+#include "ota-download.h"
+
+#define NVS_NAMESPACE "ota_peer"
+
+static const char *TAG = "ota-peer";
+
+static ota_manifest_t s_image; // what we serve
+static httpd_handle_t s_server = NULL;
+
+void ota_peer_remember(const ota_manifest_t *manifest)
+{
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle) != ESP_OK)
+    {
+        return;
+    }
+    nvs_set_str(nvs_handle, "version", manifest->version);
+    nvs_set_u32(nvs_handle, "size", manifest->size);
+    nvs_set_str(nvs_handle, "sha256", manifest->sha256);
+    nvs_commit(nvs_handle);
+    nvs_close(nvs_handle);
+}
+
+static bool load_image(ota_manifest_t *manifest)
+{
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle) != ESP_OK)
+    {
+        return false;
+    }
+    size_t version_len = sizeof(manifest->version);
+    size_t sha256_len = sizeof(manifest->sha256);
+    bool ok = nvs_get_str(nvs_handle, "version", manifest->version, &version_len) == ESP_OK &&
+              nvs_get_u32(nvs_handle, "size", &manifest->size) == ESP_OK &&
+              nvs_get_str(nvs_handle, "sha256", manifest->sha256, &sha256_len) == ESP_OK;
+    nvs_close(nvs_handle);
+    return ok;
+}
+
+static esp_err_t send_all(httpd_req_t *req, const char *buf, size_t len)
+{
+    while (len > 0)
+    {
+        int sent = httpd_send(req, buf, len);
+        if (sent <= 0)
+        {
+            return ESP_FAIL;
+        }
+        buf += sent;
+        len -= sent;
+    }
+    return ESP_OK;
+}
+
+// "bytes=<first>-[<last>]" into *start and *end (inclusive). Anything else,
+// suffix and multiple ranges included, is ignored and the whole image sent.
+static bool parse_range(const char *range, uint32_t *start, uint32_t *end)
+{
+    char *p;
+    if (strncmp(range, "bytes=", 6) != 0 || !isdigit((unsigned char)range[6]))
+    {
+        return false;
+    }
+    unsigned long first = strtoul(range + 6, &p, 10);
+    if (*p++ != '-')
+    {
+        return false;
+    }
+    unsigned long last = ULONG_MAX;
+    if (isdigit((unsigned char)*p))
+    {
+        last = strtoul(p, &p, 10);
+    }
+    if (*p != '\0' || last < first)
+    {
+        return false;
+    }
+    *start = first;
+    *end = last;
+    return true;
+}
+
+static esp_err_t firmware_get_handler(httpd_req_t *req)
+{
+    uint32_t start = 0;
+    uint32_t end = s_image.size - 1;
+    char range[32];
+    bool partial = httpd_req_get_hdr_value_str(req, "Range", range, sizeof(range)) == ESP_OK &&
+                   parse_range(range, &start, &end);
+    if (partial && start >= s_image.size)
+    {
+        httpd_resp_set_status(req, "416 Range Not Satisfiable");
+        return httpd_resp_send(req, NULL, 0);
+    }
+    if (end >= s_image.size)
+    {
+        end = s_image.size - 1;
+    }
+
+    // httpd_resp_send_chunk() would use chunked encoding, the OTA client wants a Content-Length
+    char head[192];
+    int head_len;
+    if (partial)
+    {
+        head_len = snprintf(head, sizeof(head),
+                            "HTTP/1.1 206 Partial Content\r\n"
+                            "Content-Type: application/octet-stream\r\n"
+                            "Content-Length: %lu\r\n"
+                            "Content-Range: bytes %lu-%lu/%lu\r\n\r\n",
+                            (unsigned long)(end - start + 1), (unsigned long)start,
+                            (unsigned long)end, (unsigned long)s_image.size);
+    }
+    else
+    {
+        head_len = snprintf(head, sizeof(head),
+                            "HTTP/1.1 200 OK\r\n"
+                            "Content-Type: application/octet-stream\r\n"
+                            "Content-Length: %lu\r\n"
+                            "Accept-Ranges: bytes\r\n\r\n",
+                            (unsigned long)s_image.size);
+    }
+
+    char *buf = malloc(OTA_PEER_BUF_SIZE);
+    if (buf == NULL)
+    {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, NULL);
+    }
+
+    ESP_LOGI(TAG, "Serving image bytes %lu-%lu", (unsigned long)start, (unsigned long)end);
+    const esp_partition_t *running = esp_ota_get_running_partition();
+    esp_err_t err = send_all(req, head, head_len);
+    for (uint32_t offset = start; err == ESP_OK && offset <= end;)
+    {
+        size_t len = end + 1 - offset < OTA_PEER_BUF_SIZE ? end + 1 - offset : OTA_PEER_BUF_SIZE;
+        err = esp_partition_read(running, offset, buf, len);
+        if (err == ESP_OK)
+        {
+            err = send_all(req, buf, len);
+        }
+        offset += len;
+    }
+    free(buf);
+    return err;
+}
+
+static const httpd_uri_t firmware_uri = {
+    .uri = "/firmware.bin",
+    .method = HTTP_GET,
+    .handler = firmware_get_handler,
+    .user_ctx = NULL};
+
+esp_err_t ota_peer_start(void)
+{
+    esp_err_t err = mdns_init();
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "mdns_init failed: %s", esp_err_to_name(err));
+        return err;
+    }
+    uint8_t mac[6];
+    char hostname[20];
+    esp_wifi_get_mac(WIFI_IF_STA, mac);
+    snprintf(hostname, sizeof(hostname), "esp32-ota-%02x%02x%02x", mac[3], mac[4], mac[5]);
+    mdns_hostname_set(hostname);
+
+    // Only vouch for an image we installed ourselves after checking its hash
+    if (!load_image(&s_image) || strcmp(s_image.version, VERSION_SHORT) != 0)
+    {
+        ESP_LOGI(TAG, "Running image was not installed over OTA, not serving it");
+        return ESP_OK;
+    }
+
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port = OTA_PEER_PORT;
+    config.ctrl_port = OTA_PEER_PORT + 1;
+    config.max_open_sockets = OTA_PEER_MAX_CLIENTS;
+    config.lru_purge_enable = true;
+    err = httpd_start(&s_server, &config);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Peer server failed to start: %s", esp_err_to_name(err));
+        return err;
+    }
+    httpd_register_uri_handler(s_server, &firmware_uri);
+
+    char size[12];
+    snprintf(size, sizeof(size), "%lu", (unsigned long)s_image.size);
+    mdns_txt_item_t txt[] = {
+        {"version", s_image.version},
+        {"size", size},
+        {"sha256", s_image.sha256},
+    };
+    err = mdns_service_add(NULL, OTA_PEER_SERVICE, OTA_PEER_PROTO, OTA_PEER_PORT, txt, 3);
+    ESP_LOGI(TAG, "Offering %s (%lu bytes) to peers on port %d", s_image.version,
+             (unsigned long)s_image.size, OTA_PEER_PORT);
+    return err;
+}
+
+static bool peer_has_image(const mdns_result_t *r, const ota_manifest_t *manifest)
+{
+    bool version_ok = false;
+    bool sha256_ok = false;
+    for (size_t i = 0; i < r->txt_count; i++)
+    {
+        const char *value = r->txt[i].value ? r->txt[i].value : "";
+        if (strcmp(r->txt[i].key, "version") == 0)
+        {
+            version_ok = strcmp(value, manifest->version) == 0;
+        }
+        else if (strcmp(r->txt[i].key, "sha256") == 0)
+        {
+            sha256_ok = strcasecmp(value, manifest->sha256) == 0;
+        }
+    }
+    return version_ok && sha256_ok && r->addr != NULL && r->addr->addr.type == ESP_IPADDR_TYPE_V4;
+}
+
+esp_err_t ota_peer_download(const ota_manifest_t *manifest)
+{
+    mdns_result_t *results = NULL;
+    esp_err_t err = mdns_query_ptr(OTA_PEER_SERVICE, OTA_PEER_PROTO, OTA_PEER_QUERY_MS, OTA_PEER_MAX_RESULTS, &results);
+    if (err != ESP_OK || results == NULL)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    // Any peer on the LAN is as close as another: pick one at random to spread the load
+    int num_peers = 0;
+    for (mdns_result_t *r = results; r; r = r->next)
+    {
+        num_peers += peer_has_image(r, manifest);
+    }
+    if (num_peers == 0)
+    {
+        mdns_query_results_free(results);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    int selected = esp_random() % num_peers;
+    char url[64];
+    for (mdns_result_t *r = results; r; r = r->next)
+    {
+        if (peer_has_image(r, manifest) && selected-- == 0)
+        {
+            snprintf(url, sizeof(url), "http://" IPSTR ":%u/firmware.bin",
+                     IP2STR(&r->addr->addr.u_addr.ip4), r->port);
+            break;
+        }
+    }
+    mdns_query_results_free(results);
+
+    ESP_LOGI(TAG, "%d peer(s) have %s, downloading from %s", num_peers, manifest->version, url);
+    esp_http_client_config_t config = {
+        .url = url,
+        .timeout_ms = 10000};
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    if (client == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    err = ota_download_resumable(client, manifest);
+    esp_http_client_cleanup(client);
+    return err;
+}
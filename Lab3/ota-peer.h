@@ -0,0 +1,41 @@
+#ifndef _OTA_PEER_H_
+#define _OTA_PEER_H_
+
+#include "esp_err.h"
+#include "ota-download.h"
+
+// Devices running an image they installed over OTA offer it to their neighbours
+#define OTA_PEER_SERVICE "_esp32ota"
+#define OTA_PEER_PROTO "_tcp"
+#define OTA_PEER_PORT 8070
+#define OTA_PEER_MAX_CLIENTS 2
+#define OTA_PEER_QUERY_MS 2000
+#define OTA_PEER_MAX_RESULTS 8
+#define OTA_PEER_BUF_SIZE 2048
+
+/**
+ * @brief Start mDNS and, if the running image came from an OTA update, serve it
+ *
+ * The image is served from the running partition at
+ * http://<ip>:OTA_PEER_PORT/firmware.bin (single byte ranges supported) and
+ * advertised as OTA_PEER_SERVICE with its version, size and sha256 in TXT.
+ * Call once the station has an IP.
+ */
+esp_err_t ota_peer_start(void);
+
+// Record the manifest of an image that was just installed, so it is served after the reboot
+void ota_peer_remember(const ota_manifest_t *manifest);
+
+/**
+ * @brief Download the image described by manifest from a LAN peer advertising it
+ *
+ * A random peer whose TXT version and sha256 match the manifest is used. The
+ * download goes through ota_download_resumable(), so the result is checked
+ * against the manifest hash from the server, not against the peer's word.
+ *
+ * @return ESP_OK when the new partition is set as boot partition,
+ *         ESP_ERR_NOT_FOUND when no peer has the image, or another error
+ */
+esp_err_t ota_peer_download(const ota_manifest_t *manifest);
+
+#endif
@@ -0,0 +1,178 @@
+"""Server egress with and without peer-to-peer distribution (ota-peer.c).
+
+Every device is its own process. It waits a random time (devices do not check
+in together, see poll_sim.py), looks for a peer that advertises the image,
+downloads from it with Range resume and checks the hash from the server
+manifest. With no peer, or a bad one, it falls back to the origin server.
+Once verified it starts serving the image itself, one download at a time
+like the single esp_http_server task in ota-peer.c; a client kept waiting past
+its timeout falls back to the server. The shared registry stands in for the
+_esp32ota._tcp mDNS records.
+
+    python p2p_sim.py [--fleet 5 10 20 40] [--size-kib 512] [--spread 3] [--no-peers]
+"""
+import argparse
+import contextlib
+import hashlib
+import http.server
+import multiprocessing
+import os
+import random
+import re
+import threading
+import time
+import urllib.error
+import urllib.request
+
+CHUNK = 16 * 1024
+
+
+def make_handler(image, busy, egress=None):
+    class Handler(http.server.BaseHTTPRequestHandler):
+        protocol_version = "HTTP/1.1"
+
+        def do_GET(self):
+            # As firmware_get_handler(): a closed range is honoured, anything
+            # but one "bytes=a-[b]" range gets the whole image
+            with busy:
+                start, end = 0, len(image) - 1
+                match = re.fullmatch(r"bytes=(\d+)-(\d*)", self.headers.get("Range", ""))
+                partial = match is not None and (not match[2] or int(match[2]) >= int(match[1]))
+                if partial:
+                    start = int(match[1])
+                    end = min(int(match[2]), end) if match[2] else end
+                if partial and start >= len(image):
+                    self.send_response(416)
+                    self.send_header("Content-Length", "0")
+                    self.end_headers()
+                    return
+                self.send_response(206 if partial else 200)
+                self.send_header("Content-Type", "application/octet-stream")
+                self.send_header("Content-Length", str(end + 1 - start))
+                if partial:
+                    self.send_header("Content-Range", f"bytes {start}-{end}/{len(image)}")
+                self.end_headers()
+                for i in range(start, end + 1, CHUNK):
+                    piece = image[i : min(i + CHUNK, end + 1)]
+                    self.wfile.write(piece)
+                    if egress is not None:
+                        with egress.get_lock():
+                            egress.value += len(piece)
+
+        def log_message(self, *args):
+            pass
+
+    return Handler
+
+
+def serve(image, one_at_a_time, egress=None):
+    # esp_http_server runs every handler on its one task: a peer that is
+    # sending keeps the next client waiting (until its timeout), never refuses it
+    busy = threading.Lock() if one_at_a_time else contextlib.nullcontext()
+    server = http.server.ThreadingHTTPServer(("127.0.0.1", 0), make_handler(image, busy, egress))
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+    return server
+
+
+def origin(image, egress, port_queue, stop):
+    server = serve(image, False, egress)
+    port_queue.put(server.server_address[1])
+    stop.wait()
+    server.shutdown()
+
+
+def fetch(port, expected_sha256, size):
+    """Download with resume, like ota_download_resumable(). None if the source failed."""
+    data = bytearray()
+    for _ in range(3):
+        request = urllib.request.Request(f"http://127.0.0.1:{port}/firmware.bin")
+        if data:
+            request.add_header("Range", f"bytes={len(data)}-")
+        try:
+            # .timeout_ms in ota_peer_download()
+            with urllib.request.urlopen(request, timeout=10) as response:
+                for chunk in iter(lambda: response.read(CHUNK), b""):
+                    data += chunk
+        except (urllib.error.URLError, ConnectionError, TimeoutError):
+            if not data:
+                return None
+        if len(data) >= size:
+            break
+    if len(data) != size or hashlib.sha256(data).hexdigest() != expected_sha256:
+        return None
+    return bytes(data)
+
+
+def device(n, origin_port, manifest, registry, use_peers, spread, results, stop):
+    random.seed(n)
+    time.sleep(random.uniform(0, spread))
+    image = None
+    source = "server"
+    if use_peers:
+        peers = list(registry)
+        random.shuffle(peers)
+        for port in peers:
+            image = fetch(port, manifest["sha256"], manifest["size"])
+            if image is not None:
+                source = "peer"
+                break
+    if image is None:
+        image = fetch(origin_port, manifest["sha256"], manifest["size"])
+    if image is None:
+        results.put((n, "failed"))
+        return
+
+    results.put((n, source))
+    if use_peers:
+        # Verified, so offer it to the rest of the fleet
+        server = serve(image, True)
+        registry.append(server.server_address[1])
+        stop.wait()
+        server.shutdown()
+
+
+def run(fleet, image, use_peers, spread):
+    manifest = {"size": len(image), "sha256": hashlib.sha256(image).hexdigest()}
+    egress = multiprocessing.Value("q", 0)
+    stop = multiprocessing.Event()
+    port_queue = multiprocessing.Queue()
+    results = multiprocessing.Queue()
+
+    with multiprocessing.Manager() as manager:
+        registry = manager.list()
+        server = multiprocessing.Process(target=origin, args=(image, egress, port_queue, stop))
+        server.start()
+        origin_port = port_queue.get()
+
+        devices = [
+            multiprocessing.Process(target=device,
+                                    args=(n, origin_port, manifest, registry, use_peers, spread, results, stop))
+            for n in range(fleet)
+        ]
+        start = time.perf_counter()
+        for p in devices:
+            p.start()
+        sources = [results.get()[1] for _ in range(fleet)]
+        elapsed = time.perf_counter() - start
+
+        stop.set()
+        for p in devices + [server]:
+            p.join()
+
+    return egress.value, sources, elapsed
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--fleet", type=int, nargs="+", default=[5, 10, 20, 40])
+    parser.add_argument("--size-kib", type=int, default=512)
+    parser.add_argument("--spread", type=float, default=3, help="seconds over which devices check in")
+    parser.add_argument("--no-peers", action="store_true")
+    args = parser.parse_args()
+
+    image = os.urandom(args.size_kib * 1024)
+    print(f"{'devices':>8} {'server MiB':>11} {'per device':>11} {'from peers':>11} {'failed':>7} {'time s':>7}")
+    for fleet in args.fleet:
+        egress, sources, elapsed = run(fleet, image, not args.no_peers, args.spread)
+        print(f"{fleet:>8} {egress / 2**20:>11.1f} {egress / fleet / 1024:>10.0f}K "
+              f"{sources.count('peer'):>11} {sources.count('failed'):>7} {elapsed:>7.1f}")
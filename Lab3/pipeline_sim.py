@@ -0,0 +1,139 @@
+"""Download time of a raw OTA image, serial and with a flash writer task.
+
+Serial is fetch_from_offset() (ota-download.c) as it is: read a buffer from
+the socket, erase the next sector when the data reaches it, write, hash,
+and save progress every OTA_PROGRESS_SAVE_BYTES. The pipeline line is the
+same work split over a receiving task and a writer task with --depth
+buffers between them, the design ota-download.c tried and dropped.
+
+While nobody reads, the TCP window still fills but is then closed, so the
+network only gets ahead by LWIP_TCP_WND bytes. Assumes the receiver keeps
+running while flash is busy (erase yields, CONFIG_SPI_FLASH_YIELD_DURING_ERASE).
+TLS record buffering is not modelled.
+
+With the defaults flash erase takes most of the time, so the overlap saves
+1-5%, and a larger --tcp-wnd speeds up both sides alike. Only a small
+window (--tcp-wnd 2920) and a network near the flash rate make the writer
+task worth its 12 KiB of buffers and its task stack.
+
+    python pipeline_sim.py [--image-kib 1024] [--erase-ms 45] [--mbps 1 2 4 8] [--tcp-wnd 5760]
+"""
+import argparse
+import random
+
+# Writer task design that was tried; keep the rest in sync with ota-download.h
+PIPELINE_DEPTH = 3
+BUF_SIZE = 4096
+SECTOR_SIZE = 4096
+PROGRESS_SAVE_BYTES = 64 * 1024
+TCP_WND = 5760                  # CONFIG_LWIP_TCP_WND_DEFAULT
+
+
+class Network:
+    """Bytes arrive at rate while the TCP window has room, with the odd Wi-Fi stall."""
+
+    def __init__(self, rate, args, seed):
+        self.rate, self.args = rate, args
+        self.rng = random.Random(f"net{seed}")
+        self.t = 0.0
+        self.buffered = 0
+
+    def read(self, start, size):
+        """Receiver asks for size bytes at start; returns when it has them."""
+        a = self.args
+        rate = self.rate * self.rng.uniform(1 - a.jitter, 1 + a.jitter)
+        stall = a.stall_ms / 1000 if self.rng.random() < a.stall_rate else 0.0
+        # A stall first eats into the time the receiver was away
+        idle = start - self.t
+        self.buffered = min(a.tcp_wnd, self.buffered + max(0.0, idle - stall) * rate)
+        stall = max(0.0, stall - idle)
+        taken = min(self.buffered, size)
+        self.buffered -= taken
+        self.t = start + (stall + (size - taken) / rate if taken < size else 0.0)
+        return self.t
+
+
+class Flash:
+    def __init__(self, args, seed):
+        self.args = args
+        self.rng = random.Random(f"flash{seed}")
+        self.erased_to = 0
+
+    def write(self, offset, size):
+        """Time write_chunk() takes for size bytes at offset."""
+        a, t = self.args, 0.0
+        end = offset + size
+        while self.erased_to < end:
+            # Sector erase time varies a lot, typical to several times typical
+            t += a.erase_ms / 1000 * self.rng.uniform(0.8, 2.0)
+            self.erased_to += SECTOR_SIZE
+        t += size / 256 * a.page_ms / 1000
+        if end // PROGRESS_SAVE_BYTES != offset // PROGRESS_SAVE_BYTES:
+            t += a.nvs_ms / 1000
+        return t
+
+
+def serial(args, rate, seed):
+    # Same network and flash samples for both, only the overlap differs
+    net, flash = Network(rate, args, seed), Flash(args, seed)
+    t = 0.0
+    for offset in range(0, args.image_kib * 1024, BUF_SIZE):
+        t = net.read(t, BUF_SIZE) + BUF_SIZE / args.sha_mbps / 1e6
+        t += flash.write(offset, BUF_SIZE)
+    return t
+
+
+def pipelined(args, rate, seed):
+    """Returns total time, receiver wait and writer idle, as the device logs them."""
+    # Same network and flash samples for both, only the overlap differs
+    net, flash = Network(rate, args, seed), Flash(args, seed)
+    free_at = [0.0] * args.depth        # when each buffer comes back from the writer
+    t = 0.0
+    writer_t = 0.0
+    receiver_wait = writer_idle = 0.0
+    for i, offset in enumerate(range(0, args.image_kib * 1024, BUF_SIZE)):
+        # Wait for a free buffer
+        free = free_at[i % args.depth]
+        receiver_wait += max(0.0, free - t)
+        t = max(t, free)
+        t = net.read(t, BUF_SIZE) + BUF_SIZE / args.sha_mbps / 1e6
+        # writer_task picks it up once the previous buffer is written
+        writer_idle += max(0.0, t - writer_t)
+        writer_t = max(writer_t, t) + flash.write(offset, BUF_SIZE)
+        free_at[i % args.depth] = writer_t
+    return writer_t, receiver_wait, writer_idle
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--image-kib", type=int, default=1024)
+    parser.add_argument("--mbps", type=float, nargs="+", default=[0.25, 0.5, 0.75, 1, 2, 8],
+                        help="network rates to compare, megabits per second")
+    parser.add_argument("--jitter", type=float, default=0.5,
+                        help="network rate varies by this fraction from buffer to buffer")
+    parser.add_argument("--stall-ms", type=float, default=100, help="Wi-Fi retries, roaming, ...")
+    parser.add_argument("--stall-rate", type=float, default=0.02, help="fraction of buffers hit by a stall")
+    parser.add_argument("--erase-ms", type=float, default=45, help="typical 4 KiB sector erase")
+    parser.add_argument("--page-ms", type=float, default=0.7, help="256-byte page program")
+    parser.add_argument("--nvs-ms", type=float, default=10, help="save_progress()")
+    parser.add_argument("--sha-mbps", type=float, default=10, help="SHA-256, megabytes per second")
+    parser.add_argument("--depth", type=int, default=PIPELINE_DEPTH)
+    parser.add_argument("--tcp-wnd", type=int, default=TCP_WND)
+    parser.add_argument("--runs", type=int, default=20)
+    args = parser.parse_args()
+
+    size = args.image_kib * 1024
+    flash_only = 0.0
+    for seed in range(args.runs):
+        flash = Flash(args, seed)
+        flash_only += sum(flash.write(offset, BUF_SIZE) for offset in range(0, size, BUF_SIZE)) / args.runs
+    print(f"{args.image_kib} KiB image, {args.depth} x {BUF_SIZE} byte buffers, mean of {args.runs} runs")
+    print(f"flash alone takes {flash_only:.1f}s; no overlap can beat the slower of flash and network\n")
+    print(f"{'network':>10} {'alone':>7} {'serial':>8} {'pipeline':>8} {'saved':>6}   receiver waited / writer idle")
+    for mbps in args.mbps:
+        rate = mbps * 1e6 / 8
+        s = sum(serial(args, rate, seed) for seed in range(args.runs)) / args.runs
+        runs = [pipelined(args, rate, seed) for seed in range(args.runs)]
+        p, wait, idle = (sum(r[k] for r in runs) / args.runs for k in range(3))
+        print(f"{mbps:6.2f} Mb/s {size / rate:6.1f}s {s:7.1f}s {p:7.1f}s {1 - p / s:6.0%}"
+              f"   {wait:5.1f}s / {idle:5.1f}s")
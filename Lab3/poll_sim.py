@@ -0,0 +1,41 @@
+"""Request rate seen by the OTA server when a whole fleet powers on together.
+
+Mirrors the schedule in ota_task (main.c): first check uniform over one
+interval, then interval +/- jitter. Compare with --no-jitter, where every
+device checks at boot and then on a fixed period.
+
+    python poll_sim.py [--devices 1000] [--hours 2] [--no-jitter]
+"""
+import argparse
+import random
+
+# Keep in sync with OTA_POLL_INTERVAL_MS / OTA_POLL_JITTER_PERCENT in main.c
+POLL_INTERVAL_S = 15 * 60
+POLL_JITTER_PERCENT = 25
+
+
+def schedule(duration_s, jitter):
+    t = random.uniform(0, POLL_INTERVAL_S) if jitter else 0
+    while t < duration_s:
+        yield t
+        spread = POLL_INTERVAL_S * POLL_JITTER_PERCENT / 100 if jitter else 0
+        t += random.uniform(POLL_INTERVAL_S - spread, POLL_INTERVAL_S + spread)
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--devices", type=int, default=1000)
+    parser.add_argument("--hours", type=float, default=2)
+    parser.add_argument("--no-jitter", action="store_true")
+    args = parser.parse_args()
+
+    duration_s = int(args.hours * 3600)
+    per_minute = [0] * (duration_s // 60 + 1)
+    for _ in range(args.devices):
+        for t in schedule(duration_s, not args.no_jitter):
+            per_minute[int(t // 60)] += 1
+
+    peak = max(per_minute)
+    print(f"{sum(per_minute)} requests, peak {peak}/min, mean {sum(per_minute) / len(per_minute):.1f}/min")
+    for minute, count in enumerate(per_minute):
+        print(f"{minute:4d} min {count:5d} {'#' * round(60 * count / peak)}")
@@ -1,14 +1,56 @@
-import io
-from flask import Flask, send_file, jsonify
+import argparse
+import hashlib
+from flask import Flask, send_file, jsonify, request, abort
+import json
 import os.path
 import re
+import shutil
+import threading
+import time
+import zlib
+
+import delta
 
 app = Flask(__name__)
 
+FIRMWARE_PATH = os.path.abspath(os.path.join(".pio", "build", "esp-wrover-kit", "firmware.bin"))
+VERSION_HEADER = os.path.abspath(os.path.join("include", "version.h"))
+
+# Every build that was ever served is kept here as <version>.bin so patches
+# can be made from whatever version a device is still running
+BUILDS_DIR = os.path.abspath("builds")
+
+# zlib window for /firmware.bin.zz. The device inflates into a window of this
+# size (OTA_INFLATE_DICT_SIZE in ota-inflate.h), so keep the two in sync.
+COMPRESS_WBITS = 12
+
+# Optional rollout plan, re-read whenever it changes:
+# {
+#   "rollout": 25,                       percent of ungrouped devices offered the current build
+#   "groups": {
+#     "bench": {"devices": ["24:6f:28:aa:bb:cc"], "rollout": 100},
+#     "field": {"devices": [...], "version": "1.2.3"}    pinned to an archived build
+#   }
+# }
+FLEET_PATH = os.path.abspath("fleet.json")
+
+# Bytes of /firmware.bin sent before the connection is cut (0 = never).
+# Used to exercise the device's resume path on the bench.
+drop_after = 0
+
+# Image downloads served at once; the rest get 503 with Retry-After
+download_slots = threading.BoundedSemaphore(4)
+retry_after = 30
+
+# Per-connection pace of image downloads in bytes/s (0 = unlimited), so a fleet
+# update cannot starve the AP of interactive traffic
+rate_limit = 0
+SHAPE_CHUNK = 4096
+
 
 def get_current_version():
     try:
-        with open("include/version.h", "r") as f:
+        with open(VERSION_HEADER, "r") as f:
             content = f.read()
             version_match = re.search(r'#define VERSION_SHORT "(.*?)"', content)
             if version_match:
@@ -18,16 +60,224 @@ def get_current_version():
     return "unknown"
 
 
+def get_sha256(path):
+    sha256 = hashlib.sha256()
+    with open(path, "rb") as f:
+        for chunk in iter(lambda: f.read(64 * 1024), b""):
+            sha256.update(chunk)
+    return sha256.hexdigest()
+
+
+# Manifests are rebuilt only when the file behind them changes
+_manifests = {}
+_current_key = None
+_current_version = None
+_manifest_lock = threading.Lock()
+
+
+def get_build_manifest(version, path):
+    st = os.stat(path)
+    key = (st.st_mtime_ns, st.st_size)
+    with _manifest_lock:
+        cached = _manifests.get(path)
+        if cached is None or cached[0] != key:
+            cached = (key, {"version": version, "size": st.st_size, "sha256": get_sha256(path)})
+            _manifests[path] = cached
+        return cached[1]
+
+
+def get_manifest():
+    """Manifest of the current build (firmware.bin + version.h)."""
+    global _current_key, _current_version
+    fw = os.stat(FIRMWARE_PATH)
+    key = (fw.st_mtime_ns, fw.st_size, os.stat(VERSION_HEADER).st_mtime_ns)
+    if key != _current_key:
+        _current_version = get_current_version()
+        _current_key = key
+    return get_build_manifest(_current_version, archive_current_build(_current_version))
+
+
+_fleet = ({}, None)
+
+
+def get_fleet():
+    global _fleet
+    try:
+        mtime = os.stat(FLEET_PATH).st_mtime_ns
+    except FileNotFoundError:
+        return {}
+    if _fleet[1] != mtime:
+        with open(FLEET_PATH) as f:
+            _fleet = (json.load(f), mtime)
+    return _fleet[0]
+
+
+def get_device_id():
+    return request.headers.get("X-Device-Id") or request.remote_addr
+
+
+def get_target_manifest():
+    """Manifest of the build this device should run, or None while the rollout has not reached it."""
+    current = get_manifest()
+    fleet = get_fleet()
+    device = get_device_id()
+    group = next((g for g in fleet.get("groups", {}).values() if device in g.get("devices", [])), fleet)
+
+    version = group.get("version", current["version"])
+    if version == current["version"]:
+        manifest = current
+    else:
+        path = os.path.join(BUILDS_DIR, f"{version}.bin")
+        if not re.fullmatch(r"[\w.\-]+", version) or not os.path.exists(path):
+            return None
+        manifest = get_build_manifest(version, path)
+
+    # Stable per device and per release, so each release canaries on a different slice
+    bucket = int(hashlib.sha256(f"{device}:{manifest['version']}".encode()).hexdigest()[:8], 16) % 100
+    return manifest if bucket < group.get("rollout", 100) else None
+
+
+def archive_current_build(version):
+    os.makedirs(BUILDS_DIR, exist_ok=True)
+    path = os.path.join(BUILDS_DIR, f"{version}.bin")
+    if not os.path.exists(path) or os.path.getmtime(path) < os.path.getmtime(FIRMWARE_PATH):
+        shutil.copyfile(FIRMWARE_PATH, path)
+    return path
+
+
+def get_patch_path(source_version, target_version):
+    """Build (once) and return the patch between two archived builds, or None."""
+    if not re.fullmatch(r"[\w.\-]+", source_version) or source_version == target_version:
+        return None
+    source_path = os.path.join(BUILDS_DIR, f"{source_version}.bin")
+    if not os.path.exists(source_path):
+        return None
+
+    target_path = os.path.join(BUILDS_DIR, f"{target_version}.bin")
+    patch_path = os.path.join(BUILDS_DIR, f"{source_version}-to-{target_version}.patch")
+    if not os.path.exists(patch_path) or os.path.getmtime(patch_path) < os.path.getmtime(target_path):
+        with open(source_path, "rb") as f:
+            source = f.read()
+        with open(target_path, "rb") as f:
+            target = f.read()
+        with open(patch_path, "wb") as f:
+            f.write(delta.make_patch(source, target))
+    return patch_path
+
+
+def get_compressed_path(version):
+    """Compress (once per build) an archived image for /firmware.bin.zz."""
+    source_path = os.path.join(BUILDS_DIR, f"{version}.bin")
+    compressed_path = os.path.join(BUILDS_DIR, f"{version}.bin.zz")
+    if not os.path.exists(compressed_path) or os.path.getmtime(compressed_path) < os.path.getmtime(source_path):
+        with open(source_path, "rb") as f:
+            data = f.read()
+        compressor = zlib.compressobj(9, zlib.DEFLATED, COMPRESS_WBITS)
+        with open(compressed_path, "wb") as f:
+            f.write(compressor.compress(data) + compressor.flush())
+    return compressed_path
+
+
+def close_body(body):
+    # send_file's iterable holds the open image file
+    close = getattr(body, "close", None)
+    if close is not None:
+        close()
+
+
+def truncated(body, limit):
+    sent = 0
+    try:
+        for chunk in body:
+            if sent + len(chunk) >= limit:
+                yield chunk[: limit - sent]
+                raise ConnectionAbortedError(f"injected drop after {limit} bytes")
+            sent += len(chunk)
+            yield chunk
+    finally:
+        close_body(body)
+
+
+def shaped(body, rate):
+    start = time.monotonic()
+    sent = 0
+    try:
+        for chunk in body:
+            for i in range(0, len(chunk), SHAPE_CHUNK):
+                piece = chunk[i : i + SHAPE_CHUNK]
+                yield piece
+                sent += len(piece)
+                delay = sent / rate - (time.monotonic() - start)
+                if delay > 0:
+                    time.sleep(delay)
+    finally:
+        close_body(body)
+
+
+def serve_download(path, drop=False, **kwargs):
+    if not download_slots.acquire(blocking=False):
+        response = app.response_class("Too many downloads in progress\n", 503, mimetype="text/plain")
+        response.headers["Retry-After"] = str(retry_after)
+        return response
+
+    try:
+        # Streamed from disk through wsgi.file_wrapper, never read into memory.
+        # conditional=True answers Range requests with 206 and If-None-Match with 304.
+        response = send_file(path, mimetype="application/octet-stream", conditional=True, **kwargs)
+    except Exception:
+        download_slots.release()
+        raise
+
+    if rate_limit or (drop and drop_after):
+        response.direct_passthrough = False
+        if rate_limit:
+            response.response = shaped(response.response, rate_limit)
+        if drop and drop_after:
+            response.response = truncated(response.response, drop_after)
+    # Runs when the body is done or the client went away
+    response.call_on_close(download_slots.release)
+    return response
+
+
 @app.route("/firmware.bin")
 def firm():
-    with open(".pio\\build\\esp-wrover-kit\\firmware.bin", "rb") as bites:
-        print(bites)
-        return send_file(io.BytesIO(bites.read()), mimetype="application/octet-stream")
+    manifest = get_target_manifest()
+    if manifest is None:
+        abort(404)
+    path = os.path.join(BUILDS_DIR, f"{manifest['version']}.bin")
+    return serve_download(path, drop=True, etag=manifest["sha256"])
+
+
+@app.route("/firmware.bin.zz")
+def firmware_compressed():
+    # zlib stream of firmware.bin; /version still describes the inflated image
+    manifest = get_target_manifest()
+    if manifest is None:
+        abort(404)
+    return serve_download(get_compressed_path(manifest["version"]))
+
+
+@app.route("/firmware.patch")
+def firmware_patch():
+    # Device passes its running version: /firmware.patch?from=1.0.3
+    manifest = get_target_manifest()
+    patch_path = manifest and get_patch_path(request.args.get("from", ""), manifest["version"])
+    if not patch_path:
+        abort(404)
+    return serve_download(patch_path)
 
 
 @app.route("/version")
 def version():
-    return jsonify({"version": get_current_version()})
+    manifest = get_target_manifest()
+    if manifest is None:
+        # Rollout has not reached this device yet
+        return "", 204
+
+    # Devices send back the ETag they last saw; nothing changed means 304 and no body
+    response = jsonify(dict(manifest, url=request.host_url + "firmware.bin"))
+    response.set_etag(f'{manifest["version"]}-{manifest["sha256"][:16]}')
+    return response.make_conditional(request)
 
 
 @app.route("/")
@@ -36,4 +286,21 @@ def hello():
 
 
 if __name__ == "__main__":
-    app.run(host="0.0.0.0", ssl_context=("ca_cert.pem", "ca_key.pem"), debug=True)
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--drop-after", type=int, default=0,
+                        help="cut every /firmware.bin response after this many bytes")
+    parser.add_argument("--max-downloads", type=int, default=4,
+                        help="image downloads served at once, others get 503")
+    parser.add_argument("--retry-after", type=int, default=30,
+                        help="seconds a refused device is told to wait")
+    parser.add_argument("--rate-limit", type=int, default=0,
+                        help="per-download pace in KiB/s (0 = unlimited)")
+    parser.add_argument("--debug", action="store_true",
+                        help="Flask debugger and reloader; lets anyone who can reach the port run code")
+    args = parser.parse_args()
+    drop_after = args.drop_after
+    download_slots = threading.BoundedSemaphore(args.max_downloads)
+    retry_after = args.retry_after
+    rate_limit = args.rate_limit * 1024
+
+    app.run(host="0.0.0.0", ssl_context=("ca_cert.pem", "ca_key.pem"), debug=args.debug, threaded=True)
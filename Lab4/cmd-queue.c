@@ -0,0 +1,215 @@
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+#include "cmd-queue.h"
+
+static const char *TAG = "cmd-queue";
+
+typedef struct
+{
+    uint32_t addr;      // IPv4, network order; 0 = free
+    int64_t last_us;    // last refill
+    int32_t tokens_milli;
+} bucket_t;
+
+static const char *const s_priority_prefixes[] = {"STATUS?", "STATS"};
+
+static bucket_t s_buckets[CMD_QUEUE_MAX_SOURCES];
+static QueueHandle_t s_high = NULL;
+static QueueHandle_t s_low = NULL;
+static TaskHandle_t s_worker = NULL;
+static cmd_queue_handler_t s_handler = NULL;
+
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static cmd_queue_stats_t s_stats;
+static cmd_queue_stats_t s_logged;
+static int64_t s_last_log_us = 0;
+
+void cmd_queue_reply(const cmd_item_t *cmd, const char *text)
+{
+    sendto(cmd->sock, text, strlen(text), 0, (const struct sockaddr *)&cmd->from, sizeof(cmd->from));
+}
+
+static void run(const cmd_item_t *cmd)
+{
+    if (strcmp(cmd->text, "STATS?") == 0)
+    {
+        cmd_queue_stats_t stats;
+        char reply[96];
+        cmd_queue_get_stats(&stats);
+        snprintf(reply, sizeof(reply), "received=%lu throttled=%lu dropped=%lu high=%lu low=%lu",
+                 (unsigned long)stats.received, (unsigned long)stats.throttled, (unsigned long)stats.dropped,
+                 (unsigned long)stats.ran_high, (unsigned long)stats.ran_low);
+        cmd_queue_reply(cmd, reply);
+    }
+    else if (strcmp(cmd->text, "STATS=RESET") == 0)
+    {
+        cmd_queue_reset_stats();
+        cmd_queue_reply(cmd, "OK");
+    }
+    else
+    {
+        s_handler(cmd);
+    }
+}
+
+static void worker_task(void *pvParameters)
+{
+    cmd_item_t item;
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        // Look at the high queue again before every low priority command
+        while (1)
+        {
+            bool high = xQueueReceive(s_high, &item, 0) == pdTRUE;
+            if (!high && xQueueReceive(s_low, &item, 0) != pdTRUE)
+            {
+                break;
+            }
+            run(&item);
+            taskENTER_CRITICAL(&s_stats_lock);
+            if (high)
+            {
+                s_stats.ran_high++;
+            }
+            else
+            {
+                s_stats.ran_low++;
+            }
+            taskEXIT_CRITICAL(&s_stats_lock);
+        }
+    }
+}
+
+esp_err_t cmd_queue_start(cmd_queue_handler_t handler)
+{
+    s_handler = handler;
+    s_high = xQueueCreate(CMD_QUEUE_HIGH_LEN, sizeof(cmd_item_t));
+    s_low = xQueueCreate(CMD_QUEUE_LOW_LEN, sizeof(cmd_item_t));
+    if (s_high == NULL || s_low == NULL ||
+        xTaskCreate(worker_task, "cmd_worker", CMD_QUEUE_TASK_STACK, NULL, CMD_QUEUE_TASK_PRIORITY, &s_worker) != pdPASS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+static bool take_token(uint32_t addr, int64_t now)
+{
+    // Unknown sources take the slot that has been quiet the longest
+    bucket_t *b = &s_buckets[0];
+    for (int i = 0; i < CMD_QUEUE_MAX_SOURCES; i++)
+    {
+        if (s_buckets[i].addr == addr)
+        {
+            b = &s_buckets[i];
+            break;
+        }
+        if (s_buckets[i].last_us < b->last_us)
+        {
+            b = &s_buckets[i];
+        }
+    }
+    if (b->addr != addr)
+    {
+        b->addr = addr;
+        b->tokens_milli = CMD_QUEUE_BURST * 1000;
+    }
+    else
+    {
+        int64_t refill = (now - b->last_us) * CMD_QUEUE_RATE_PER_S / 1000;
+        b->tokens_milli = refill + b->tokens_milli > CMD_QUEUE_BURST * 1000 ? CMD_QUEUE_BURST * 1000
+                                                                            : b->tokens_milli + refill;
+    }
+    b->last_us = now;
+
+    if (b->tokens_milli < 1000)
+    {
+        return false;
+    }
+    b->tokens_milli -= 1000;
+    return true;
+}
+
+static bool is_priority(const char *text)
+{
+    for (size_t i = 0; i < sizeof(s_priority_prefixes) / sizeof(s_priority_prefixes[0]); i++)
+    {
+        if (strncmp(text, s_priority_prefixes[i], strlen(s_priority_prefixes[i])) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void log_stats(int64_t now)
+{
+    // Summaries instead of a line per datagram, which a flood would turn into a second flood
+    if (now - s_last_log_us < CMD_QUEUE_STATS_INTERVAL_MS * 1000LL)
+    {
+        return;
+    }
+    s_last_log_us = now;
+    cmd_queue_stats_t stats;
+    cmd_queue_get_stats(&stats);
+    if (memcmp(&stats, &s_logged, sizeof(stats)) != 0)
+    {
+        ESP_LOGI(TAG, "received %lu, throttled %lu, dropped %lu, ran %lu high / %lu low",
+                 (unsigned long)stats.received, (unsigned long)stats.throttled, (unsigned long)stats.dropped,
+                 (unsigned long)stats.ran_high, (unsigned long)stats.ran_low);
+        s_logged = stats;
+    }
+}
+
+esp_err_t cmd_queue_submit(const cmd_item_t *cmd)
+{
+    esp_err_t err = ESP_OK;
+    if (!take_token(cmd->from.sin_addr.s_addr, cmd->rx_us))
+    {
+        err = ESP_ERR_INVALID_STATE;
+    }
+    else if (xQueueSend(is_priority(cmd->text) ? s_high : s_low, cmd, 0) != pdTRUE)
+    {
+        err = ESP_ERR_NO_MEM;
+    }
+    else
+    {
+        xTaskNotifyGive(s_worker);
+    }
+
+    taskENTER_CRITICAL(&s_stats_lock);
+    s_stats.received++;
+    if (err == ESP_ERR_INVALID_STATE)
+    {
+        s_stats.throttled++;
+    }
+    else if (err == ESP_ERR_NO_MEM)
+    {
+        s_stats.dropped++;
+    }
+    taskEXIT_CRITICAL(&s_stats_lock);
+
+    log_stats(cmd->rx_us);
+    return err;
+}
+
+void cmd_queue_get_stats(cmd_queue_stats_t *stats)
+{
+    taskENTER_CRITICAL(&s_stats_lock);
+    *stats = s_stats;
+    taskEXIT_CRITICAL(&s_stats_lock);
+}
+
+void cmd_queue_reset_stats(void)
+{
+    taskENTER_CRITICAL(&s_stats_lock);
+    memset(&s_stats, 0, sizeof(s_stats));
+    taskEXIT_CRITICAL(&s_stats_lock);
+}
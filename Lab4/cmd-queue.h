@@ -0,0 +1,69 @@
+#ifndef _CMD_QUEUE_H_
+#define _CMD_QUEUE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "lwip/sockets.h"
+
+// Per-source token bucket: sustained commands per second and burst size
+#define CMD_QUEUE_RATE_PER_S 20
+#define CMD_QUEUE_BURST 10
+#define CMD_QUEUE_MAX_SOURCES 8
+
+#define CMD_QUEUE_HIGH_LEN 4
+#define CMD_QUEUE_LOW_LEN 8
+#define CMD_QUEUE_TEXT_LEN 128
+#define CMD_QUEUE_STATS_INTERVAL_MS 10000
+#define CMD_QUEUE_TASK_STACK 4096
+#define CMD_QUEUE_TASK_PRIORITY 5
+
+typedef struct
+{
+    char text[CMD_QUEUE_TEXT_LEN];
+    int64_t rx_us;           // esp_timer_get_time() at receipt
+    struct sockaddr_in from; // where replies go
+    int sock;                // socket it came in on
+} cmd_item_t;
+
+typedef struct
+{
+    uint32_t received;
+    uint32_t throttled; // over the source's rate
+    uint32_t dropped;   // admitted, but the queue for its class was full
+    uint32_t ran_high;
+    uint32_t ran_low;
+} cmd_queue_stats_t;
+
+// Runs one command, from the worker task
+typedef void (*cmd_queue_handler_t)(const cmd_item_t *cmd);
+
+/**
+ * @brief Start the worker task that runs queued commands
+ *
+ * State queries and admin commands (STATUS?, STATS?, STATS=RESET) go to a
+ * high priority queue that the worker always drains first, so a flood of
+ * actuation commands cannot delay them by more than the one command running.
+ * STATS? and STATS=RESET are answered here; everything else goes to handler.
+ */
+esp_err_t cmd_queue_start(cmd_queue_handler_t handler);
+
+// Send text back to where cmd came from
+void cmd_queue_reply(const cmd_item_t *cmd, const char *text);
+
+/**
+ * @brief Admit and queue one datagram; call from the receiving task
+ *
+ * Charges a token from the sender's bucket, so one chatty or misbehaving
+ * source is throttled without touching the others. Never blocks.
+ *
+ * @return ESP_OK when queued, ESP_ERR_INVALID_STATE if throttled,
+ *         ESP_ERR_NO_MEM if the queue for its class is full
+ */
+esp_err_t cmd_queue_submit(const cmd_item_t *cmd);
+
+void cmd_queue_get_stats(cmd_queue_stats_t *stats);
+
+void cmd_queue_reset_stats(void);
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef _LED_PWM_H_
+#define _LED_PWM_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define LED_PWM_FREQ_HZ 5000
+#define LED_PWM_MAX_STEPS 8
+#define LED_PWM_QUEUE_LEN 8
+#define LED_PWM_TASK_STACK 3072
+#define LED_PWM_TASK_PRIORITY 6
+
+typedef struct
+{
+    uint8_t level;    // brightness, 0..100 %
+    uint16_t fade_ms; // hardware ramp from the previous level, 0 = jump
+    uint16_t hold_ms; // time to stay at level once the ramp ends
+} led_pwm_step_t;
+
+/**
+ * @brief Drive the LED on gpio from LEDC with hardware fades
+ *
+ * Ramps are run by the LEDC fade engine. Its fade-end interrupt wakes the
+ * driver task only to start the next pattern step, so between commands (and
+ * during a ramp) no code runs for the LED.
+ */
+esp_err_t led_pwm_init(int gpio);
+
+// Go to level (0..100 %) over fade_ms, stopping any running pattern
+esp_err_t led_pwm_set(uint8_t level, uint32_t fade_ms);
+
+// Current brightness, 0..100 %
+uint8_t led_pwm_get_level(void);
+
+// Play steps in a loop until the next led_pwm_set() / led_pwm_play()
+esp_err_t led_pwm_play(const led_pwm_step_t *steps, size_t num_steps);
+
+/**
+ * @brief Run a text command received at rx_us (esp_timer_get_time())
+ *
+ *   GPIO4=0 | GPIO4=1                       off / full on
+ *   LED=<level>[,<fade_ms>]                 e.g. LED=40,750
+ *   PATTERN=<level>,<fade_ms>,<hold_ms>;...  e.g. PATTERN=100,500,0;0,500,200
+ *
+ * The time from rx_us until the LEDC registers are written is logged, and
+ * so is the CPU time each ramp took once it ends.
+ *
+ * @return ESP_ERR_NOT_SUPPORTED if cmd is not an LED command
+ */
+esp_err_t led_pwm_command(const char *cmd, int64_t rx_us);
+
+#endif
@@ -0,0 +1,297 @@
+#include <string.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "lwip/sockets.h"
+
+#include "time-sync.h"
+
+static const char *TAG = "time-sync";
+
+typedef struct
+{
+    bool used;
+    int64_t due_us; // esp_timer clock
+    char cmd[TIME_SYNC_CMD_LEN];
+} pending_t;
+
+static pending_t s_pending[TIME_SYNC_MAX_PENDING];
+static SemaphoreHandle_t s_lock = NULL;
+static esp_timer_handle_t s_timer = NULL;
+static time_sync_action_cb_t s_action = NULL;
+
+static const char *s_server = NULL;
+static volatile bool s_synced = false;
+static int64_t s_last_sync_mono_us = 0;
+
+#define NTP_PORT 123
+#define NTP_UNIX_OFFSET 2208988800ULL // 1900 -> 1970
+
+static int64_t now_us(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static int64_t ntp_to_us(const uint8_t *p)
+{
+    uint32_t sec = (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+    uint32_t frac = (uint32_t)p[4] << 24 | p[5] << 16 | p[6] << 8 | p[7];
+    return ((int64_t)sec - NTP_UNIX_OFFSET) * 1000000 + (((uint64_t)frac * 1000000) >> 32);
+}
+
+static void us_to_ntp(int64_t us, uint8_t *p)
+{
+    uint32_t sec = us / 1000000 + NTP_UNIX_OFFSET;
+    uint32_t frac = ((uint64_t)(us % 1000000) << 32) / 1000000;
+    for (int i = 0; i < 4; i++)
+    {
+        p[i] = sec >> (24 - 8 * i);
+        p[4 + i] = frac >> (24 - 8 * i);
+    }
+}
+
+/* One NTP exchange. Returns false on timeout or a reply to another request.
+ * offset: server minus us; delay: round trip minus the server's own time */
+static bool ntp_exchange(int sock, const struct sockaddr_in *server, int64_t *offset_us, int64_t *delay_us)
+{
+    uint8_t pkt[48] = {0x23}; // LI 0, version 4, client
+    int64_t t1 = now_us();
+    us_to_ntp(t1, pkt + 40); // echoed back as the originate timestamp
+    if (sendto(sock, pkt, sizeof(pkt), 0, (const struct sockaddr *)server, sizeof(*server)) < 0)
+    {
+        return false;
+    }
+    uint8_t tx_stamp[8];
+    memcpy(tx_stamp, pkt + 40, sizeof(tx_stamp));
+
+    int len = recv(sock, pkt, sizeof(pkt), 0);
+    int64_t t4 = now_us();
+    if (len < (int)sizeof(pkt) || memcmp(pkt + 24, tx_stamp, sizeof(tx_stamp)) != 0)
+    {
+        return false;
+    }
+    int64_t t2 = ntp_to_us(pkt + 32);
+    int64_t t3 = ntp_to_us(pkt + 40);
+    *offset_us = ((t2 - t1) + (t3 - t4)) / 2;
+    *delay_us = (t4 - t1) - (t3 - t2);
+    return true;
+}
+
+/* A burst of exchanges, keeping the one with the shortest round trip: its legs
+ * can be the least asymmetric, so its offset is the most trustworthy. A single
+ * sample (what lwIP SNTP takes) is off by half of any Wi-Fi delay spike. */
+static bool sync_once(void)
+{
+    struct sockaddr_in server = {
+        .sin_family = AF_INET,
+        .sin_port = htons(NTP_PORT),
+        .sin_addr.s_addr = inet_addr(s_server)};
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (sock < 0)
+    {
+        return false;
+    }
+    struct timeval timeout = {.tv_sec = 0, .tv_usec = TIME_SYNC_REPLY_TIMEOUT_MS * 1000};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    int64_t best_offset = 0, best_delay = INT64_MAX;
+    int replies = 0;
+    for (int i = 0; i < TIME_SYNC_BURST; i++)
+    {
+        int64_t offset, delay;
+        if (ntp_exchange(sock, &server, &offset, &delay))
+        {
+            replies++;
+            if (delay < best_delay)
+            {
+                best_delay = delay;
+                best_offset = offset;
+            }
+        }
+        vTaskDelay(pdMS_TO_TICKS(TIME_SYNC_BURST_GAP_MS));
+    }
+    close(sock);
+    if (replies == 0)
+    {
+        return false;
+    }
+
+    int64_t corrected = now_us() + best_offset;
+    struct timeval tv = {.tv_sec = corrected / 1000000, .tv_usec = corrected % 1000000};
+    settimeofday(&tv, NULL);
+
+    int64_t mono_us = esp_timer_get_time();
+    if (s_synced)
+    {
+        // The clock free-ran since the last sync, so the offset is its drift
+        int64_t elapsed_us = mono_us - s_last_sync_mono_us;
+        ESP_LOGI(TAG, "Clock corrected by %lld us after %lld s (%lld ppm), best round trip %lld us of %d",
+                 best_offset, elapsed_us / 1000000, elapsed_us > 0 ? best_offset * 1000000 / elapsed_us : 0,
+                 best_delay, replies);
+    }
+    else
+    {
+        ESP_LOGI(TAG, "Clock set, best round trip %lld us of %d", best_delay, replies);
+    }
+    s_last_sync_mono_us = mono_us;
+    s_synced = true;
+    return true;
+}
+
+static void sync_task(void *pvParameters)
+{
+    while (1)
+    {
+        bool ok = sync_once();
+        vTaskDelay(pdMS_TO_TICKS(ok ? TIME_SYNC_INTERVAL_MS : TIME_SYNC_RETRY_MS));
+    }
+}
+
+// Arm the timer for the earliest pending command. Called with s_lock held.
+static void arm_timer(void)
+{
+    int64_t earliest = INT64_MAX;
+    for (int i = 0; i < TIME_SYNC_MAX_PENDING; i++)
+    {
+        if (s_pending[i].used && s_pending[i].due_us < earliest)
+        {
+            earliest = s_pending[i].due_us;
+        }
+    }
+    esp_timer_stop(s_timer); // not running is fine
+    if (earliest != INT64_MAX)
+    {
+        int64_t delay_us = earliest - esp_timer_get_time();
+        esp_timer_start_once(s_timer, delay_us > 0 ? delay_us : 0);
+    }
+}
+
+static void timer_cb(void *arg)
+{
+    pending_t due[TIME_SYNC_MAX_PENDING];
+    int num_due = 0;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int64_t now = esp_timer_get_time();
+    for (int i = 0; i < TIME_SYNC_MAX_PENDING; i++)
+    {
+        if (s_pending[i].used && s_pending[i].due_us <= now)
+        {
+            // Keep them in due order
+            int j = num_due++;
+            while (j > 0 && due[j - 1].due_us > s_pending[i].due_us)
+            {
+                due[j] = due[j - 1];
+                j--;
+            }
+            due[j] = s_pending[i];
+            s_pending[i].used = false;
+        }
+    }
+    arm_timer();
+    xSemaphoreGive(s_lock);
+
+    for (int i = 0; i < num_due; i++)
+    {
+        s_action(due[i].cmd, esp_timer_get_time() - due[i].due_us);
+    }
+}
+
+esp_err_t time_sync_start(const char *server, time_sync_action_cb_t action)
+{
+    s_action = action;
+    s_lock = xSemaphoreCreateMutex();
+    if (s_lock == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_timer_create_args_t timer_args = {
+        .callback = timer_cb,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "time_sync"};
+    esp_err_t err = esp_timer_create(&timer_args, &s_timer);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    s_server = server;
+    if (xTaskCreate(sync_task, "time_sync", 3072, NULL, 5, NULL) != pdPASS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "Syncing with %s every %d s", server, TIME_SYNC_INTERVAL_MS / 1000);
+    return ESP_OK;
+}
+
+bool time_sync_is_synced(void)
+{
+    return s_synced;
+}
+
+int64_t time_sync_now_ms(void)
+{
+    return now_us() / 1000;
+}
+
+esp_err_t time_sync_schedule(int64_t at_ms, const char *cmd)
+{
+    if (!s_synced || s_lock == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (strlen(cmd) >= TIME_SYNC_CMD_LEN)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    int64_t ahead_us = at_ms * 1000 - now_us();
+    if (ahead_us > (int64_t)TIME_SYNC_MAX_AHEAD_MS * 1000)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t err = ESP_ERR_NO_MEM;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < TIME_SYNC_MAX_PENDING; i++)
+    {
+        if (!s_pending[i].used)
+        {
+            s_pending[i].used = true;
+            s_pending[i].due_us = esp_timer_get_time() + ahead_us;
+            strcpy(s_pending[i].cmd, cmd);
+            arm_timer();
+            err = ESP_OK;
+            break;
+        }
+    }
+    xSemaphoreGive(s_lock);
+    return err;
+}
+
+esp_err_t time_sync_command(const char *msg)
+{
+    if (strncmp(msg, "AT=", 3) != 0)
+    {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    char *end;
+    long long at_ms = strtoll(msg + 3, &end, 10);
+    if (end == msg + 3 || *end != ';')
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = time_sync_schedule(at_ms, end + 1);
+    if (err == ESP_OK)
+    {
+        ESP_LOGI(TAG, "%s scheduled %lld ms ahead", end + 1, at_ms - time_sync_now_ms());
+    }
+    return err;
+}
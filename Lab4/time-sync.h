@@ -0,0 +1,60 @@
+#ifndef _TIME_SYNC_H_
+#define _TIME_SYNC_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define TIME_SYNC_INTERVAL_MS (5 * 60 * 1000)
+#define TIME_SYNC_RETRY_MS 5000
+#define TIME_SYNC_BURST 8 // NTP exchanges per sync, the shortest round trip wins
+#define TIME_SYNC_BURST_GAP_MS 20
+#define TIME_SYNC_REPLY_TIMEOUT_MS 200
+#define TIME_SYNC_MAX_PENDING 8
+#define TIME_SYNC_CMD_LEN 64
+#define TIME_SYNC_MAX_AHEAD_MS 60000 // refuse commands scheduled further out than this
+
+/**
+ * @brief Runs a scheduled command
+ *
+ * Called from the esp_timer task, so it must not block.
+ *
+ * @param cmd     The command without its AT= prefix
+ * @param late_us How long after the requested instant the timer fired
+ */
+typedef void (*time_sync_action_cb_t)(const char *cmd, int64_t late_us);
+
+/**
+ * @brief Keep the wall clock in sync with an NTP server and start the timer queue
+ *
+ * server is an IPv4 address. Every TIME_SYNC_INTERVAL_MS a burst of
+ * TIME_SYNC_BURST requests is sent and the reply with the shortest round
+ * trip sets the clock. Every sync logs how far the clock had drifted since
+ * the previous one. Until the link is up, syncs are retried every
+ * TIME_SYNC_RETRY_MS.
+ */
+esp_err_t time_sync_start(const char *server, time_sync_action_cb_t action);
+
+bool time_sync_is_synced(void);
+
+// Wall clock in ms since the epoch
+int64_t time_sync_now_ms(void);
+
+/**
+ * @brief Queue cmd to run at at_ms (wall clock, ms since the epoch)
+ *
+ * The instant is converted to the esp_timer clock when queued, and one
+ * esp_timer is armed for the earliest pending command. Commands already
+ * due run right away and are reported as late.
+ */
+esp_err_t time_sync_schedule(int64_t at_ms, const char *cmd);
+
+/**
+ * @brief Queue a command of the form AT=<epoch_ms>;<command>
+ *
+ * @return ESP_ERR_NOT_SUPPORTED if msg has no AT= prefix,
+ *         ESP_ERR_INVALID_STATE before the first sync
+ */
+esp_err_t time_sync_command(const char *msg);
+
+#endif
@@ -0,0 +1,227 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "esp_wifi.h"
+#include "esp_event.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+
+#include "wifi-manager.h"
+#include "boot-profile.h"
+
+#define WIFI_CONNECTED_BIT BIT0
+
+static const char *TAG = "wifi-manager";
+
+static EventGroupHandle_t s_wifi_event_group;
+static esp_timer_handle_t s_retry_timer;
+static volatile wifi_manager_state_t s_state = WIFI_MANAGER_IDLE;
+static uint32_t s_retry_num = 0;
+
+static portMUX_TYPE s_subscribers_lock = portMUX_INITIALIZER_UNLOCKED;
+static struct
+{
+    wifi_manager_cb_t cb;
+    void *ctx;
+} s_subscribers[WIFI_MANAGER_MAX_SUBSCRIBERS];
+static int s_subscriber_count = 0;
+
+static void notify_subscribers(bool link_up)
+{
+    int count;
+    taskENTER_CRITICAL(&s_subscribers_lock);
+    count = s_subscriber_count;
+    taskEXIT_CRITICAL(&s_subscribers_lock);
+
+    // Entries are only ever appended, so the first `count` slots are stable
+    for (int i = 0; i < count; i++)
+    {
+        s_subscribers[i].cb(link_up, s_subscribers[i].ctx);
+    }
+}
+
+static uint32_t next_backoff_ms(void)
+{
+    uint32_t shift = s_retry_num < 16 ? s_retry_num : 16;
+    uint32_t ceiling = WIFI_MANAGER_BACKOFF_MIN_MS << shift;
+    if (ceiling > WIFI_MANAGER_BACKOFF_MAX_MS)
+    {
+        ceiling = WIFI_MANAGER_BACKOFF_MAX_MS;
+    }
+    // Equal jitter: keep half of the ceiling, randomize the other half
+    return ceiling / 2 + esp_random() % (ceiling / 2 + 1);
+}
+
+static void schedule_retry(void)
+{
+    uint32_t delay_ms = next_backoff_ms();
+    s_retry_num++;
+    s_state = WIFI_MANAGER_BACKOFF;
+    ESP_LOGI(TAG, "retry %lu in %lu ms", (unsigned long)s_retry_num, (unsigned long)delay_ms);
+    esp_timer_stop(s_retry_timer);
+    ESP_ERROR_CHECK(esp_timer_start_once(s_retry_timer, (uint64_t)delay_ms * 1000));
+}
+
+static void retry_timer_cb(void *arg)
+{
+    s_state = WIFI_MANAGER_CONNECTING;
+    esp_err_t err = esp_wifi_connect();
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "esp_wifi_connect failed: %s", esp_err_to_name(err));
+        schedule_retry();
+    }
+}
+
+static void event_handler(void *arg, esp_event_base_t event_base,
+                          int32_t event_id, void *event_data)
+{
+    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START)
+    {
+        s_state = WIFI_MANAGER_CONNECTING;
+        esp_wifi_connect();
+    }
+    else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED)
+    {
+        boot_profile_mark("wifi_associated");
+    }
+    else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED)
+    {
+        wifi_event_sta_disconnected_t *event = (wifi_event_sta_disconnected_t *)event_data;
+        bool was_connected = s_state == WIFI_MANAGER_CONNECTED;
+
+        xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+        ESP_LOGI(TAG, "connect to the AP fail, reason %d", event->reason);
+        schedule_retry();
+
+        if (was_connected)
+        {
+            notify_subscribers(false);
+        }
+    }
+    else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP)
+    {
+        ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
+        ESP_LOGI(TAG, "got ip:" IPSTR " after %lu retries", IP2STR(&event->ip_info.ip),
+                 (unsigned long)s_retry_num);
+        boot_profile_mark("dhcp_got_ip");
+        s_retry_num = 0;
+        s_state = WIFI_MANAGER_CONNECTED;
+        xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+        notify_subscribers(true);
+    }
+    else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_LOST_IP)
+    {
+        // Still associated; DHCP will hand out a new lease and raise GOT_IP again
+        ESP_LOGI(TAG, "lost ip");
+        s_state = WIFI_MANAGER_CONNECTING;
+        xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+        notify_subscribers(false);
+    }
+}
+
+esp_err_t wifi_manager_start(const char *ssid, const char *password)
+{
+    if (s_state != WIFI_MANAGER_IDLE)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    s_wifi_event_group = xEventGroupCreate();
+    if (s_wifi_event_group == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = retry_timer_cb,
+        .name = "wifi_retry"};
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &s_retry_timer));
+
+    esp_netif_create_default_wifi_sta();
+
+    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,
+                                                        ESP_EVENT_ANY_ID,
+                                                        &event_handler,
+                                                        NULL,
+                                                        NULL));
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT,
+                                                        IP_EVENT_STA_GOT_IP,
+                                                        &event_handler,
+                                                        NULL,
+                                                        NULL));
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT,
+                                                        IP_EVENT_STA_LOST_IP,
+                                                        &event_handler,
+                                                        NULL,
+                                                        NULL));
+
+    wifi_config_t wifi_config = {0};
+    strncpy((char *)wifi_config.sta.ssid, ssid, sizeof(wifi_config.sta.ssid));
+    strncpy((char *)wifi_config.sta.password, password, sizeof(wifi_config.sta.password));
+    if (strlen(password) > 0)
+    {
+        wifi_config.sta.threshold.authmode = WIFI_AUTH_WPA2_PSK;
+    }
+
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+    ESP_ERROR_CHECK(esp_wifi_start());
+
+    ESP_LOGI(TAG, "wifi_manager_start finished, SSID:%s", ssid);
+    return ESP_OK;
+}
+
+esp_err_t wifi_manager_subscribe(wifi_manager_cb_t cb, void *ctx)
+{
+    if (cb == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    taskENTER_CRITICAL(&s_subscribers_lock);
+    if (s_subscriber_count >= WIFI_MANAGER_MAX_SUBSCRIBERS)
+    {
+        taskEXIT_CRITICAL(&s_subscribers_lock);
+        return ESP_ERR_NO_MEM;
+    }
+    s_subscribers[s_subscriber_count].cb = cb;
+    s_subscribers[s_subscriber_count].ctx = ctx;
+    s_subscriber_count++;
+    taskEXIT_CRITICAL(&s_subscribers_lock);
+
+    if (wifi_manager_is_connected())
+    {
+        cb(true, ctx);
+    }
+    return ESP_OK;
+}
+
+bool wifi_manager_is_connected(void)
+{
+    return s_state == WIFI_MANAGER_CONNECTED;
+}
+
+bool wifi_manager_wait_connected(TickType_t ticks_to_wait)
+{
+    if (s_wifi_event_group == NULL)
+    {
+        return false;
+    }
+    EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group,
+                                           WIFI_CONNECTED_BIT,
+                                           pdFALSE,
+                                           pdTRUE,
+                                           ticks_to_wait);
+    return (bits & WIFI_CONNECTED_BIT) != 0;
+}
+
+wifi_manager_state_t wifi_manager_get_state(void)
+{
+    return s_state;
+}
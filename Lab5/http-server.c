@@ -14,6 +14,7 @@
 
 #include "esp_http_server.h"
 #include "wifi-scan.h"
+#include "boot-profile.h"
 
 static const char *TAG = "http-server";
 static wifi_scan_result_t* scan_results = NULL;
@@ -116,6 +117,21 @@ esp_err_t post_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
+esp_err_t boot_get_handler(httpd_req_t *req)
+{
+    // httpd serves one request at a time, so a static buffer keeps this off the task stack
+    static char json[2048];
+    size_t len = boot_profile_to_json(json, sizeof(json));
+    if (len == 0) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, json, len);
+    return ESP_OK;
+}
+
 httpd_uri_t uri_get = {
     .uri      = "/index.html",
     .method   = HTTP_GET,
@@ -130,6 +146,13 @@ httpd_uri_t uri_post = {
     .user_ctx = NULL
 };
 
+httpd_uri_t uri_boot = {
+    .uri      = "/boot",
+    .method   = HTTP_GET,
+    .handler  = boot_get_handler,
+    .user_ctx = NULL
+};
+
 httpd_handle_t start_webserver(void)
 {
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
@@ -139,6 +162,7 @@ httpd_handle_t start_webserver(void)
     if (httpd_start(&server, &config) == ESP_OK) {
         httpd_register_uri_handler(server, &uri_get);
         httpd_register_uri_handler(server, &uri_post);
+        httpd_register_uri_handler(server, &uri_boot);
         ESP_LOGI(TAG, "Web server started successfully");
     }
     return server;
@@ -25,21 +25,31 @@
 #include "wifi-scan.h"
 
 #include "../mdns/include/mdns.h"
+#include "boot-profile.h"
 
 void app_main(void)
 {
   // Initialize NVS
+  int phase = boot_profile_begin("nvs_init");
   esp_err_t ret = nvs_flash_init();
   if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND)
   {
+    int erase_phase = boot_profile_begin("nvs_erase_retry");
     ESP_ERROR_CHECK(nvs_flash_erase());
     ret = nvs_flash_init();
+    boot_profile_end(erase_phase);
   }
   ESP_ERROR_CHECK(ret);
+  boot_profile_end(phase);
+
+  phase = boot_profile_begin("event_loop");
   ESP_ERROR_CHECK(esp_event_loop_create_default());
+  boot_profile_end(phase);
 
   // TODO: 3. SSID scanning in STA mode
+  phase = boot_profile_begin("wifi_scan");
   wifi_scan_result_t *scan_result = wifi_start_scan();
+  boot_profile_end(phase);
   if (scan_result == NULL)
   {
     ESP_LOGE("main", "WiFi scan failed!");
@@ -51,9 +61,12 @@ void app_main(void)
   set_scan_results(scan_result);
 
   // TODO: 1. Start the softAP mode
+  phase = boot_profile_begin("softap_start");
   wifi_init_softap();
+  boot_profile_end(phase);
 
   // TODO: 4. mDNS init (if there is time left)
+  phase = boot_profile_begin("mdns_init");
   esp_err_t err = mdns_init();
   if (err)
   {
@@ -66,15 +79,19 @@ void app_main(void)
   mdns_instance_name_set("ESP32 Web Configuration");
 
   mdns_service_add(NULL, "_http", "_tcp", 80, NULL, 0);
+  boot_profile_end(phase);
 
   ESP_LOGI("main", "mDNS initialized. Device can be accessed at esp32-config.local");
 
   // TODO: 2. Start the web server
+  phase = boot_profile_begin("httpd_start");
   httpd_handle_t server = start_webserver();
+  boot_profile_end(phase);
   if (server == NULL)
   {
     ESP_LOGI("main", "Error starting web server!");
     return;
   }
   ESP_LOGI("main", "Web server started successfully");
+  boot_profile_finish();
 }
\ No newline at end of file
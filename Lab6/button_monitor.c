@@ -5,6 +5,8 @@
 #include "nvs_flash.h"
 #include "nvs.h"
 
+#include "boot-profile.h"
+
 #define BUTTON_GPIO 2
 #define LONG_PRESS_TIME_MS 5000
 
@@ -13,6 +15,7 @@ static const char *TAG = "button_monitor";
 void button_monitor_task(void *pvParameters)
 {
     // Configure button GPIO
+    int phase = boot_profile_begin("gpio_init");
     gpio_config_t io_conf = {
         .pin_bit_mask = (1ULL << BUTTON_GPIO),
         .mode = GPIO_MODE_INPUT,
@@ -21,6 +24,7 @@ void button_monitor_task(void *pvParameters)
         .intr_type = GPIO_INTR_DISABLE
     };
     gpio_config(&io_conf);
+    boot_profile_end(phase);
 
     TickType_t press_start = 0;
     bool button_pressed = false;
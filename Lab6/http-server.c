@@ -14,6 +14,7 @@
 
 #include "esp_http_server.h"
 #include "wifi-scan.h"
+#include "boot-profile.h"
 
 static const char *TAG = "http-server";
 static wifi_scan_result_t *scan_results = NULL;
@@ -161,6 +162,23 @@ esp_err_t post_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
+/* URI handler returning the boot timeline as JSON */
+esp_err_t boot_get_handler(httpd_req_t *req)
+{
+    // httpd serves one request at a time, so a static buffer keeps this off the task stack
+    static char json[2048];
+    size_t len = boot_profile_to_json(json, sizeof(json));
+    if (len == 0)
+    {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, json, len);
+    return ESP_OK;
+}
+
 /* URI handler structure for GET /uri */
 httpd_uri_t uri_get = {
     .uri = "/index.html",
@@ -175,6 +193,13 @@ httpd_uri_t uri_post = {
     .handler = post_handler,
     .user_ctx = NULL};
 
+/* URI handler structure for GET /boot */
+httpd_uri_t uri_boot = {
+    .uri = "/boot",
+    .method = HTTP_GET,
+    .handler = boot_get_handler,
+    .user_ctx = NULL};
+
 /* Function for starting the webserver */
 httpd_handle_t start_webserver(void)
 {
@@ -190,12 +215,27 @@ httpd_handle_t start_webserver(void)
         /* Register URI handlers */
         httpd_register_uri_handler(server, &uri_get);
         httpd_register_uri_handler(server, &uri_post);
+        httpd_register_uri_handler(server, &uri_boot);
         ESP_LOGI(TAG, "Web server started successfully");
     }
     /* If server failed to start, handle will be NULL */
     return server;
 }
 
+/* Function for starting a server that only exposes the boot timeline */
+httpd_handle_t start_status_server(void)
+{
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    httpd_handle_t server = NULL;
+
+    if (httpd_start(&server, &config) == ESP_OK)
+    {
+        httpd_register_uri_handler(server, &uri_boot);
+        ESP_LOGI(TAG, "Status server started successfully");
+    }
+    return server;
+}
+
 /* Function for stopping the webserver */
 void stop_webserver(httpd_handle_t server)
 {
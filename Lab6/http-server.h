@@ -7,6 +7,9 @@
 // Initialize the webserver with scan results
 httpd_handle_t start_webserver(void);
 
+// Start a webserver exposing only GET /boot (normal mode)
+httpd_handle_t start_status_server(void);
+
 // Stop the webserver
 void stop_webserver(httpd_handle_t server);
 
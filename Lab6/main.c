@@ -26,70 +26,40 @@
 
 #include "../mdns/include/mdns.h"
 #include "button_monitor.h"
+#include "wifi-manager.h"
+#include "boot-profile.h"
 
-static void wifi_event_handler(void *arg, esp_event_base_t event_base,
-                               int32_t event_id, void *event_data);
 static void connect_wifi(void);
 static void scan_mdns_services(void);
 
-#define WIFI_CONNECTED_BIT BIT0
-#define WIFI_FAIL_BIT BIT1
-static EventGroupHandle_t s_wifi_event_group;
-static int s_retry_num = 0;
-#define MAXIMUM_RETRY 5
+#define BOOT_MDNS_READY_BIT BIT0
+static EventGroupHandle_t s_boot_event_group;
 
-static void wifi_event_handler(void *arg, esp_event_base_t event_base,
-                               int32_t event_id, void *event_data)
+static void mdns_setup_task(void *pvParameters)
 {
-  if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START)
+  bool provisioning = (bool)pvParameters;
+
+  int phase = boot_profile_begin("mdns_init");
+  esp_err_t err = mdns_init();
+  if (err == ESP_OK && provisioning)
   {
-    esp_wifi_connect();
+    mdns_hostname_set("esp32-config");
+    mdns_instance_name_set("ESP32 Web Configuration");
+    mdns_service_add(NULL, "_http", "_tcp", 80, NULL, 0);
   }
-  else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED)
-  {
-    if (s_retry_num < MAXIMUM_RETRY)
-    {
-      esp_wifi_connect();
-      s_retry_num++;
-      ESP_LOGI("main", "retry to connect to the AP");
-    }
-    else
-    {
-      xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
-    }
-    ESP_LOGI("main", "connect to the AP fail");
-  }
-  else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP)
+  boot_profile_end(phase);
+
+  if (err != ESP_OK)
   {
-    ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
-    ESP_LOGI("main", "got ip:" IPSTR, IP2STR(&event->ip_info.ip));
-    s_retry_num = 0;
-    xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+    ESP_LOGE("main", "mDNS Init failed: %d", err);
   }
+
+  xEventGroupSetBits(s_boot_event_group, BOOT_MDNS_READY_BIT);
+  vTaskDelete(NULL);
 }
 
 static void connect_wifi(void)
 {
-  s_wifi_event_group = xEventGroupCreate();
-
-  esp_netif_create_default_wifi_sta();
-
-  wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
-  ESP_ERROR_CHECK(esp_wifi_init(&cfg));
-
-  esp_event_handler_instance_t instance_any_id;
-  esp_event_handler_instance_t instance_got_ip;
-  ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,
-                                                      ESP_EVENT_ANY_ID,
-                                                      &wifi_event_handler,
-                                                      NULL,
-                                                      &instance_any_id));
-  ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT,
-                                                      IP_EVENT_STA_GOT_IP,
-                                                      &wifi_event_handler,
-                                                      NULL,
-                                                      &instance_got_ip));
-
   nvs_handle_t nvs_handle;
   char ssid[32];
   char pass[64];
@@ -121,44 +91,11 @@ static void connect_wifi(void)
 
   nvs_close(nvs_handle);
 
-  wifi_config_t wifi_config = {
-      .sta = {
-          .threshold.authmode = WIFI_AUTH_WPA2_PSK,
-      },
-  };
-  memcpy(wifi_config.sta.ssid, ssid, ssid_len);
-  memcpy(wifi_config.sta.password, pass, pass_len);
-
-  ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-  ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
-  ESP_ERROR_CHECK(esp_wifi_start());
-
-  ESP_LOGI("main", "wifi_init_sta finished.");
-
-  EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group,
-                                         WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
-                                         pdFALSE,
-                                         pdFALSE,
-                                         portMAX_DELAY);
-
-  if (bits & WIFI_CONNECTED_BIT)
-  {
-    ESP_LOGI("main", "connected to ap SSID:%s", ssid);
-  }
-  else if (bits & WIFI_FAIL_BIT)
-  {
-    ESP_LOGI("main", "Failed to connect to SSID:%s", ssid);
-  }
-  else
-  {
-    ESP_LOGE("main", "UNEXPECTED EVENT");
-  }
+  ESP_ERROR_CHECK(wifi_manager_start(ssid, pass));
 }
 
 static void scan_mdns_services(void)
 {
-  ESP_ERROR_CHECK(mdns_init());
-
   ESP_LOGI("main", "Browsing for _http._tcp.local services...");
   mdns_result_t *results = NULL;
   esp_err_t err = mdns_query_ptr("_http", "_tcp", 3000, 20, &results);
@@ -229,29 +166,49 @@ static bool check_wifi_credentials(void)
 
 void app_main(void)
 {
+  int phase = boot_profile_begin("nvs_init");
   esp_err_t ret = nvs_flash_init();
   if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND)
   {
+    int erase_phase = boot_profile_begin("nvs_erase_retry");
     ESP_ERROR_CHECK(nvs_flash_erase());
     ret = nvs_flash_init();
+    boot_profile_end(erase_phase);
   }
   ESP_ERROR_CHECK(ret);
+  boot_profile_end(phase);
 
+  phase = boot_profile_begin("netif_init");
   ESP_ERROR_CHECK(esp_netif_init());
   ESP_ERROR_CHECK(esp_event_loop_create_default());
+  boot_profile_end(phase);
+
+  s_boot_event_group = xEventGroupCreate();
 
+  // Button GPIO is configured inside its own task, in parallel with the rest of boot
   xTaskCreate(button_monitor_task, "button_monitor", 2048, NULL, 5, NULL);
 
   if (check_wifi_credentials())
   {
     ESP_LOGI("main", "Starting normal application mode");
 
+    xTaskCreate(mdns_setup_task, "mdns_setup", 4096, (void *)false, 5, NULL);
+
+    phase = boot_profile_begin("wifi_start");
     connect_wifi();
+    boot_profile_end(phase);
 
-    scan_mdns_services();
+    phase = boot_profile_begin("httpd_start");
+    start_status_server();
+    boot_profile_end(phase);
+
+    xEventGroupWaitBits(s_boot_event_group, BOOT_MDNS_READY_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
+    wifi_manager_wait_connected(portMAX_DELAY);
+    boot_profile_finish();
 
     while (1)
     {
+      wifi_manager_wait_connected(portMAX_DELAY);
       scan_mdns_services();
       vTaskDelay(pdMS_TO_TICKS(30000)); 
     }
@@ -260,7 +217,22 @@ void app_main(void)
   {
     ESP_LOGI("main", "Starting provisioning mode");
 
+    // Neither mDNS nor the web server depend on the scan results: the softAP
+    // only comes up after the scan, so no client can hit the server early
+    xTaskCreate(mdns_setup_task, "mdns_setup", 4096, (void *)true, 5, NULL);
+
+    phase = boot_profile_begin("httpd_start");
+    httpd_handle_t server = start_webserver();
+    boot_profile_end(phase);
+    if (server == NULL)
+    {
+      ESP_LOGE("main", "Error starting web server!");
+      return;
+    }
+
+    phase = boot_profile_begin("wifi_scan");
     wifi_scan_result_t *scan_result = wifi_start_scan();
+    boot_profile_end(phase);
     if (scan_result == NULL)
     {
       ESP_LOGE("main", "WiFi scan failed!");
@@ -269,21 +241,11 @@ void app_main(void)
 
     set_scan_results(scan_result);
 
+    phase = boot_profile_begin("softap_start");
     wifi_init_softap();
+    boot_profile_end(phase);
 
-    esp_err_t err = mdns_init();
-    if (err == ESP_OK)
-    {
-      mdns_hostname_set("esp32-config");
-      mdns_instance_name_set("ESP32 Web Configuration");
-      mdns_service_add(NULL, "_http", "_tcp", 80, NULL, 0);
-    }
-
-    httpd_handle_t server = start_webserver();
-    if (server == NULL)
-    {
-      ESP_LOGE("main", "Error starting web server!");
-      return;
-    }
+    xEventGroupWaitBits(s_boot_event_group, BOOT_MDNS_READY_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
+    boot_profile_finish();
   }
 }
\ No newline at end of file
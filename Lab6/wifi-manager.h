@@ -0,0 +1,53 @@
+#ifndef _WIFI_MANAGER_H_
+#define _WIFI_MANAGER_H_
+
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+// Reconnect backoff: the ceiling doubles on every failed attempt, from MIN up to MAX
+#define WIFI_MANAGER_BACKOFF_MIN_MS 500
+#define WIFI_MANAGER_BACKOFF_MAX_MS 60000
+
+#define WIFI_MANAGER_MAX_SUBSCRIBERS 4
+
+typedef enum
+{
+    WIFI_MANAGER_IDLE,       // wifi_manager_start() not called yet
+    WIFI_MANAGER_CONNECTING, // association / DHCP in progress
+    WIFI_MANAGER_CONNECTED,  // associated and holding an IP address
+    WIFI_MANAGER_BACKOFF,    // waiting for the retry timer before the next attempt
+} wifi_manager_state_t;
+
+/**
+ * @brief Link state callback
+ *
+ * Called from the default event loop task (or the esp_timer task) whenever
+ * the link becomes usable or is lost. Must not block.
+ *
+ * @param link_up true once an IP address is held, false when it is lost
+ * @param ctx     Pointer passed to wifi_manager_subscribe()
+ */
+typedef void (*wifi_manager_cb_t)(bool link_up, void *ctx);
+
+/**
+ * @brief Start the station and return immediately
+ *
+ * esp_netif_init() and esp_event_loop_create_default() must have been called.
+ * The manager never gives up: every disconnect schedules another attempt after
+ * a jittered exponential backoff, so a fleet that lost its AP does not
+ * reconnect in lock-step once it comes back.
+ */
+esp_err_t wifi_manager_start(const char *ssid, const char *password);
+
+// Register a link state callback. If the link is already up, cb is called right away.
+esp_err_t wifi_manager_subscribe(wifi_manager_cb_t cb, void *ctx);
+
+bool wifi_manager_is_connected(void);
+
+// Block the calling task until the link is up or ticks_to_wait expires
+bool wifi_manager_wait_connected(TickType_t ticks_to_wait);
+
+wifi_manager_state_t wifi_manager_get_state(void);
+
+#endif
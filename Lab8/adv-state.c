@@ -0,0 +1,126 @@
+/***************************************************************************//**
+ * @file
+ * @brief Button and LED state broadcast in the advertising data.
+ ******************************************************************************/
+#include "sl_bluetooth.h"
+#include "sl_sleeptimer.h"
+#include "app_log.h"
+
+#include "adv-state.h"
+
+#define MANUFACTURER_LEN 14 // AD type + the fields in adv-state.h
+
+static uint8_t advertising_set = 0xff;
+static uint8_t button = 0;
+static uint8_t led = 0;
+static uint16_t counter = 0;
+static uint32_t refresh_tick;
+static uint32_t delay_ticks;
+
+static uint32_t refreshes = 0;
+static uint64_t delay_total_us = 0;
+static uint32_t delay_max_us = 0;
+static uint32_t failed = 0;
+static uint32_t stats_tick = 0;
+
+static void put16(uint8_t *p, uint16_t v)
+{
+  p[0] = v & 0xff;
+  p[1] = v >> 8;
+}
+
+static sl_status_t write_packet(void)
+{
+  uint8_t data[3 + 1 + MANUFACTURER_LEN];
+  uint32_t refresh_ms = sl_sleeptimer_tick_to_ms(refresh_tick);
+  uint32_t delay_us = (uint32_t)((uint64_t)delay_ticks * 1000000 / sl_sleeptimer_get_timer_frequency());
+  uint8_t *p = data;
+
+  *p++ = 2;    // flags
+  *p++ = 0x01;
+  *p++ = 0x06; // LE general discoverable, no BR/EDR
+  *p++ = MANUFACTURER_LEN;
+  *p++ = 0xff; // manufacturer specific data
+  put16(p, ADV_STATE_COMPANY_ID);
+  p += 2;
+  *p++ = ADV_STATE_FORMAT;
+  *p++ = (button ? 0x01 : 0) | (led ? 0x02 : 0);
+  *p++ = led;
+  put16(p, counter);
+  p += 2;
+  put16(p, refresh_ms & 0xffff);
+  put16(p + 2, refresh_ms >> 16);
+  p += 4;
+  put16(p, delay_us > 0xffff ? 0xffff : delay_us);
+
+  return sl_bt_legacy_advertiser_set_data(advertising_set, sl_bt_advertiser_advertising_data_packet,
+                                          sizeof(data), data);
+}
+
+sl_status_t adv_state_start(uint8_t set)
+{
+  advertising_set = set;
+  refresh_tick = sl_sleeptimer_get_tick_count();
+  delay_ticks = 0;
+  return write_packet();
+}
+
+static void refresh(uint32_t event_tick)
+{
+  counter++;
+  if (advertising_set == 0xff) {
+    return; // before boot; adv_state_start() will publish it
+  }
+
+  // The stack sends the new packet from the next advertising event on
+  refresh_tick = sl_sleeptimer_get_tick_count();
+  delay_ticks = refresh_tick - event_tick;
+  if (write_packet() != SL_STATUS_OK) {
+    failed++;
+    return;
+  }
+
+  uint32_t delay_us = (uint32_t)((uint64_t)delay_ticks * 1000000 / sl_sleeptimer_get_timer_frequency());
+  refreshes++;
+  delay_total_us += delay_us;
+  if (delay_us > delay_max_us) {
+    delay_max_us = delay_us;
+  }
+}
+
+void adv_state_set_button(uint8_t state, uint32_t event_tick)
+{
+  if (state != button) {
+    button = state;
+    refresh(event_tick);
+  }
+}
+
+void adv_state_set_led(uint8_t level, uint32_t event_tick)
+{
+  if (level != led) {
+    led = level;
+    refresh(event_tick);
+  }
+}
+
+void adv_state_log_stats(void)
+{
+  uint32_t now = sl_sleeptimer_get_tick_count();
+  if (now - stats_tick < sl_sleeptimer_ms_to_tick(ADV_STATE_STATS_INTERVAL_MS)) {
+    return;
+  }
+  stats_tick = now;
+  if (refreshes + failed == 0) {
+    return;
+  }
+
+  app_log("Advertised state: %lu refreshes (counter %u), change to packet avg %lu us, max %lu us, %lu failed\r\n",
+          (unsigned long)refreshes, counter,
+          (unsigned long)(refreshes ? delay_total_us / refreshes : 0),
+          (unsigned long)delay_max_us, (unsigned long)failed);
+  refreshes = 0;
+  delay_total_us = 0;
+  delay_max_us = 0;
+  failed = 0;
+}
@@ -34,28 +34,93 @@
 
 #include "em_cmu.h"
 #include "em_gpio.h"
+#include "sl_sleeptimer.h"
+#include "boot-profile.h"
+#include "edge-ring.h"
+#include "edge-history.h"
+#include "conn-profile.h"
+#include "gpio-out.h"
+#include "adv-state.h"
+#include "throughput.h"
+#include "dfu.h"
 #include "gatt_db.h"
 #define gattdb_LED_IO 27
 #define gattdb_BUTTON_IO 29
+// A burst of edges is reported once the pin has been quiet this long
+#define BUTTON_SETTLE_MS 5
+#define BUTTON_SETTLE_SIGNAL (1UL << 1) // sl_bt_external_signal() bit; throughput.h and edge-history.h use 0 and 2
+#define BUTTON_STATS_INTERVAL_MS 10000
 static bool button_io_notification_enabled = false;
 // The advertising set handle allocated from Bluetooth stack.
 static uint8_t advertising_set_handle = 0xff;
 
+// Edges drained from the ring but not reported yet
+static uint32_t batch_edges = 0;
+static uint32_t batch_last_tick;
+static sl_sleeptimer_timer_handle_t settle_timer;
+static uint8_t button_reported = 0xff; // last value written to the GATT database
+static uint32_t button_batches = 0;
+static uint32_t button_updates = 0;
+static uint32_t stats_logged_tick = 0;
+static uint32_t stats_logged_edges = 0;
+
 void GPIO_ODD_IRQHandler(void)
 {
+  uint32_t start = edge_ring_cycles();
   // Stergere flag intrerupere
   uint32_t interruptMask = GPIO_IntGet();
   GPIO_IntClear(interruptMask);
 
-  uint8_t button_state = GPIO_PinInGet(gpioPortC, 7) ? 1 : 0;
+  // Only record the edge; the GATT update happens in app_process_action()
+  if (interruptMask & (1 << 7)) {
+    edge_ring_push(GPIO_PinInGet(gpioPortC, 7) ? 1 : 0);
+  }
+  edge_ring_isr_done(start);
+}
 
-    // Update GATT attribute value
-    sl_bt_gatt_server_write_attribute_value(gattdb_BUTTON_IO, 0, sizeof(button_state), &button_state);
+static void settle_cb(sl_sleeptimer_timer_handle_t *handle, void *data)
+{
+  (void)handle;
+  (void)data;
+  // Only wakes the main loop, which reports the batch
+  sl_bt_external_signal(BUTTON_SETTLE_SIGNAL);
+}
 
-    // Notify client if enabled
-    if (button_io_notification_enabled) {
-      sl_bt_gatt_server_notify_all(gattdb_BUTTON_IO, sizeof(button_state), &button_state);
-    }
+static void report_button(uint8_t button_state)
+{
+  // Update GATT attribute value
+  sl_bt_gatt_server_write_attribute_value(gattdb_BUTTON_IO, 0, sizeof(button_state), &button_state);
+
+  // Notify client if enabled
+  if (button_io_notification_enabled) {
+    sl_bt_gatt_server_notify_all(gattdb_BUTTON_IO, sizeof(button_state), &button_state);
+  }
+  button_reported = button_state;
+  button_updates++;
+}
+
+static void log_button_stats(uint32_t now)
+{
+  if (now - stats_logged_tick < sl_sleeptimer_ms_to_tick(BUTTON_STATS_INTERVAL_MS)) {
+    return;
+  }
+  stats_logged_tick = now;
+
+  edge_ring_stats_t stats;
+  edge_ring_get_stats(&stats);
+  if (stats.edges == stats_logged_edges) {
+    return;
+  }
+  stats_logged_edges = stats.edges;
+
+  uint32_t avg = stats.isr_count ? (uint32_t)(stats.isr_total_cycles / stats.isr_count) : 0;
+  app_log("Button: %lu edges in %lu bursts, %lu GATT updates, %lu lost (ring full), %lu missed (bounce)\r\n",
+          (unsigned long)stats.edges, (unsigned long)button_batches, (unsigned long)button_updates,
+          (unsigned long)stats.lost, (unsigned long)stats.missed);
+  app_log("GPIO ISR: %lu runs, avg %lu cycles, max %lu cycles (%lu ns at %lu MHz)\r\n",
+          (unsigned long)stats.isr_count, (unsigned long)avg, (unsigned long)stats.isr_max_cycles,
+          (unsigned long)((uint64_t)stats.isr_max_cycles * 1000000000ULL / SystemCoreClock),
+          (unsigned long)(SystemCoreClock / 1000000));
 }
 
 /**************************************************************************//**
@@ -68,17 +133,21 @@ SL_WEAK void app_init(void)
   // This is called once during start-up.                                    //
   /////////////////////////////////////////////////////////////////////////////
 
+  int phase = boot_profile_begin("gpio_init");
   // Activare ramura clock periferic GPIO
   CMU_ClockEnable(cmuClock_GPIO, true);
-  // Configurare GPIOA 04 ca iesire (LED)
-  GPIO_PinModeSet(gpioPortA, 4, gpioModePushPull, 1);
+  // Output pins and their PWM timer; the LED on PA4 is output 0, starting at 0
+  gpio_out_init();
   // Configurare GPIOC 07 ca intrare (buton)
   GPIO_PinModeSet(gpioPortC, 7, gpioModeInputPullFilter, 1);
+  edge_ring_init(GPIO_PinInGet(gpioPortC, 7) ? 1 : 0);
+  edge_history_init(1 << 7);
   // Configurare intrerupere pentru buton pe ambele fronturi
   GPIO_ExtIntConfig(gpioPortC, 7, 7, true, true, true);
   // Activare intrerupere
   NVIC_ClearPendingIRQ(GPIO_ODD_IRQn);
   NVIC_EnableIRQ(GPIO_ODD_IRQn);
+  boot_profile_end(phase);
 
 }
 
@@ -92,6 +161,37 @@ SL_WEAK void app_process_action(void)
   // This is called infinitely.                                              //
   // Do not call blocking functions from here!                               //
   /////////////////////////////////////////////////////////////////////////////
+  edge_event_t ev;
+  bool drained = false;
+  while (edge_ring_pop(&ev)) {
+    drained = true;
+    edge_history_add(&ev);
+    batch_edges++;
+    batch_last_tick = ev.tick;
+  }
+
+  // Contact bounce arrives as a burst of edges; report only where it settled
+  uint32_t now = sl_sleeptimer_get_tick_count();
+  uint32_t settle_ticks = sl_sleeptimer_ms_to_tick(BUTTON_SETTLE_MS);
+  if (batch_edges > 0 && now - batch_last_tick >= settle_ticks) {
+    button_batches++;
+    // The ISR's latest level: the last popped edge is stale if the ring overflowed
+    uint8_t state = edge_ring_level();
+    if (state != button_reported) {
+      report_button(state);
+      adv_state_set_button(state, batch_last_tick);
+    }
+    batch_edges = 0;
+  } else if (drained) {
+    // New edges: nothing else may wake the CPU when the pin has settled
+    sl_sleeptimer_restart_timer(&settle_timer, settle_ticks - (now - batch_last_tick),
+                                settle_cb, NULL, 0, 0);
+  }
+  edge_history_process();
+  dfu_process();
+  log_button_stats(now);
+  gpio_out_log_stats();
+  adv_state_log_stats();
 }
 
 /**************************************************************************//**
@@ -103,12 +203,21 @@ SL_WEAK void app_process_action(void)
 void sl_bt_on_event(sl_bt_msg_t *evt)
 {
   sl_status_t sc;
+  int phase;
+
+  edge_history_on_event(evt);
+  conn_profile_on_event(evt);
+  gpio_out_on_event(evt);
+  throughput_on_event(evt);
+  dfu_on_event(evt);
 
   switch (SL_BT_MSG_ID(evt->header)) {
     // -------------------------------
     // This event indicates the device has started and the radio is ready.
     // Do not call any stack command before receiving this boot event!
     case sl_bt_evt_system_boot_id:
+      boot_profile_mark("bt_stack_ready");
+      phase = boot_profile_begin("advertiser_start");
       // Create an advertising set.
       sc = sl_bt_advertiser_create_set(&advertising_set_handle);
       app_assert_status(sc);
@@ -117,19 +226,20 @@ void sl_bt_on_event(sl_bt_msg_t *evt)
       sc = sl_bt_legacy_advertiser_generate_data(advertising_set_handle,
                                                  sl_bt_advertiser_general_discoverable);
       app_assert_status(sc);
+      // Button/LED state record in place of the generated advertising packet
+      sc = adv_state_start(advertising_set_handle);
+      app_assert_status(sc);
 
-      // Set advertising interval to 100ms.
-      sc = sl_bt_advertiser_set_timing(
-        advertising_set_handle,
-        160, // min. adv. interval (milliseconds * 1.6)
-        160, // max. adv. interval (milliseconds * 1.6)
-        0,   // adv. duration
-        0);  // max. num. adv. events
+      // Advertising interval comes from the connection profile
+      // (100 ms for the default, balanced one).
+      sc = conn_profile_start(advertising_set_handle);
       app_assert_status(sc);
       // Start advertising and enable connections.
       sc = sl_bt_legacy_advertiser_start(advertising_set_handle,
                                          sl_bt_advertiser_connectable_scannable);
       app_assert_status(sc);
+      boot_profile_end(phase);
+      boot_profile_finish();
       break;
 
     // -------------------------------
@@ -144,6 +254,9 @@ void sl_bt_on_event(sl_bt_msg_t *evt)
       sc = sl_bt_legacy_advertiser_generate_data(advertising_set_handle,
                                                  sl_bt_advertiser_general_discoverable);
       app_assert_status(sc);
+      // Button/LED state record in place of the generated advertising packet
+      sc = adv_state_start(advertising_set_handle);
+      app_assert_status(sc);
 
       // Restart advertising after client has disconnected.
       sc = sl_bt_legacy_advertiser_start(advertising_set_handle,
@@ -155,16 +268,15 @@ void sl_bt_on_event(sl_bt_msg_t *evt)
     // Add additional event handlers here as your application requires!      //
     ///////////////////////////////////////////////////////////////////////////
     case sl_bt_evt_gatt_server_attribute_value_id:
-      if (gattdb_LED_IO == evt->data.evt_gatt_server_attribute_value.attribute) {
-        uint8_t recv_val;
-        size_t recv_len;
-        sl_bt_gatt_server_read_attribute_value(gattdb_LED_IO, 0, sizeof(recv_val), &recv_len, &recv_val);
-        GPIO_PinOutSet(gpioPortA, 4);
-        if (recv_val == 0) {
-          GPIO_PinOutClear(gpioPortA, 4);
-        }
+      if (gattdb_LED_IO == evt->data.evt_gatt_server_attribute_value.attribute
+          && evt->data.evt_gatt_server_attribute_value.value.len > 0) {
+        // The event carries the written value; no need to read it back
+        uint8_t recv_val = evt->data.evt_gatt_server_attribute_value.value.data[0];
+        gpio_out_set(0, recv_val ? 100 : 0);
         app_log("LED = %d\r\n", recv_val);
       }
+      // Either this or the outputs characteristic may have moved the LED
+      adv_state_set_led(gpio_out_get(0), sl_sleeptimer_get_tick_count());
       break;
 
     case sl_bt_evt_gatt_server_characteristic_status_id:
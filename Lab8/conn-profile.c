@@ -0,0 +1,155 @@
+/***************************************************************************//**
+ * @file
+ * @brief Low-latency / low-power connection and advertising profiles.
+ ******************************************************************************/
+#include "nvm3_default.h"
+#include "app_assert.h"
+#include "app_log.h"
+
+#include "gatt-service.h"
+#include "conn-profile.h"
+
+static const conn_profile_params_t profiles[CONN_PROFILE_COUNT] = {
+  // Supervision timeout must exceed (1 + latency) * max_interval * 2
+  [CONN_PROFILE_LOW_LATENCY] = { "low-latency", 32, 6, 8, 0, 100 },
+  [CONN_PROFILE_BALANCED]    = { "balanced", 160, 24, 40, 0, 400 },
+  [CONN_PROFILE_LOW_POWER]   = { "low-power", 1600, 400, 800, 4, 1200 },
+};
+
+static conn_profile_t current = CONN_PROFILE_BALANCED;
+static uint16_t profile_handle;
+static uint8_t advertising_set = 0xff;
+static uint8_t connections[CONN_PROFILE_MAX_CONNECTIONS];
+static int open_count = 0;
+
+conn_profile_t conn_profile_get(void)
+{
+  return current;
+}
+
+static sl_status_t apply(void)
+{
+  const conn_profile_params_t *p = &profiles[current];
+  uint8_t value = current;
+  sl_status_t sc;
+
+  sl_bt_gatt_server_write_attribute_value(profile_handle, 0, sizeof(value), &value);
+
+  // For connections opened from now on
+  sc = sl_bt_connection_set_default_parameters(p->min_interval, p->max_interval,
+                                               p->latency, p->timeout, 0, 0xffff);
+  if (sc != SL_STATUS_OK) {
+    return sc;
+  }
+
+  for (int i = 0; i < open_count; i++) {
+    sc = sl_bt_connection_set_parameters(connections[i], p->min_interval, p->max_interval,
+                                         p->latency, p->timeout, 0, 0xffff);
+    if (sc != SL_STATUS_OK) {
+      return sc;
+    }
+  }
+  if (advertising_set == 0xff) {
+    return SL_STATUS_OK;
+  }
+
+  // Advertising stops when a connection opens and picks the timing up when
+  // it is restarted; with no connection it is running, so restart it here.
+  if (open_count == 0) {
+    sl_bt_advertiser_stop(advertising_set);
+  }
+  sc = sl_bt_advertiser_set_timing(advertising_set, p->adv_interval, p->adv_interval, 0, 0);
+  if (sc != SL_STATUS_OK || open_count > 0) {
+    return sc;
+  }
+  return sl_bt_legacy_advertiser_start(advertising_set, sl_bt_advertiser_connectable_scannable);
+}
+
+sl_status_t conn_profile_start(uint8_t set)
+{
+  advertising_set = set;
+  return sl_bt_advertiser_set_timing(set, profiles[current].adv_interval,
+                                     profiles[current].adv_interval, 0, 0);
+}
+
+sl_status_t conn_profile_set(conn_profile_t profile)
+{
+  if (profile >= CONN_PROFILE_COUNT) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  current = profile;
+  uint8_t value = profile;
+  nvm3_writeData(nvm3_defaultHandle, CONN_PROFILE_NVM3_KEY, &value, sizeof(value));
+  app_log("Connection profile %s\r\n", profiles[profile].name);
+  return apply();
+}
+
+void conn_profile_on_event(sl_bt_msg_t *evt)
+{
+  sl_status_t sc;
+
+  switch (SL_BT_MSG_ID(evt->header)) {
+    case sl_bt_evt_system_boot_id: {
+      static const gatt_service_char_t chars[] = {
+        { GATT_SERVICE_UUID(CONN_PROFILE_UUID_PROFILE),
+          SL_BT_GATTDB_CHARACTERISTIC_READ | SL_BT_GATTDB_CHARACTERISTIC_WRITE,
+          0, 1, &profile_handle },
+      };
+      static const uint8_t service[] = GATT_SERVICE_UUID(CONN_PROFILE_UUID_SERVICE);
+      uint8_t saved;
+      sc = gatt_service_add(service, chars, sizeof(chars) / sizeof(chars[0]));
+      app_assert_status(sc);
+      if (nvm3_readData(nvm3_defaultHandle, CONN_PROFILE_NVM3_KEY, &saved, sizeof(saved)) == ECODE_NVM3_OK
+          && saved < CONN_PROFILE_COUNT) {
+        current = saved;
+      }
+      // Advertising is not set up yet; conn_profile_start() times it
+      sc = apply();
+      app_assert_status(sc);
+      break;
+    }
+
+    case sl_bt_evt_connection_opened_id:
+      if (open_count < CONN_PROFILE_MAX_CONNECTIONS) {
+        connections[open_count++] = evt->data.evt_connection_opened.connection;
+      }
+      break;
+
+    case sl_bt_evt_connection_closed_id:
+      for (int i = 0; i < open_count; i++) {
+        if (connections[i] == evt->data.evt_connection_closed.connection) {
+          connections[i] = connections[--open_count];
+          break;
+        }
+      }
+      break;
+
+    case sl_bt_evt_connection_parameters_id: {
+      // What the central granted, which may not be what was asked for
+      uint16_t interval = evt->data.evt_connection_parameters.interval;
+      const conn_profile_params_t *p = &profiles[current];
+      app_log("Connection %u: interval %u.%02u ms (asked %u.%02u-%u.%02u), latency %u, timeout %u ms, profile %s\r\n",
+              evt->data.evt_connection_parameters.connection,
+              interval * 125 / 100, interval * 125 % 100,
+              p->min_interval * 125 / 100, p->min_interval * 125 % 100,
+              p->max_interval * 125 / 100, p->max_interval * 125 % 100,
+              evt->data.evt_connection_parameters.latency,
+              evt->data.evt_connection_parameters.timeout * 10, p->name);
+      break;
+    }
+
+    case sl_bt_evt_gatt_server_attribute_value_id:
+      if (evt->data.evt_gatt_server_attribute_value.attribute == profile_handle
+          && evt->data.evt_gatt_server_attribute_value.value.len == 1) {
+        sc = conn_profile_set(evt->data.evt_gatt_server_attribute_value.value.data[0]);
+        if (sc != SL_STATUS_OK) {
+          app_log_warning("Connection profile not applied, sc=0x%lx\r\n", (unsigned long)sc);
+          apply(); // put the characteristic back to the profile in force
+        }
+      }
+      break;
+
+    default:
+      break;
+  }
+}
@@ -0,0 +1,272 @@
+/***************************************************************************//**
+ * @file
+ * @brief Button edge history characteristic.
+ ******************************************************************************/
+#include <stdbool.h>
+#include "em_gpio.h"
+#include "sl_sleeptimer.h"
+#include "app_assert.h"
+#include "app_log.h"
+
+#include "gatt-service.h"
+#include "edge-history.h"
+
+#define HEADER_LEN 6
+#define ATT_NOTIFY_OVERHEAD 3
+#define MAX_PAYLOAD (EDGE_HISTORY_MAX_MTU - ATT_NOTIFY_OVERHEAD)
+
+static uint16_t edges_handle;
+static uint8_t connection = 0xff;
+static uint16_t mtu = 23;
+static bool notify = false;
+
+// Edges waiting to be sent; pending[first] has index seq
+static edge_event_t pending[EDGE_HISTORY_MAX_PENDING];
+static uint32_t first = 0;
+static uint32_t count = 0;
+static uint16_t seq = 0;
+
+static uint32_t edges_sent = 0;
+static uint32_t notifications = 0;
+
+static uint32_t int_mask;
+static sl_sleeptimer_timer_handle_t wake_timer;
+static sl_sleeptimer_timer_handle_t burst_timer;
+static volatile uint32_t burst_left = 0;
+static volatile uint32_t burst_end_tick;
+static bool burst_running = false;
+static uint32_t burst_size;
+static uint32_t burst_interval_us;
+static uint32_t burst_sent_before;
+static uint32_t burst_notifications_before;
+
+void edge_history_init(uint32_t mask)
+{
+  int_mask = mask;
+}
+
+static uint32_t edges_per_notification(void)
+{
+  uint32_t payload = mtu - ATT_NOTIFY_OVERHEAD;
+  if (payload > MAX_PAYLOAD) {
+    payload = MAX_PAYLOAD;
+  }
+  return (payload - HEADER_LEN) / 2;
+}
+
+static void wake_cb(sl_sleeptimer_timer_handle_t *handle, void *data)
+{
+  (void)handle;
+  (void)data;
+  sl_bt_external_signal(EDGE_HISTORY_SIGNAL);
+}
+
+// Nothing else may wake the CPU when a wait runs out, so a timer does
+static void wake_after(uint32_t ticks)
+{
+  sl_sleeptimer_restart_timer(&wake_timer, ticks ? ticks : 1, wake_cb, NULL, 0, 0);
+}
+
+static void burst_cb(sl_sleeptimer_timer_handle_t *handle, void *data)
+{
+  (void)data;
+  // Goes through the real interrupt handler and ring, like a bouncing contact
+  GPIO_IntSet(int_mask);
+  if (--burst_left == 0) {
+    sl_sleeptimer_stop_timer(handle);
+    burst_end_tick = sl_sleeptimer_get_tick_count();
+  }
+}
+
+static void start_burst(const uint8_t *value, size_t len)
+{
+  if (len < 4 || burst_running) {
+    return;
+  }
+  uint32_t size = value[0] | (value[1] << 8);
+  uint32_t interval_us = value[2] | (value[3] << 8);
+  if (size == 0) {
+    return;
+  }
+  uint32_t ticks = (uint32_t)((uint64_t)interval_us * sl_sleeptimer_get_timer_frequency() / 1000000);
+  if (ticks == 0) {
+    ticks = 1;
+  }
+
+  burst_size = size;
+  burst_interval_us = interval_us;
+  burst_sent_before = edges_sent;
+  burst_notifications_before = notifications;
+  burst_left = size;
+  burst_running = true;
+  sl_status_t sc = sl_sleeptimer_start_periodic_timer(&burst_timer, ticks, burst_cb, NULL, 0, 0);
+  if (sc != SL_STATUS_OK) {
+    burst_running = false;
+    app_log_warning("Bounce burst not started, sc=0x%lx\r\n", (unsigned long)sc);
+  }
+}
+
+static void report_burst(void)
+{
+  if (!burst_running || burst_left > 0 || count > 0) {
+    return;
+  }
+  // Give the last edge time to reach the ring and go out
+  uint32_t waited = sl_sleeptimer_get_tick_count() - burst_end_tick;
+  uint32_t wait = 2 * sl_sleeptimer_ms_to_tick(EDGE_HISTORY_HOLD_MS);
+  if (waited < wait) {
+    wake_after(wait - waited);
+    return;
+  }
+  burst_running = false;
+
+  uint32_t delivered = edges_sent - burst_sent_before;
+  uint32_t sent = notifications - burst_notifications_before;
+  uint32_t lost = delivered < burst_size ? burst_size - delivered : 0;
+  app_log("Bounce burst: %lu edges %lu us apart, %lu delivered in %lu notifications "
+          "(%lu.%02lu per edge), %lu lost (%lu.%02lu%%)\r\n",
+          (unsigned long)burst_size, (unsigned long)burst_interval_us,
+          (unsigned long)delivered, (unsigned long)sent,
+          (unsigned long)(delivered ? sent / delivered : 0),
+          (unsigned long)(delivered ? sent * 100 / delivered % 100 : 0),
+          (unsigned long)lost, (unsigned long)(lost * 100 / burst_size),
+          (unsigned long)(lost * 10000 / burst_size % 100));
+}
+
+void edge_history_on_event(sl_bt_msg_t *evt)
+{
+  sl_status_t sc;
+
+  switch (SL_BT_MSG_ID(evt->header)) {
+    case sl_bt_evt_system_boot_id: {
+      static const gatt_service_char_t chars[] = {
+        { GATT_SERVICE_UUID(EDGE_HISTORY_UUID_EDGES),
+          SL_BT_GATTDB_CHARACTERISTIC_NOTIFY | SL_BT_GATTDB_CHARACTERISTIC_WRITE,
+          0, MAX_PAYLOAD, &edges_handle },
+      };
+      static const uint8_t service[] = GATT_SERVICE_UUID(EDGE_HISTORY_UUID_SERVICE);
+      uint16_t max_mtu;
+      sc = gatt_service_add(service, chars, sizeof(chars) / sizeof(chars[0]));
+      app_assert_status(sc);
+      sc = sl_bt_gatt_server_set_max_mtu(EDGE_HISTORY_MAX_MTU, &max_mtu);
+      app_assert_status(sc);
+      break;
+    }
+
+    case sl_bt_evt_connection_closed_id:
+      if (evt->data.evt_connection_closed.connection == connection) {
+        connection = 0xff;
+        notify = false;
+        seq += count;
+        count = 0;
+      }
+      break;
+
+    case sl_bt_evt_gatt_mtu_exchanged_id:
+      if (evt->data.evt_gatt_mtu_exchanged.connection == connection) {
+        mtu = evt->data.evt_gatt_mtu_exchanged.mtu;
+        app_log("ATT MTU %u: %lu edges per history notification\r\n",
+                mtu, (unsigned long)edges_per_notification());
+      }
+      break;
+
+    case sl_bt_evt_gatt_server_characteristic_status_id:
+      if (evt->data.evt_gatt_server_characteristic_status.characteristic != edges_handle
+          || evt->data.evt_gatt_server_characteristic_status.status_flags
+          != sl_bt_gatt_server_client_config) {
+        break;
+      }
+      // One subscriber at a time: the latest connection to enable it
+      if (evt->data.evt_gatt_server_characteristic_status.client_config_flags
+          & sl_bt_gatt_notification) {
+        connection = evt->data.evt_gatt_server_characteristic_status.connection;
+        notify = true;
+        if (sl_bt_gatt_server_get_mtu(connection, &mtu) != SL_STATUS_OK) {
+          mtu = 23;
+        }
+      } else if (evt->data.evt_gatt_server_characteristic_status.connection == connection) {
+        connection = 0xff;
+        notify = false;
+      }
+      break;
+
+    case sl_bt_evt_gatt_server_attribute_value_id:
+      if (evt->data.evt_gatt_server_attribute_value.attribute == edges_handle) {
+        start_burst(evt->data.evt_gatt_server_attribute_value.value.data,
+                    evt->data.evt_gatt_server_attribute_value.value.len);
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+void edge_history_add(const edge_event_t *ev)
+{
+  if (!notify) {
+    seq++; // nobody to tell; keep the index counting edges
+    return;
+  }
+  if (count == EDGE_HISTORY_MAX_PENDING) {
+    // Drop the oldest so what is queued stays contiguous behind seq
+    first = (first + 1) % EDGE_HISTORY_MAX_PENDING;
+    count--;
+    seq++;
+  }
+  pending[(first + count) % EDGE_HISTORY_MAX_PENDING] = *ev;
+  count++;
+}
+
+static size_t pack(uint8_t *buf, uint32_t n)
+{
+  const edge_event_t *ev = &pending[first];
+  uint32_t prev = ev->tick;
+  buf[0] = seq & 0xff;
+  buf[1] = seq >> 8;
+  buf[2] = prev & 0xff;
+  buf[3] = (prev >> 8) & 0xff;
+  buf[4] = (prev >> 16) & 0xff;
+  buf[5] = prev >> 24;
+
+  size_t len = HEADER_LEN;
+  for (uint32_t i = 0; i < n; i++) {
+    ev = &pending[(first + i) % EDGE_HISTORY_MAX_PENDING];
+    uint32_t delta = ev->tick - prev;
+    uint16_t word = (delta > 0x7fff ? 0x7fff : delta) | (ev->state ? 0x8000 : 0);
+    prev = ev->tick;
+    buf[len++] = word & 0xff;
+    buf[len++] = word >> 8;
+  }
+  return len;
+}
+
+void edge_history_process(void)
+{
+  uint8_t buf[MAX_PAYLOAD];
+
+  while (count > 0 && notify && connection != 0xff) {
+    uint32_t n = edges_per_notification();
+    if (count < n) {
+      uint32_t held = sl_sleeptimer_get_tick_count() - pending[first].tick;
+      uint32_t hold = sl_sleeptimer_ms_to_tick(EDGE_HISTORY_HOLD_MS);
+      if (held < hold) {
+        wake_after(hold - held);
+        break; // more of the burst may be on its way
+      }
+      n = count;
+    }
+
+    size_t len = pack(buf, n);
+    if (sl_bt_gatt_server_send_notification(connection, edges_handle, len, buf) != SL_STATUS_OK) {
+      break; // no buffers in the stack; retry on the next pass
+    }
+    first = (first + n) % EDGE_HISTORY_MAX_PENDING;
+    count -= n;
+    seq += n;
+    edges_sent += n;
+    notifications++;
+  }
+
+  report_burst();
+}
@@ -0,0 +1,81 @@
+/***************************************************************************//**
+ * @file
+ * @brief Custom GATT services added to the dynamic database at boot.
+ ******************************************************************************/
+#include <string.h>
+#include "sl_bluetooth.h"
+
+#include "gatt-service.h"
+
+static uint32_t fingerprint = 2166136261u; // FNV-1a offset basis
+
+static void hash(const void *data, size_t len)
+{
+  const uint8_t *p = data;
+  for (size_t i = 0; i < len; i++) {
+    fingerprint = (fingerprint ^ p[i]) * 16777619u;
+  }
+}
+
+static sl_status_t add_in_session(uint16_t session, const uint8_t uuid[16],
+                                  const gatt_service_char_t *chars, size_t num_chars)
+{
+  uint16_t service;
+  sl_status_t sc = sl_bt_gattdb_add_service(session, sl_bt_gattdb_primary_service,
+                                            0, 16, uuid, &service);
+  if (sc != SL_STATUS_OK) {
+    return sc;
+  }
+
+  for (size_t i = 0; i < num_chars; i++) {
+    uuid_128 char_uuid;
+    memcpy(char_uuid.data, chars[i].uuid, sizeof(char_uuid.data));
+    sc = sl_bt_gattdb_add_uuid128_characteristic(session, service, chars[i].properties,
+                                                  chars[i].security, 0, char_uuid,
+                                                  sl_bt_gattdb_variable_length_value,
+                                                  chars[i].maxlen, 0, NULL,
+                                                  chars[i].handle);
+    if (sc != SL_STATUS_OK) {
+      return sc;
+    }
+    sc = sl_bt_gattdb_start_characteristic(session, *chars[i].handle);
+    if (sc != SL_STATUS_OK) {
+      return sc;
+    }
+  }
+
+  sc = sl_bt_gattdb_start_service(session, service);
+  if (sc != SL_STATUS_OK) {
+    return sc;
+  }
+  return sl_bt_gattdb_commit(session);
+}
+
+sl_status_t gatt_service_add(const uint8_t uuid[16],
+                             const gatt_service_char_t *chars, size_t num_chars)
+{
+  uint16_t session;
+  sl_status_t sc = sl_bt_gattdb_new_session(&session);
+  if (sc != SL_STATUS_OK) {
+    return sc;
+  }
+  sc = add_in_session(session, uuid, chars, num_chars);
+  if (sc != SL_STATUS_OK) {
+    sl_bt_gattdb_abort(session);
+    return sc;
+  }
+
+  hash(uuid, 16);
+  for (size_t i = 0; i < num_chars; i++) {
+    hash(chars[i].uuid, sizeof(chars[i].uuid));
+    hash(&chars[i].properties, sizeof(chars[i].properties));
+    hash(&chars[i].security, sizeof(chars[i].security));
+    hash(&chars[i].maxlen, sizeof(chars[i].maxlen));
+  }
+  return sc;
+}
+
+uint32_t gatt_service_fingerprint(void)
+{
+  return fingerprint;
+}
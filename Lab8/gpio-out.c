@@ -0,0 +1,180 @@
+/***************************************************************************//**
+ * @file
+ * @brief Several output pins set from one GATT write.
+ ******************************************************************************/
+#include "em_cmu.h"
+#include "em_gpio.h"
+#include "em_timer.h"
+#include "sl_sleeptimer.h"
+#include "app_assert.h"
+#include "app_log.h"
+
+#include "gatt-service.h"
+#include "gpio-out.h"
+
+typedef struct {
+  GPIO_Port_TypeDef port;
+  uint8_t pin;
+} gpio_out_pin_t;
+
+// LED first, then free pins on the expansion header
+static const gpio_out_pin_t pins[GPIO_OUT_COUNT] = {
+  { gpioPortA, 4 },
+  { gpioPortB, 0 },
+  { gpioPortB, 1 },
+  { gpioPortD, 2 },
+};
+
+static uint16_t outputs_handle;
+static uint32_t pwm_top;
+static uint8_t levels[GPIO_OUT_COUNT];
+
+static uint32_t writes = 0;       // with response
+static uint32_t commands = 0;     // write without response
+static uint32_t malformed = 0;
+static uint32_t stats_tick = 0;
+
+void gpio_out_init(void)
+{
+  CMU_ClockEnable(cmuClock_GPIO, true);
+  CMU_ClockEnable(cmuClock_TIMER0, true);
+
+  for (int i = 0; i < GPIO_OUT_COUNT; i++) {
+    GPIO_PinModeSet(pins[i].port, pins[i].pin, gpioModePushPull, 0);
+  }
+
+  TIMER_InitCC_TypeDef cc = TIMER_INITCC_DEFAULT;
+  cc.mode = timerCCModePWM;
+  for (int ch = 0; ch < GPIO_OUT_PWM_CHANNELS; ch++) {
+    TIMER_InitCC(TIMER0, ch, &cc);
+  }
+  GPIO->TIMERROUTE[0].CC0ROUTE = (pins[0].port << _GPIO_TIMER_CC0ROUTE_PORT_SHIFT)
+                                 | (pins[0].pin << _GPIO_TIMER_CC0ROUTE_PIN_SHIFT);
+  GPIO->TIMERROUTE[0].CC1ROUTE = (pins[1].port << _GPIO_TIMER_CC1ROUTE_PORT_SHIFT)
+                                 | (pins[1].pin << _GPIO_TIMER_CC1ROUTE_PIN_SHIFT);
+  GPIO->TIMERROUTE[0].CC2ROUTE = (pins[2].port << _GPIO_TIMER_CC2ROUTE_PORT_SHIFT)
+                                 | (pins[2].pin << _GPIO_TIMER_CC2ROUTE_PIN_SHIFT);
+
+  TIMER_Init_TypeDef init = TIMER_INIT_DEFAULT;
+  init.enable = false;
+  TIMER_Init(TIMER0, &init);
+  pwm_top = CMU_ClockFreqGet(cmuClock_TIMER0) / GPIO_OUT_PWM_FREQ_HZ - 1;
+  TIMER_TopSet(TIMER0, pwm_top);
+  for (int ch = 0; ch < GPIO_OUT_PWM_CHANNELS; ch++) {
+    TIMER_CompareSet(TIMER0, ch, 0);
+  }
+  TIMER_Enable(TIMER0, true);
+}
+
+void gpio_out_set(uint8_t index, uint8_t level)
+{
+  if (index >= GPIO_OUT_COUNT) {
+    return;
+  }
+  if (level > 100) {
+    level = 100;
+  }
+  levels[index] = level;
+
+  if (index < GPIO_OUT_PWM_CHANNELS) {
+    // Full on and off are plain GPIO; the timer only drives the pin in between
+    uint32_t en = GPIO_TIMER_ROUTEEN_CC0PEN << index;
+    if (level == 0 || level == 100) {
+      GPIO->TIMERROUTE[0].ROUTEEN &= ~en;
+    } else {
+      // Perceived brightness is roughly quadratic in duty
+      TIMER_CompareBufSet(TIMER0, index, (pwm_top + 1) * level * level / 10000);
+      GPIO->TIMERROUTE[0].ROUTEEN |= en;
+      return;
+    }
+  }
+  if (level > 0) {
+    GPIO_PinOutSet(pins[index].port, pins[index].pin);
+  } else {
+    GPIO_PinOutClear(pins[index].port, pins[index].pin);
+  }
+}
+
+uint8_t gpio_out_get(uint8_t index)
+{
+  return index < GPIO_OUT_COUNT ? levels[index] : 0;
+}
+
+bool gpio_out_apply(const uint8_t *value, size_t len)
+{
+  if (len < 1 || (value[0] >> GPIO_OUT_COUNT) != 0) {
+    return false;
+  }
+  size_t k = 0;
+  for (int i = 0; i < GPIO_OUT_COUNT; i++) {
+    k += (value[0] >> i) & 1;
+  }
+  if (len != 1 + k) {
+    return false;
+  }
+
+  const uint8_t *level = value + 1;
+  for (uint8_t i = 0; i < GPIO_OUT_COUNT; i++) {
+    if (value[0] & (1 << i)) {
+      gpio_out_set(i, *level++);
+    }
+  }
+  return true;
+}
+
+void gpio_out_log_stats(void)
+{
+  uint32_t now = sl_sleeptimer_get_tick_count();
+  uint32_t elapsed = now - stats_tick;
+  if (elapsed < sl_sleeptimer_ms_to_tick(GPIO_OUT_STATS_INTERVAL_MS)) {
+    return;
+  }
+  stats_tick = now;
+  if (writes + commands + malformed == 0) {
+    return;
+  }
+
+  // One line per interval; a line per write would cap the rate at the UART's
+  uint32_t ms = sl_sleeptimer_tick_to_ms(elapsed);
+  app_log("Outputs: %lu updates/s (%lu without response, %lu with), %lu malformed\r\n",
+          (unsigned long)((writes + commands) * 1000 / ms), (unsigned long)commands,
+          (unsigned long)writes, (unsigned long)malformed);
+  writes = 0;
+  commands = 0;
+  malformed = 0;
+}
+
+void gpio_out_on_event(sl_bt_msg_t *evt)
+{
+  switch (SL_BT_MSG_ID(evt->header)) {
+    case sl_bt_evt_system_boot_id: {
+      static const gatt_service_char_t chars[] = {
+        { GATT_SERVICE_UUID(GPIO_OUT_UUID_OUTPUTS),
+          SL_BT_GATTDB_CHARACTERISTIC_READ | SL_BT_GATTDB_CHARACTERISTIC_WRITE
+          | SL_BT_GATTDB_CHARACTERISTIC_WRITE_NO_RESPONSE,
+          0, 1 + GPIO_OUT_COUNT, &outputs_handle },
+      };
+      static const uint8_t service[] = GATT_SERVICE_UUID(GPIO_OUT_UUID_SERVICE);
+      sl_status_t sc = gatt_service_add(service, chars, sizeof(chars) / sizeof(chars[0]));
+      app_assert_status(sc);
+      break;
+    }
+
+    case sl_bt_evt_gatt_server_attribute_value_id:
+      if (evt->data.evt_gatt_server_attribute_value.attribute == outputs_handle) {
+        // The event carries the written bytes; no need to read them back
+        if (!gpio_out_apply(evt->data.evt_gatt_server_attribute_value.value.data,
+                            evt->data.evt_gatt_server_attribute_value.value.len)) {
+          malformed++;
+        } else if (evt->data.evt_gatt_server_attribute_value.att_opcode == sl_bt_gatt_write_command) {
+          commands++;
+        } else {
+          writes++;
+        }
+      }
+      break;
+
+    default:
+      break;
+  }
+}
@@ -0,0 +1,292 @@
+/***************************************************************************//**
+ * @file
+ * @brief GATT throughput benchmark.
+ ******************************************************************************/
+#include <string.h>
+#include "sl_sleeptimer.h"
+#include "app_assert.h"
+#include "app_log.h"
+
+#include "gatt-service.h"
+#include "throughput.h"
+
+#define RESULT_LEN 20
+#define MAX_HANDLE 8 // connection handles start at 1
+
+static uint16_t control_handle;
+static uint16_t stream_handle;
+static uint16_t result_handle;
+
+static uint8_t connection = 0xff;   // the one subscribed to the stream
+static bool subscribed = false;      // stream notifications enabled by connection
+static bool result_subscribed = false;
+static uint16_t intervals[MAX_HANDLE + 1]; // per connection, units of 1.25 ms
+static uint16_t interval = 0;               // of the benchmark connection
+static bool running = false;
+static bool awaiting_stats = false;
+
+static uint16_t payload_len;
+static uint32_t duration_ticks;
+static uint32_t start_tick;
+static uint32_t stop_tick;
+static uint32_t seq;
+static uint32_t bytes;
+static uint32_t packets;
+static uint32_t stalls;
+static bool stalled;
+static sl_sleeptimer_timer_handle_t retry_timer;
+
+static void put16(uint8_t *p, uint16_t v)
+{
+  p[0] = v & 0xff;
+  p[1] = v >> 8;
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+  put16(p, v & 0xffff);
+  put16(p + 2, v >> 16);
+}
+
+static void publish(uint32_t events, uint32_t crc_errors)
+{
+  uint32_t ms = sl_sleeptimer_tick_to_ms(stop_tick - start_tick);
+  uint32_t rate = ms ? (uint32_t)((uint64_t)bytes * 1000 / ms) : 0;
+  if (events == 0 && interval != 0) {
+    // No link statistics: estimate the events from the interval
+    events = ms * 100 / (interval * 125);
+  }
+  uint32_t per_event_x100 = events ? packets * 100 / events : 0;
+
+  uint8_t result[RESULT_LEN];
+  put32(result, bytes);
+  put32(result + 4, ms);
+  put32(result + 8, rate);
+  put16(result + 12, per_event_x100 > 0xffff ? 0xffff : per_event_x100);
+  put16(result + 14, stalls > 0xffff ? 0xffff : stalls);
+  put16(result + 16, crc_errors > 0xffff ? 0xffff : crc_errors);
+  put16(result + 18, interval);
+  sl_bt_gatt_server_write_attribute_value(result_handle, 0, sizeof(result), result);
+  if (result_subscribed && connection != 0xff) {
+    sl_bt_gatt_server_send_notification(connection, result_handle, sizeof(result), result);
+  }
+
+  app_log("Throughput: %lu bytes in %lu ms = %lu B/s, %lu packets of %u B, "
+          "%lu.%02lu per connection event (interval %u.%02u ms), %lu stalls, %lu CRC errors\r\n",
+          (unsigned long)bytes, (unsigned long)ms, (unsigned long)rate,
+          (unsigned long)packets, payload_len,
+          (unsigned long)(per_event_x100 / 100), (unsigned long)(per_event_x100 % 100),
+          interval * 125 / 100, interval * 125 % 100,
+          (unsigned long)stalls, (unsigned long)crc_errors);
+}
+
+static void stop(void)
+{
+  if (!running) {
+    return;
+  }
+  running = false;
+  sl_sleeptimer_stop_timer(&retry_timer);
+  stop_tick = sl_sleeptimer_get_tick_count();
+  // Real connection event and CRC counts arrive in connection_statistics
+  if (connection != 0xff && sl_bt_connection_read_statistics(connection, 0) == SL_STATUS_OK) {
+    awaiting_stats = true;
+  } else {
+    publish(0, 0);
+  }
+}
+
+static void retry_cb(sl_sleeptimer_timer_handle_t *handle, void *data)
+{
+  (void)handle;
+  (void)data;
+  sl_bt_external_signal(THROUGHPUT_SIGNAL);
+}
+
+static void fill(void)
+{
+  uint8_t buf[THROUGHPUT_MAX_PAYLOAD];
+
+  if (!running) {
+    return;
+  }
+  if (duration_ticks != 0 && sl_sleeptimer_get_tick_count() - start_tick >= duration_ticks) {
+    stop();
+    return;
+  }
+
+  for (int i = 0; i < THROUGHPUT_BURST; i++) {
+    put32(buf, seq);
+    memset(buf + 4, (uint8_t)seq, payload_len - 4);
+    sl_status_t sc = sl_bt_gatt_server_send_notification(connection, stream_handle, payload_len, buf);
+    if (sc == SL_STATUS_NO_MORE_RESOURCE) {
+      // Count each time the queue fills up, not every retry while it is full
+      if (!stalled) {
+        stalls++;
+        stalled = true;
+      }
+      // Buffers only free up at a connection event; look again shortly
+      // rather than raising the signal straight away and spinning on it
+      sl_sleeptimer_restart_timer_ms(&retry_timer, THROUGHPUT_RETRY_MS, retry_cb, NULL, 0, 0);
+      return;
+    }
+    if (sc != SL_STATUS_OK) {
+      app_log_warning("Throughput stream stopped, sc=0x%lx\r\n", (unsigned long)sc);
+      stop();
+      return;
+    }
+    stalled = false;
+    seq++;
+    packets++;
+    bytes += payload_len;
+  }
+  sl_bt_external_signal(THROUGHPUT_SIGNAL);
+}
+
+static void start(uint8_t conn, const uint8_t *value, size_t len)
+{
+  uint16_t mtu = 23;
+  uint16_t asked = len >= 3 ? value[1] | (value[2] << 8) : 0;
+  uint16_t ms = len >= 5 ? value[3] | (value[4] << 8) : 0;
+  uint8_t phy = len >= 6 ? value[5] : 0;
+
+  if (running || awaiting_stats) {
+    return;
+  }
+  if (conn != connection || !subscribed) {
+    app_log_warning("Throughput: subscribe to the stream before starting\r\n");
+    return;
+  }
+  sl_bt_gatt_server_get_mtu(conn, &mtu);
+  payload_len = mtu - 3;
+  if (payload_len > THROUGHPUT_MAX_PAYLOAD) {
+    payload_len = THROUGHPUT_MAX_PAYLOAD;
+  }
+  if (asked >= 4 && asked < payload_len) {
+    payload_len = asked;
+  }
+  if (phy != 0) {
+    sl_bt_connection_set_preferred_phy(conn, phy, 0xff);
+  }
+
+  // Reset the link counters so the run has its own
+  sl_bt_connection_read_statistics(conn, 1);
+  duration_ticks = ms ? sl_sleeptimer_ms_to_tick(ms) : 0;
+  seq = 0;
+  bytes = 0;
+  packets = 0;
+  stalls = 0;
+  stalled = false;
+  running = true;
+  start_tick = sl_sleeptimer_get_tick_count();
+  app_log("Throughput: start, %u B notifications, MTU %u\r\n", payload_len, mtu);
+  fill();
+}
+
+void throughput_on_event(sl_bt_msg_t *evt)
+{
+  switch (SL_BT_MSG_ID(evt->header)) {
+    case sl_bt_evt_system_boot_id: {
+      static const gatt_service_char_t chars[] = {
+        { GATT_SERVICE_UUID(THROUGHPUT_UUID_CONTROL),
+          SL_BT_GATTDB_CHARACTERISTIC_WRITE, 0, 6, &control_handle },
+        { GATT_SERVICE_UUID(THROUGHPUT_UUID_STREAM),
+          SL_BT_GATTDB_CHARACTERISTIC_NOTIFY, 0, THROUGHPUT_MAX_PAYLOAD, &stream_handle },
+        { GATT_SERVICE_UUID(THROUGHPUT_UUID_RESULT),
+          SL_BT_GATTDB_CHARACTERISTIC_READ | SL_BT_GATTDB_CHARACTERISTIC_NOTIFY,
+          0, RESULT_LEN, &result_handle },
+      };
+      static const uint8_t service[] = GATT_SERVICE_UUID(THROUGHPUT_UUID_SERVICE);
+      sl_status_t sc = gatt_service_add(service, chars, sizeof(chars) / sizeof(chars[0]));
+      app_assert_status(sc);
+      break;
+    }
+
+    case sl_bt_evt_system_external_signal_id:
+      if (evt->data.evt_system_external_signal.extsignals & THROUGHPUT_SIGNAL) {
+        fill();
+      }
+      break;
+
+    case sl_bt_evt_connection_closed_id:
+      if (evt->data.evt_connection_closed.connection == connection) {
+        stop();
+        connection = 0xff;
+        subscribed = false;
+        result_subscribed = false;
+        if (awaiting_stats) {
+          awaiting_stats = false;
+          publish(0, 0);
+        }
+      }
+      break;
+
+    case sl_bt_evt_connection_parameters_id:
+      if (evt->data.evt_connection_parameters.connection <= MAX_HANDLE) {
+        intervals[evt->data.evt_connection_parameters.connection] =
+          evt->data.evt_connection_parameters.interval;
+      }
+      if (evt->data.evt_connection_parameters.connection == connection) {
+        interval = evt->data.evt_connection_parameters.interval;
+      }
+      break;
+
+    case sl_bt_evt_connection_phy_status_id:
+      if (evt->data.evt_connection_phy_status.connection == connection) {
+        app_log("Throughput: PHY %u\r\n", evt->data.evt_connection_phy_status.phy);
+      }
+      break;
+
+    case sl_bt_evt_connection_statistics_id:
+      if (awaiting_stats && evt->data.evt_connection_statistics.connection == connection) {
+        awaiting_stats = false;
+        publish(evt->data.evt_connection_statistics.num_total_connection_events,
+                evt->data.evt_connection_statistics.num_crc_errors);
+      }
+      break;
+
+    case sl_bt_evt_gatt_server_characteristic_status_id: {
+      uint16_t characteristic = evt->data.evt_gatt_server_characteristic_status.characteristic;
+      bool on = evt->data.evt_gatt_server_characteristic_status.client_config_flags
+                & sl_bt_gatt_notification;
+      if (evt->data.evt_gatt_server_characteristic_status.status_flags != sl_bt_gatt_server_client_config
+          || (characteristic != stream_handle && characteristic != result_handle)) {
+        break;
+      }
+      if (connection != evt->data.evt_gatt_server_characteristic_status.connection) {
+        if (!on || running || awaiting_stats) {
+          break; // one benchmark connection at a time
+        }
+        connection = evt->data.evt_gatt_server_characteristic_status.connection;
+        subscribed = false;
+        result_subscribed = false;
+        interval = connection <= MAX_HANDLE ? intervals[connection] : 0;
+      }
+      if (characteristic == stream_handle) {
+        subscribed = on;
+        if (!on) {
+          stop();
+        }
+      } else {
+        result_subscribed = on;
+      }
+      break;
+    }
+
+    case sl_bt_evt_gatt_server_attribute_value_id:
+      if (evt->data.evt_gatt_server_attribute_value.attribute == control_handle
+          && evt->data.evt_gatt_server_attribute_value.value.len >= 1) {
+        if (evt->data.evt_gatt_server_attribute_value.value.data[0] == 1) {
+          start(evt->data.evt_gatt_server_attribute_value.connection,
+                evt->data.evt_gatt_server_attribute_value.value.data,
+                evt->data.evt_gatt_server_attribute_value.value.len);
+        } else {
+          stop();
+        }
+      }
+      break;
+
+    default:
+      break;
+  }
+}
@@ -0,0 +1,40 @@
+/***************************************************************************//**
+ * @file
+ * @brief GATT throughput benchmark.
+ *
+ * Control (write):  u8 command       1 = start, 0 = stop
+ *                   u16 payload_len  0 = fill the ATT MTU
+ *                   u16 duration_ms  0 = until stopped
+ *                   u8 phy           0 = leave, else sl_bt_gap_phy_* to prefer
+ *                   (all but command are optional)
+ * Stream (notify):  u32 sequence number, then filler; subscribe before start
+ * Result (read, notify), after each run:
+ *                   u32 bytes, u32 duration_ms, u32 bytes_per_s,
+ *                   u16 packets per connection event x 100,
+ *                   u16 stalls (stack out of buffers), u16 CRC errors
+ *                   (each one a link-layer retry), u16 interval (1.25 ms)
+ *
+ * All little-endian. Runs entirely from sl_bt_on_event(): sending continues
+ * on an external signal the module raises for itself after each burst, so
+ * other stack events get a turn in between. While the stack is out of
+ * buffers the signal comes from a THROUGHPUT_RETRY_MS timer instead.
+ ******************************************************************************/
+#ifndef THROUGHPUT_H
+#define THROUGHPUT_H
+
+#include "sl_bluetooth.h"
+
+#define THROUGHPUT_UUID_SERVICE 0x0400
+#define THROUGHPUT_UUID_CONTROL 0x0401
+#define THROUGHPUT_UUID_STREAM  0x0402
+#define THROUGHPUT_UUID_RESULT  0x0403
+
+#define THROUGHPUT_SIGNAL       (1UL << 0) // sl_bt_external_signal() bit
+#define THROUGHPUT_BURST        8          // notifications per signal
+#define THROUGHPUT_MAX_PAYLOAD  244        // 247-byte MTU less the ATT header
+#define THROUGHPUT_RETRY_MS     2          // after a stall; under the 7.5 ms shortest interval
+
+// Feed every Bluetooth event through here, from sl_bt_on_event().
+void throughput_on_event(sl_bt_msg_t *evt);
+
+#endif // THROUGHPUT_H
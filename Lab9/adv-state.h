@@ -0,0 +1,43 @@
+/***************************************************************************//**
+ * @file
+ * @brief Button and LED state broadcast in the advertising data.
+ *
+ * Any number of scanners can follow the state without connecting. The
+ * advertising packet carries flags and one manufacturer-specific AD
+ * structure, all little-endian:
+ *
+ *   u16 company     ADV_STATE_COMPANY_ID
+ *   u8  format      ADV_STATE_FORMAT
+ *   u8  state       bit 0 = button, bit 1 = LED on
+ *   u8  led         LED level, 0..100 %
+ *   u16 counter     bumped on every change
+ *   u32 refresh_ms  device time the packet was updated
+ *   u16 delay_us    from the change to that update (saturates)
+ *
+ * The device name stays in the scan response.
+ ******************************************************************************/
+#ifndef ADV_STATE_H
+#define ADV_STATE_H
+
+#include <stdint.h>
+#include "sl_status.h"
+
+#define ADV_STATE_COMPANY_ID        0xffff // none assigned: for testing only
+#define ADV_STATE_FORMAT            1
+#define ADV_STATE_STATS_INTERVAL_MS 10000
+
+/**************************************************************************//**
+ * Put the state record in the advertising packet of advertising_set. Call
+ * after every sl_bt_legacy_advertiser_generate_data(), which replaces it.
+ *****************************************************************************/
+sl_status_t adv_state_start(uint8_t advertising_set);
+
+// Report a change seen at event_tick (sl_sleeptimer ticks); the packet is
+// rewritten straight away. Values equal to the advertised ones are ignored.
+void adv_state_set_button(uint8_t state, uint32_t event_tick);
+void adv_state_set_led(uint8_t level, uint32_t event_tick);
+
+// Log the change-to-advertisement delays, from app_process_action().
+void adv_state_log_stats(void);
+
+#endif // ADV_STATE_H
@@ -0,0 +1,102 @@
+"""Follow the button/LED state the boards broadcast in their advertising data.
+
+No connection is made, so any number of these can run at once. Each time a
+board's counter moves, prints the new state and two delays:
+
+  change->packet   measured on the board (delay_us in the packet)
+  packet->seen     host receive time minus the board's refresh_ms, relative
+                   to the fastest one seen so far (the two clocks are not
+                   synchronised, so the minimum stands in for zero)
+
+A counter that jumps by more than one means changes came and went between
+two packets this scanner caught. Works for Lab8 and Lab9 (see adv-state.h).
+
+    pip install bleak
+    python adv_scan.py [--seconds 60] [--address AA:BB:...]
+"""
+import argparse
+import asyncio
+import statistics
+import struct
+import time
+
+from bleak import BleakScanner
+
+COMPANY_ID = 0xFFFF
+FORMAT = 1
+
+
+class Board:
+    def __init__(self):
+        self.counter = None
+        self.min_offset = None
+        self.seen = []     # packet->seen, ms, relative to min_offset at the time
+        self.delays = []   # change->packet, us
+        self.updates = 0
+        self.skipped = 0
+
+
+def parse(payload):
+    if len(payload) < 11 or payload[0] != FORMAT:
+        return None
+    _, state, led, counter, refresh_ms, delay_us = struct.unpack_from("<BBBHIH", payload)
+    return state & 1, led, counter, refresh_ms, delay_us
+
+
+def percentile(values, p):
+    values = sorted(values)
+    return values[int(p * (len(values) - 1))]
+
+
+async def main(args):
+    boards = {}
+
+    def on_advertisement(device, adv):
+        rx_ms = time.monotonic() * 1000
+        if args.address and device.address.upper() != args.address.upper():
+            return
+        payload = adv.manufacturer_data.get(COMPANY_ID)
+        fields = parse(payload) if payload else None
+        if fields is None:
+            return
+        button, led, counter, refresh_ms, delay_us = fields
+
+        board = boards.setdefault(device.address, Board())
+        if board.counter == counter:
+            return  # same packet again
+        offset = rx_ms - refresh_ms
+        if board.min_offset is None or offset < board.min_offset:
+            board.min_offset = offset
+        if board.counter is not None:
+            step = (counter - board.counter) & 0xFFFF
+            board.skipped += step - 1
+            board.updates += 1
+            board.seen.append(offset - board.min_offset)
+            board.delays.append(delay_us)
+            print(f"{device.address} #{counter}: button {button}, LED {led}%, "
+                  f"change->packet {delay_us} us, packet->seen {offset - board.min_offset:.1f} ms"
+                  + (f", {step - 1} change(s) not seen" if step > 1 else ""))
+        board.counter = counter
+
+    scanner = BleakScanner(detection_callback=on_advertisement)
+    await scanner.start()
+    try:
+        await asyncio.sleep(args.seconds)
+    finally:
+        await scanner.stop()
+
+    for address, board in boards.items():
+        if not board.seen:
+            print(f"{address}: no changes seen")
+            continue
+        print(f"{address}: {board.updates} updates, {board.skipped} changes not seen; "
+              f"change->packet p50 {statistics.median(board.delays):.0f} us, "
+              f"packet->seen p50 {statistics.median(board.seen):.1f} ms, "
+              f"p99 {percentile(board.seen, 0.99):.1f} ms")
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--seconds", type=float, default=60)
+    parser.add_argument("--address", help="only this board")
+    asyncio.run(main(parser.parse_args()))
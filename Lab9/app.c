@@ -36,49 +36,117 @@
 
 #include "em_cmu.h"
 #include "em_gpio.h"
+#include "sl_sleeptimer.h"
+#include "boot-profile.h"
+#include "edge-ring.h"
+#include "edge-history.h"
+#include "conn-profile.h"
+#include "gpio-out.h"
+#include "adv-state.h"
+#include "throughput.h"
+#include "dfu.h"
+#include "conn-table.h"
+#include "reconnect.h"
 
 // Use the GATT database handles
 #define LED_CHAR_HANDLE    gattdb_LED_IO     // Assuming gattdb_LED_IO is the handle for LED characteristic from gatt_db.h
 #define BUTTON_CHAR_HANDLE gattdb_BUTTON_IO  // Assuming gattdb_BUTTON_IO is the handle for BUTTON characteristic from gatt_db.h
 
-#define GPIO_PORT_LED     gpioPortA
-#define GPIO_PIN_LED      4
 #define GPIO_PORT_BUTTON  gpioPortC
 #define GPIO_PIN_BUTTON   7
 #define BUTTON_IRQn       GPIO_ODD_IRQn // Assuming PC7 uses ODD IRQ Handler
 
-static bool button_io_notification_enabled = false;
+// A burst of edges is reported once the pin has been quiet this long
+#define BUTTON_SETTLE_MS          5
+#define BUTTON_SETTLE_SIGNAL      (1UL << 1) // sl_bt_external_signal() bit; throughput.h and edge-history.h use 0 and 2
+#define BUTTON_STATS_INTERVAL_MS  10000
+
 // The advertising set handle allocated from Bluetooth stack.
 static uint8_t advertising_set_handle = 0xff;
-// Connection handle
-static uint8_t connection_handle = 0xff;
+// Open connections and who subscribed to what live in conn-table.c
+
+// Edges drained from the ring but not reported yet
+static uint32_t batch_edges = 0;
+static uint32_t batch_last_tick;
+static sl_sleeptimer_timer_handle_t settle_timer;
+static uint8_t button_reported; // last value written to the GATT database
+static uint32_t button_batches = 0;
+static uint32_t button_updates = 0;
+static uint32_t stats_logged_tick = 0;
+static uint32_t stats_logged_edges = 0;
 
 void GPIO_ODD_IRQHandler(void)
 {
+  uint32_t start = edge_ring_cycles();
   // Stergere flag intrerupere
   uint32_t interruptMask = GPIO_IntGet();
   GPIO_IntClear(interruptMask);
 
-  // Check if the interrupt is from the correct pin
+  // Check if the interrupt is from the correct pin. Only record the edge:
+  // stack calls are not safe from interrupt context, so the GATT update
+  // happens in app_process_action().
   if (interruptMask & (1 << GPIO_PIN_BUTTON)) {
-      uint8_t button_state = GPIO_PinInGet(GPIO_PORT_BUTTON, GPIO_PIN_BUTTON) ? 1 : 0;
-      sl_status_t sc;
-
-      // Update GATT attribute value
-      sc = sl_bt_gatt_server_write_attribute_value(BUTTON_CHAR_HANDLE, 0, sizeof(button_state), &button_state);
-      app_log_status_error(sc);
-
-      // Notify client if enabled and connected
-      if (button_io_notification_enabled && connection_handle != 0xff) {
-          sc = sl_bt_gatt_server_notify_all(BUTTON_CHAR_HANDLE, sizeof(button_state), &button_state);
-          // Optional: Log error if notification fails, but don't assert
-          if(sc != SL_STATUS_OK){
-              app_log_warning("Failed to send notification, sc=0x%lx\n", sc);
-          }
-      }
+      edge_ring_push(GPIO_PinInGet(GPIO_PORT_BUTTON, GPIO_PIN_BUTTON) ? 1 : 0);
+  }
+  edge_ring_isr_done(start);
+}
+
+static void settle_cb(sl_sleeptimer_timer_handle_t *handle, void *data)
+{
+  (void)handle;
+  (void)data;
+  // Only wakes the main loop, which reports the batch
+  sl_bt_external_signal(BUTTON_SETTLE_SIGNAL);
+}
+
+static void report_button(uint8_t button_state)
+{
+  sl_status_t sc;
+
+  // Update GATT attribute value
+  sc = sl_bt_gatt_server_write_attribute_value(BUTTON_CHAR_HANDLE, 0, sizeof(button_state), &button_state);
+  app_log_status_error(sc);
+
+  // Notify only the connections that subscribed; one that is out of
+  // buffers gets the value later without holding up the others
+  conn_table_notify(BUTTON_CHAR_HANDLE, &button_state, sizeof(button_state));
+  button_reported = button_state;
+  button_updates++;
+}
+
+// The current state to one connection that just subscribed
+static void send_button_state(uint8_t connection)
+{
+  uint8_t button_state = GPIO_PinInGet(GPIO_PORT_BUTTON, GPIO_PIN_BUTTON) ? 1 : 0;
+  if (!conn_table_send(connection, BUTTON_CHAR_HANDLE, &button_state, sizeof(button_state))) {
+    app_log_warning("Failed to send initial notification\n");
   }
 }
 
+static void log_button_stats(uint32_t now)
+{
+  if (now - stats_logged_tick < sl_sleeptimer_ms_to_tick(BUTTON_STATS_INTERVAL_MS)) {
+    return;
+  }
+  stats_logged_tick = now;
+
+  edge_ring_stats_t stats;
+  edge_ring_get_stats(&stats);
+  if (stats.edges == stats_logged_edges) {
+    return;
+  }
+  stats_logged_edges = stats.edges;
+
+  uint32_t avg = stats.isr_count ? (uint32_t)(stats.isr_total_cycles / stats.isr_count) : 0;
+  app_log("Button: %lu edges in %lu bursts, %lu GATT updates, %lu lost (ring full), %lu missed (bounce)\r\n",
+          (unsigned long)stats.edges, (unsigned long)button_batches, (unsigned long)button_updates,
+          (unsigned long)stats.lost, (unsigned long)stats.missed);
+  app_log("GPIO ISR: %lu runs, avg %lu cycles, max %lu cycles (%lu ns at %lu MHz)\r\n",
+          (unsigned long)stats.isr_count, (unsigned long)avg, (unsigned long)stats.isr_max_cycles,
+          (unsigned long)((uint64_t)stats.isr_max_cycles * 1000000000ULL / SystemCoreClock),
+          (unsigned long)(SystemCoreClock / 1000000));
+}
+
 /**************************************************************************//**
  * Application Init.
  *****************************************************************************/
@@ -89,22 +157,30 @@ SL_WEAK void app_init(void)
   // This is called once during start-up.                                    //
   /////////////////////////////////////////////////////////////////////////////
 
+  int phase = boot_profile_begin("gpio_init");
   // Activare ramura clock periferic GPIO
   CMU_ClockEnable(cmuClock_GPIO, true);
-  // Configurare GPIOA 04 ca iesire (LED)
-  GPIO_PinModeSet(GPIO_PORT_LED, GPIO_PIN_LED, gpioModePushPull, 1); // Start with LED OFF assuming '1' is OFF based on schematic or preference
+  // Output pins and their PWM timer; the LED is output 0, starting at 0
+  gpio_out_init();
   // Configurare GPIOC 07 ca intrare (buton) cu pull-up si filtru
   GPIO_PinModeSet(GPIO_PORT_BUTTON, GPIO_PIN_BUTTON, gpioModeInputPullFilter, 1);
+  edge_ring_init(GPIO_PinInGet(GPIO_PORT_BUTTON, GPIO_PIN_BUTTON) ? 1 : 0);
+  edge_history_init(1 << GPIO_PIN_BUTTON);
   // Configurare intrerupere pentru buton pe ambele fronturi
   GPIO_ExtIntConfig(GPIO_PORT_BUTTON, GPIO_PIN_BUTTON, GPIO_PIN_BUTTON, true, true, true); // Use pin number also as IRQ number for simplicity if mapping allows
   // Activare intrerupere
   NVIC_ClearPendingIRQ(BUTTON_IRQn);
   NVIC_EnableIRQ(BUTTON_IRQn);
+  boot_profile_end(phase);
 
   // Initial read of button state and update GATT DB
   uint8_t initial_button_state = GPIO_PinInGet(GPIO_PORT_BUTTON, GPIO_PIN_BUTTON) ? 1 : 0;
   sl_status_t sc = sl_bt_gatt_server_write_attribute_value(BUTTON_CHAR_HANDLE, 0, sizeof(initial_button_state), &initial_button_state);
   app_assert_status(sc); // Should succeed on init
+  button_reported = initial_button_state;
+  adv_state_set_button(initial_button_state, sl_sleeptimer_get_tick_count());
+  // Bonded peers come back subscribed without writing the CCCD again
+  conn_table_watch(BUTTON_CHAR_HANDLE);
 }
 
 /**************************************************************************//**
@@ -117,6 +193,38 @@ SL_WEAK void app_process_action(void)
   // This is called infinitely.                                              //
   // Do not call blocking functions from here!                               //
   /////////////////////////////////////////////////////////////////////////////
+  edge_event_t ev;
+  bool drained = false;
+  while (edge_ring_pop(&ev)) {
+    drained = true;
+    edge_history_add(&ev);
+    batch_edges++;
+    batch_last_tick = ev.tick;
+  }
+
+  // Contact bounce arrives as a burst of edges; report only where it settled
+  uint32_t now = sl_sleeptimer_get_tick_count();
+  uint32_t settle_ticks = sl_sleeptimer_ms_to_tick(BUTTON_SETTLE_MS);
+  if (batch_edges > 0 && now - batch_last_tick >= settle_ticks) {
+    button_batches++;
+    // The ISR's latest level: the last popped edge is stale if the ring overflowed
+    uint8_t state = edge_ring_level();
+    if (state != button_reported) {
+      report_button(state);
+      adv_state_set_button(state, batch_last_tick);
+    }
+    batch_edges = 0;
+  } else if (drained) {
+    // New edges: nothing else may wake the CPU when the pin has settled
+    sl_sleeptimer_restart_timer(&settle_timer, settle_ticks - (now - batch_last_tick),
+                                settle_cb, NULL, 0, 0);
+  }
+  edge_history_process();
+  conn_table_process();
+  dfu_process();
+  log_button_stats(now);
+  gpio_out_log_stats();
+  adv_state_log_stats();
 }
 
 /**************************************************************************//**
@@ -128,13 +236,24 @@ SL_WEAK void app_process_action(void)
 void sl_bt_on_event(sl_bt_msg_t *evt)
 {
   sl_status_t sc;
+  int phase;
+
+  conn_table_on_event(evt);
+  edge_history_on_event(evt);
+  conn_profile_on_event(evt);
+  gpio_out_on_event(evt);
+  throughput_on_event(evt);
+  dfu_on_event(evt);
+  reconnect_on_event(evt);
 
   switch (SL_BT_MSG_ID(evt->header)) {
     // -------------------------------
     // This event indicates the device has started and the radio is ready.
     // Do not call any stack command before receiving this boot event!
     case sl_bt_evt_system_boot_id:
+      boot_profile_mark("bt_stack_ready");
       app_log("System Boot\r\n");
+      phase = boot_profile_begin("advertiser_start");
       // Create an advertising set.
       sc = sl_bt_advertiser_create_set(&advertising_set_handle);
       app_assert_status(sc);
@@ -143,19 +262,19 @@ void sl_bt_on_event(sl_bt_msg_t *evt)
       sc = sl_bt_legacy_advertiser_generate_data(advertising_set_handle,
                                                  sl_bt_advertiser_general_discoverable);
       app_assert_status(sc);
+      // Button/LED state record in place of the generated advertising packet
+      sc = adv_state_start(advertising_set_handle);
+      app_assert_status(sc);
 
-      // Set advertising interval to 100ms.
-      sc = sl_bt_advertiser_set_timing(
-        advertising_set_handle,
-        160, // min. adv. interval (milliseconds * 1.6 = 100ms)
-        160, // max. adv. interval (milliseconds * 1.6 = 100ms)
-        0,   // adv. duration
-        0);  // max. num. adv. events
+      // Advertising interval comes from the connection profile
+      // (100 ms for the default, balanced one).
+      sc = conn_profile_start(advertising_set_handle);
       app_assert_status(sc);
       // Start advertising and enable connections.
       sc = sl_bt_legacy_advertiser_start(advertising_set_handle,
                                          sl_bt_advertiser_connectable_scannable);
       app_assert_status(sc);
+      boot_profile_end(phase);
 
       // Configure security manager: enable bonding, require MITM for 'authenticated' pairing (if used)
       // Using 0x01 flag: Bondable mode enabled. No MITM required (Just Works pairing often sufficient for 'bonded').
@@ -167,22 +286,36 @@ void sl_bt_on_event(sl_bt_msg_t *evt)
       sc = sl_bt_sm_set_bondable_mode(1); // 1 = bondable
       app_assert_status(sc);
       app_log("Bondable mode set\r\n");
+      boot_profile_finish();
 
       break;
 
     // -------------------------------
     // This event indicates that a new connection was opened.
     case sl_bt_evt_connection_opened_id:
-      connection_handle = evt->data.evt_connection_opened.connection;
-      app_log("Connection opened, handle: %d\r\n", connection_handle);
-
-      // Optionally increase security (request bonding/encryption) if needed right away.
-      // For characteristics marked as 'Bonded', the stack usually handles this implicitly
-      // when the client tries to access them. However, explicit call can enforce it earlier.
-      // sc = sl_bt_sm_increase_security(connection_handle);
-      // if (sc != SL_STATUS_OK && sc != SL_STATUS_INVALID_STATE){ // Ignore SL_STATUS_INVALID_STATE if already secure
-      //   app_log_warning("sl_bt_sm_increase_security failed: 0x%lx\r\n", sc);
-      // }
+      app_log("Connection opened, handle: %d (%d open)\r\n",
+              evt->data.evt_connection_opened.connection, conn_table_count());
+
+      // Bonded peers get encryption resumed right away (reconnect.c); new
+      // ones pair when they first access a characteristic marked 'Bonded'.
+
+      // Advertising stopped when this central connected; keep it going
+      // while there is room for another one.
+      if (conn_table_count() < CONN_TABLE_MAX) {
+        sc = sl_bt_legacy_advertiser_start(advertising_set_handle,
+                                           sl_bt_advertiser_connectable_scannable);
+        app_assert_status(sc);
+      }
+      break;
+
+    // -------------------------------
+    // Parameters or security changed. Once a bonded peer is encrypted
+    // conn-table.c has its subscriptions back from the bond; it gets the
+    // current state as if it had just subscribed.
+    case sl_bt_evt_connection_parameters_id:
+      if (conn_table_restored(evt->data.evt_connection_parameters.connection, BUTTON_CHAR_HANDLE)) {
+        send_button_state(evt->data.evt_connection_parameters.connection);
+      }
       break;
 
     // -------------------------------
@@ -191,15 +324,19 @@ void sl_bt_on_event(sl_bt_msg_t *evt)
       app_log("Connection closed, reason: 0x%x, handle: %d\r\n",
               evt->data.evt_connection_closed.reason,
               evt->data.evt_connection_closed.connection);
-      connection_handle = 0xff; // Reset connection handle
-      button_io_notification_enabled = false; // Reset notification status on disconnect
+      // The other connections keep their subscriptions (see conn-table.c)
 
       // Generate data for advertising
       sc = sl_bt_legacy_advertiser_generate_data(advertising_set_handle,
                                                  sl_bt_advertiser_general_discoverable);
       app_assert_status(sc);
+      // Button/LED state record in place of the generated advertising packet
+      sc = adv_state_start(advertising_set_handle);
+      app_assert_status(sc);
 
-      // Restart advertising after client has disconnected.
+      // Restart advertising after client has disconnected. It may still be
+      // running if the table was not full, so stop it first.
+      sl_bt_advertiser_stop(advertising_set_handle);
       sc = sl_bt_legacy_advertiser_start(advertising_set_handle,
                                          sl_bt_advertiser_connectable_scannable);
       app_assert_status(sc);
@@ -226,50 +363,37 @@ void sl_bt_on_event(sl_bt_msg_t *evt)
     // This event occurs when the remote device writes characteristics.
     case sl_bt_evt_gatt_server_attribute_value_id:
       // Check if the write operation is on the LED characteristic
-      if (LED_CHAR_HANDLE == evt->data.evt_gatt_server_attribute_value.attribute) {
-        uint8_t recv_val;
-        size_t recv_len;
-        // Read the written value - Although we get the value in the event data, reading ensures we have the correct current value
-        // Note: evt->data.evt_gatt_server_attribute_value.value contains the data too.
-        sc = sl_bt_gatt_server_read_attribute_value(LED_CHAR_HANDLE,
-                                                    0,
-                                                    sizeof(recv_val),
-                                                    &recv_len,
-                                                    &recv_val);
-        app_assert_status(sc);
-
-        if (recv_len > 0) {
-          if (recv_val == 0) {
-            GPIO_PinOutClear(GPIO_PORT_LED, GPIO_PIN_LED);
-            app_log("LED OFF\r\n");
-          } else {
-            GPIO_PinOutSet(GPIO_PORT_LED, GPIO_PIN_LED);
-             app_log("LED ON\r\n");
-          }
-          // Optionally log the raw value: app_log("LED = %d\r\n", recv_val);
+      if (LED_CHAR_HANDLE == evt->data.evt_gatt_server_attribute_value.attribute
+          && evt->data.evt_gatt_server_attribute_value.value.len > 0) {
+        // The event already carries the written value, so use it directly
+        uint8_t recv_val = evt->data.evt_gatt_server_attribute_value.value.data[0];
+        if (recv_val == 0) {
+          gpio_out_set(0, 0);
+          app_log("LED OFF\r\n");
+        } else {
+          gpio_out_set(0, 100);
+           app_log("LED ON\r\n");
         }
       }
+      // Either this or the outputs characteristic may have moved the LED
+      adv_state_set_led(gpio_out_get(0), sl_sleeptimer_get_tick_count());
       break;
 
     // -------------------------------
     // This event occurs when the characteristic status flags for a client change.
     case sl_bt_evt_gatt_server_characteristic_status_id:
       // Check if the status change is for the BUTTON characteristic
+      // (conn-table.c has already recorded it for this connection)
       if (BUTTON_CHAR_HANDLE == evt->data.evt_gatt_server_characteristic_status.characteristic) {
+        uint8_t connection = evt->data.evt_gatt_server_characteristic_status.connection;
         // Check if the client enabled notifications (GATT Client Characteristic Configuration descriptor flags)
         if (sl_bt_gatt_notification == (sl_bt_gatt_server_characteristic_status_flag_t)evt->data.evt_gatt_server_characteristic_status.status_flags) {
-           if (evt->data.evt_gatt_server_characteristic_status.client_config_flags & sl_bt_gatt_notification) {
-              app_log("Notificare activata pentru caracteristica BUTTON\r\n");
-              button_io_notification_enabled = true;
-              // Optionally send current state upon enabling notification
-               uint8_t button_state = GPIO_PinInGet(GPIO_PORT_BUTTON, GPIO_PIN_BUTTON) ? 1 : 0;
-               sc = sl_bt_gatt_server_notify_all(BUTTON_CHAR_HANDLE, sizeof(button_state), &button_state);
-                if(sc != SL_STATUS_OK){
-                  app_log_warning("Failed to send initial notification, sc=0x%lx\n", sc);
-                }
+           if (conn_table_subscribed(connection, BUTTON_CHAR_HANDLE)) {
+              app_log("Notificare activata pentru caracteristica BUTTON, conexiunea %d\r\n", connection);
+              // Send the current state to the new subscriber only
+              send_button_state(connection);
             } else {
-              app_log("Notificare dezactivata pentru caracteristica BUTTON\r\n");
-              button_io_notification_enabled = false;
+              app_log("Notificare dezactivata pentru caracteristica BUTTON, conexiunea %d\r\n", connection);
             }
         }
       }
@@ -0,0 +1,80 @@
+/***************************************************************************//**
+ * @file
+ * @brief Boot phase timeline.
+ ******************************************************************************/
+#include <stdbool.h>
+#include "em_core.h"
+#include "sl_sleeptimer.h"
+#include "app_log.h"
+
+#include "boot-profile.h"
+
+static boot_profile_phase_t phases[BOOT_PROFILE_MAX_PHASES];
+static int phase_count = 0;
+static bool finished = false;
+
+static uint64_t now_us(void)
+{
+  uint64_t ticks = sl_sleeptimer_get_tick_count64();
+  return ticks * 1000000ULL / sl_sleeptimer_get_timer_frequency();
+}
+
+static int alloc_slot(const char *name, uint64_t now)
+{
+  int slot = -1;
+  CORE_DECLARE_IRQ_STATE;
+
+  CORE_ENTER_ATOMIC();
+  if (!finished && phase_count < BOOT_PROFILE_MAX_PHASES) {
+    slot = phase_count++;
+    phases[slot].name = name;
+    phases[slot].start_us = now;
+    phases[slot].end_us = 0;
+  }
+  CORE_EXIT_ATOMIC();
+  return slot;
+}
+
+int boot_profile_begin(const char *name)
+{
+  return alloc_slot(name, now_us());
+}
+
+void boot_profile_end(int slot)
+{
+  if (slot < 0 || slot >= BOOT_PROFILE_MAX_PHASES) {
+    return;
+  }
+  phases[slot].end_us = now_us();
+}
+
+void boot_profile_mark(const char *name)
+{
+  uint64_t now = now_us();
+  int slot = alloc_slot(name, now);
+  if (slot >= 0) {
+    phases[slot].end_us = now;
+  }
+}
+
+void boot_profile_finish(void)
+{
+  if (finished) {
+    return;
+  }
+  finished = true;
+
+  app_log("Boot timeline (%d phases, ready at %lu ms):\r\n",
+          phase_count, (unsigned long)(now_us() / 1000));
+  for (int i = 0; i < phase_count; i++) {
+    const boot_profile_phase_t *p = &phases[i];
+    if (p->end_us == p->start_us) {
+      app_log("  %8lu us  * %s\r\n", (unsigned long)p->start_us, p->name);
+    } else if (p->end_us == 0) {
+      app_log("  %8lu us  %-20s (still running)\r\n", (unsigned long)p->start_us, p->name);
+    } else {
+      app_log("  %8lu us  %-20s %8lu us\r\n", (unsigned long)p->start_us, p->name,
+              (unsigned long)(p->end_us - p->start_us));
+    }
+  }
+}
@@ -0,0 +1,34 @@
+/***************************************************************************//**
+ * @file
+ * @brief Boot phase timeline.
+ ******************************************************************************/
+#ifndef BOOT_PROFILE_H
+#define BOOT_PROFILE_H
+
+#include <stdint.h>
+
+#define BOOT_PROFILE_MAX_PHASES 16
+
+typedef struct {
+  const char *name;  // must point to a string literal
+  uint64_t start_us; // time since the sleeptimer started
+  uint64_t end_us;   // 0 while open; equal to start_us for marks
+} boot_profile_phase_t;
+
+/**************************************************************************//**
+ * Open a named boot phase. Returns the slot for boot_profile_end(), or -1
+ * once the table is full or boot_profile_finish() was called.
+ *****************************************************************************/
+int boot_profile_begin(const char *name);
+
+void boot_profile_end(int slot);
+
+// Record an instantaneous milestone (e.g. "bt_stack_ready").
+void boot_profile_mark(const char *name);
+
+/**************************************************************************//**
+ * Close the table and print the timeline through app_log.
+ *****************************************************************************/
+void boot_profile_finish(void);
+
+#endif // BOOT_PROFILE_H
@@ -0,0 +1,53 @@
+/***************************************************************************//**
+ * @file
+ * @brief Low-latency / low-power connection and advertising profiles.
+ ******************************************************************************/
+#ifndef CONN_PROFILE_H
+#define CONN_PROFILE_H
+
+#include <stdint.h>
+#include "sl_bluetooth.h"
+
+#define CONN_PROFILE_UUID_SERVICE 0x0200
+#define CONN_PROFILE_UUID_PROFILE 0x0201
+
+// NVM3 key the selected profile is kept under across resets
+#define CONN_PROFILE_NVM3_KEY     0x0c40
+
+#define CONN_PROFILE_MAX_CONNECTIONS 4 // keep >= SL_BT_CONFIG_MAX_CONNECTIONS
+
+typedef enum {
+  CONN_PROFILE_LOW_LATENCY = 0, // ~10 ms button-to-phone
+  CONN_PROFILE_BALANCED    = 1, // the old fixed 100 ms advertising
+  CONN_PROFILE_LOW_POWER   = 2, // months on a coin cell
+  CONN_PROFILE_COUNT
+} conn_profile_t;
+
+typedef struct {
+  const char *name;
+  uint16_t adv_interval;  // units of 0.625 ms
+  uint16_t min_interval;  // units of 1.25 ms
+  uint16_t max_interval;
+  uint16_t latency;       // connection events the peripheral may skip
+  uint16_t timeout;       // supervision timeout, units of 10 ms
+} conn_profile_params_t;
+
+// Feed every Bluetooth event through here, from sl_bt_on_event().
+void conn_profile_on_event(sl_bt_msg_t *evt);
+
+/**************************************************************************//**
+ * Apply the saved profile's timing to the advertising set. Call from the
+ * boot event in place of sl_bt_advertiser_set_timing(), before starting it.
+ *****************************************************************************/
+sl_status_t conn_profile_start(uint8_t advertising_set);
+
+/**************************************************************************//**
+ * Switch profile: renegotiate every open connection, retime advertising and
+ * save the choice. Also done by writing the profile characteristic (u8).
+ * The interval the central settles on is logged when it arrives.
+ *****************************************************************************/
+sl_status_t conn_profile_set(conn_profile_t profile);
+
+conn_profile_t conn_profile_get(void);
+
+#endif // CONN_PROFILE_H
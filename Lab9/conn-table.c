@@ -0,0 +1,285 @@
+/***************************************************************************//**
+ * @file
+ * @brief Open connections, their parameters and their subscriptions.
+ ******************************************************************************/
+#include <string.h>
+#include "sl_sleeptimer.h"
+#include "app_log.h"
+
+#include "conn-table.h"
+
+static conn_entry_t table[CONN_TABLE_MAX];
+static bool initialized = false;
+static int open_count = 0;
+static uint16_t watched[CONN_TABLE_MAX_CCCD];
+
+static void init_table(void)
+{
+  memset(table, 0, sizeof(table));
+  for (int i = 0; i < CONN_TABLE_MAX; i++) {
+    table[i].handle = 0xff;
+  }
+  open_count = 0;
+  initialized = true;
+}
+
+conn_entry_t *conn_table_find(uint8_t connection)
+{
+  if (!initialized || connection == 0xff) {
+    return NULL;
+  }
+  for (int i = 0; i < CONN_TABLE_MAX; i++) {
+    if (table[i].handle == connection) {
+      return &table[i];
+    }
+  }
+  return NULL;
+}
+
+int conn_table_count(void)
+{
+  return open_count;
+}
+
+static conn_cccd_t *find_cccd(conn_entry_t *c, uint16_t characteristic, bool create)
+{
+  conn_cccd_t *free_slot = NULL;
+  for (int i = 0; i < CONN_TABLE_MAX_CCCD; i++) {
+    if (c->cccd[i].characteristic == characteristic) {
+      return &c->cccd[i];
+    }
+    if (c->cccd[i].characteristic == 0 && free_slot == NULL) {
+      free_slot = &c->cccd[i];
+    }
+  }
+  if (create && free_slot != NULL) {
+    memset(free_slot, 0, sizeof(*free_slot));
+    free_slot->characteristic = characteristic;
+    return free_slot;
+  }
+  return NULL;
+}
+
+bool conn_table_subscribed(uint8_t connection, uint16_t characteristic)
+{
+  conn_entry_t *c = conn_table_find(connection);
+  conn_cccd_t *cccd = c ? find_cccd(c, characteristic, false) : NULL;
+  return cccd != NULL && (cccd->flags & sl_bt_gatt_notification);
+}
+
+void conn_table_watch(uint16_t characteristic)
+{
+  for (int i = 0; i < CONN_TABLE_MAX_CCCD; i++) {
+    if (watched[i] == characteristic || watched[i] == 0) {
+      watched[i] = characteristic;
+      return;
+    }
+  }
+  app_log_warning("Characteristic %u not watched, list full\r\n", characteristic);
+}
+
+bool conn_table_restored(uint8_t connection, uint16_t characteristic)
+{
+  conn_entry_t *c = conn_table_find(connection);
+  return c != NULL && c->restored > 0 && c->sent == 0
+         && conn_table_subscribed(connection, characteristic);
+}
+
+// The stack puts a bond's client configuration back once the link is encrypted
+static void restore_subscriptions(conn_entry_t *c)
+{
+  for (int i = 0; i < CONN_TABLE_MAX_CCCD && watched[i] != 0; i++) {
+    uint16_t flags = 0;
+    sl_status_t sc = sl_bt_gatt_server_read_client_configuration(c->handle, watched[i], &flags);
+    if (sc != SL_STATUS_OK || flags == 0) {
+      continue;
+    }
+    conn_cccd_t *cccd = find_cccd(c, watched[i], true);
+    if (cccd != NULL) {
+      cccd->flags = (uint8_t)flags;
+      c->restored++;
+    }
+  }
+  if (c->restored > 0) {
+    app_log("Connection %u: %u subscriptions restored from bond %u\r\n",
+            c->handle, c->restored, c->bonding);
+  }
+}
+
+static uint32_t ms_since_open(const conn_entry_t *c)
+{
+  return sl_sleeptimer_tick_to_ms(sl_sleeptimer_get_tick_count() - c->opened_tick);
+}
+
+static bool send(conn_entry_t *c, uint16_t characteristic, const uint8_t *value, size_t len)
+{
+  sl_status_t sc = sl_bt_gatt_server_send_notification(c->handle, characteristic, len, value);
+  if (sc == SL_STATUS_OK) {
+    if (c->sent++ == 0) {
+      app_log("Connection %u (%s): encrypted at %lu ms, first notification at %lu ms\r\n",
+              c->handle, c->bonding != SL_BT_INVALID_BONDING_HANDLE ? "bonded" : "new",
+              (unsigned long)c->encrypted_ms, (unsigned long)ms_since_open(c));
+    }
+    return true;
+  }
+  if (sc != SL_STATUS_NO_MORE_RESOURCE) {
+    app_log_warning("Notification to %u failed, sc=0x%lx\r\n", c->handle, (unsigned long)sc);
+  }
+  return false;
+}
+
+bool conn_table_send(uint8_t connection, uint16_t characteristic,
+                     const uint8_t *value, size_t len)
+{
+  conn_entry_t *c = conn_table_find(connection);
+  return c != NULL && send(c, characteristic, value, len);
+}
+
+int conn_table_notify(uint16_t characteristic, const uint8_t *value, size_t len)
+{
+  int reached = 0;
+
+  if (!initialized) {
+    return 0;
+  }
+  for (int i = 0; i < CONN_TABLE_MAX; i++) {
+    conn_entry_t *c = &table[i];
+    conn_cccd_t *cccd = c->handle != 0xff ? find_cccd(c, characteristic, false) : NULL;
+    if (cccd == NULL || !(cccd->flags & sl_bt_gatt_notification)) {
+      continue;
+    }
+    // Keep order: while an older value waits, the new one waits behind it
+    if (!cccd->pending && send(c, characteristic, value, len)) {
+      reached++;
+      continue;
+    }
+    if (len > CONN_TABLE_VALUE_LEN) {
+      continue;
+    }
+    if (cccd->pending) {
+      c->superseded++;
+    } else {
+      c->deferred++;
+    }
+    memcpy(cccd->value, value, len);
+    cccd->len = len;
+    cccd->pending = true;
+  }
+  return reached;
+}
+
+void conn_table_process(void)
+{
+  if (!initialized) {
+    return;
+  }
+  for (int i = 0; i < CONN_TABLE_MAX; i++) {
+    conn_entry_t *c = &table[i];
+    if (c->handle == 0xff) {
+      continue;
+    }
+    for (int j = 0; j < CONN_TABLE_MAX_CCCD; j++) {
+      conn_cccd_t *cccd = &c->cccd[j];
+      if (cccd->pending && send(c, cccd->characteristic, cccd->value, cccd->len)) {
+        cccd->pending = false;
+      }
+    }
+  }
+}
+
+void conn_table_on_event(sl_bt_msg_t *evt)
+{
+  conn_entry_t *c;
+
+  switch (SL_BT_MSG_ID(evt->header)) {
+    case sl_bt_evt_system_boot_id:
+      init_table();
+      break;
+
+    case sl_bt_evt_connection_opened_id:
+      c = NULL;
+      for (int i = 0; i < CONN_TABLE_MAX && c == NULL; i++) {
+        if (table[i].handle == 0xff) {
+          c = &table[i];
+        }
+      }
+      if (c == NULL) {
+        // More links than the table was sized for; they get no notifications
+        app_log_warning("Connection %u not tracked, table full\r\n",
+                        evt->data.evt_connection_opened.connection);
+        break;
+      }
+      memset(c, 0, sizeof(*c));
+      c->handle = evt->data.evt_connection_opened.connection;
+      c->address = evt->data.evt_connection_opened.address;
+      c->bonding = evt->data.evt_connection_opened.bonding;
+      c->opened_tick = sl_sleeptimer_get_tick_count();
+      c->mtu = 23;
+      open_count++;
+      break;
+
+    case sl_bt_evt_connection_closed_id:
+      c = conn_table_find(evt->data.evt_connection_closed.connection);
+      if (c != NULL) {
+        app_log("Connection %u: %lu notifications, %lu waited for a buffer, %lu superseded\r\n",
+                c->handle, (unsigned long)c->sent, (unsigned long)c->deferred,
+                (unsigned long)c->superseded);
+        c->handle = 0xff;
+        open_count--;
+      }
+      break;
+
+    case sl_bt_evt_connection_parameters_id:
+      c = conn_table_find(evt->data.evt_connection_parameters.connection);
+      if (c != NULL) {
+        c->interval = evt->data.evt_connection_parameters.interval;
+        c->latency = evt->data.evt_connection_parameters.latency;
+        c->timeout = evt->data.evt_connection_parameters.timeout;
+        if (c->encrypted_ms == 0
+            && evt->data.evt_connection_parameters.security_mode != sl_bt_connection_mode1_level1) {
+          c->encrypted_ms = ms_since_open(c);
+          if (c->encrypted_ms == 0) {
+            c->encrypted_ms = 1;
+          }
+          if (c->bonding != SL_BT_INVALID_BONDING_HANDLE) {
+            restore_subscriptions(c);
+          }
+        }
+      }
+      break;
+
+    case sl_bt_evt_sm_bonded_id:
+      c = conn_table_find(evt->data.evt_sm_bonded.connection);
+      if (c != NULL) {
+        c->bonding = evt->data.evt_sm_bonded.bonding;
+      }
+      break;
+
+    case sl_bt_evt_gatt_mtu_exchanged_id:
+      c = conn_table_find(evt->data.evt_gatt_mtu_exchanged.connection);
+      if (c != NULL) {
+        c->mtu = evt->data.evt_gatt_mtu_exchanged.mtu;
+      }
+      break;
+
+    case sl_bt_evt_gatt_server_characteristic_status_id:
+      if (evt->data.evt_gatt_server_characteristic_status.status_flags
+          != sl_bt_gatt_server_client_config) {
+        break;
+      }
+      c = conn_table_find(evt->data.evt_gatt_server_characteristic_status.connection);
+      if (c != NULL) {
+        conn_cccd_t *cccd = find_cccd(c, evt->data.evt_gatt_server_characteristic_status.characteristic, true);
+        if (cccd != NULL) {
+          cccd->flags = evt->data.evt_gatt_server_characteristic_status.client_config_flags;
+          if (cccd->flags == 0) {
+            cccd->pending = false;
+          }
+        }
+      }
+      break;
+
+    default:
+      break;
+  }
+}
@@ -0,0 +1,85 @@
+/***************************************************************************//**
+ * @file
+ * @brief Open connections, their parameters and their subscriptions.
+ ******************************************************************************/
+#ifndef CONN_TABLE_H
+#define CONN_TABLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sl_bluetooth.h"
+
+#define CONN_TABLE_MAX        4  // keep <= SL_BT_CONFIG_MAX_CONNECTIONS
+#define CONN_TABLE_MAX_CCCD   4  // subscribed characteristics per connection
+#define CONN_TABLE_VALUE_LEN  20 // longest value that can wait for a buffer
+
+typedef struct {
+  uint16_t characteristic;  // 0 = free
+  uint8_t flags;            // client config flags the peer wrote
+  bool pending;             // value waits for a stack buffer
+  uint8_t len;
+  uint8_t value[CONN_TABLE_VALUE_LEN];
+} conn_cccd_t;
+
+typedef struct {
+  uint8_t handle;           // 0xff = free slot
+  bd_addr address;
+  uint8_t bonding;          // SL_BT_INVALID_BONDING_HANDLE if not bonded
+  uint16_t interval;        // units of 1.25 ms
+  uint16_t latency;
+  uint16_t timeout;         // units of 10 ms
+  uint16_t mtu;
+  conn_cccd_t cccd[CONN_TABLE_MAX_CCCD];
+  uint32_t opened_tick;     // sl_sleeptimer tick of connection_opened
+  uint32_t encrypted_ms;    // after opening; 0 until encrypted
+  uint8_t restored;         // subscriptions read back from the bond
+  uint32_t sent;
+  uint32_t deferred;        // waited for a buffer before going out
+  uint32_t superseded;      // replaced by a newer value while waiting
+} conn_entry_t;
+
+// Feed every Bluetooth event through here, from sl_bt_on_event().
+void conn_table_on_event(sl_bt_msg_t *evt);
+
+// NULL if connection is not open.
+conn_entry_t *conn_table_find(uint8_t connection);
+
+int conn_table_count(void);
+
+bool conn_table_subscribed(uint8_t connection, uint16_t characteristic);
+
+/**************************************************************************//**
+ * Track subscriptions to characteristic across reconnections. A bonded peer
+ * keeps its client configuration in the bond and never writes it again, so
+ * no characteristic_status event comes for it. Once such a link is
+ * encrypted, the table reads the restored configuration of every watched
+ * characteristic back from the stack. Up to CONN_TABLE_MAX_CCCD, at init.
+ *****************************************************************************/
+void conn_table_watch(uint16_t characteristic);
+
+// True from the encryption of a bonded link until its first notification
+// went out, if the bond subscribed it to characteristic.
+bool conn_table_restored(uint8_t connection, uint16_t characteristic);
+
+/**************************************************************************//**
+ * Notify characteristic to every connection that subscribed to it, and to no
+ * one else. When the stack is out of buffers for a connection, the value is
+ * held for that connection alone (a newer one replaces it) and sent from
+ * conn_table_process(), so one slow peer does not hold up the others.
+ * Returns the number of connections it went out to now.
+ *****************************************************************************/
+int conn_table_notify(uint16_t characteristic, const uint8_t *value, size_t len);
+
+/**************************************************************************//**
+ * Notify one connection now, whether or not it subscribed (e.g. the current
+ * value right after it does). The first notification on a connection logs
+ * how long after the connection opened it went out.
+ *****************************************************************************/
+bool conn_table_send(uint8_t connection, uint16_t characteristic,
+                     const uint8_t *value, size_t len);
+
+// Retry held notifications; call from app_process_action().
+void conn_table_process(void);
+
+#endif // CONN_TABLE_H
@@ -0,0 +1,444 @@
+/***************************************************************************//**
+ * @file
+ * @brief Firmware update over GATT into the bootloader's staging slot.
+ ******************************************************************************/
+#include <string.h>
+#include "btl_interface.h"
+#include "mbedtls/sha256.h"
+#include "nvm3_default.h"
+#include "sl_sleeptimer.h"
+#include "app_assert.h"
+#include "app_log.h"
+
+#include "gatt-service.h"
+#include "dfu.h"
+
+#define START_LEN    37 // opcode, size, hash
+#define RESPONSE_LEN 10
+#define DATA_HEADER  4
+
+// What a transfer is and how much of it is in the slot, kept in NVM3
+typedef struct {
+  uint32_t size;
+  uint8_t sha256[32];
+  uint32_t flushed;
+} dfu_progress_t;
+
+static uint16_t control_handle;
+static uint16_t data_handle;
+static uint32_t slot_size = 0;        // 0 = no bootloader storage
+
+static dfu_progress_t progress;
+static bool receiving = false;        // START accepted, RAM holds the hash
+static bool verified = false;
+static bool install_pending = false;
+static uint32_t received;             // bytes hashed, in the slot or in chunk
+static uint8_t chunk[DFU_FLASH_CHUNK]; // received bytes from progress.flushed on
+static mbedtls_sha256_context sha;
+
+static uint8_t connection = 0xff;     // the one sending the image
+static uint32_t subscribers;          // bit n: connection n has control notifications on
+static uint32_t unacked;              // data writes since the last ack
+static bool gap_reported;
+static uint32_t writes;
+static uint32_t start_tick;
+static uint32_t last_data_tick;
+static uint32_t start_offset;         // where this session picked up
+
+static uint8_t held[RESPONSE_LEN];    // answer waiting for a stack buffer
+static uint8_t held_connection = 0xff;
+
+static void put32(uint8_t *p, uint32_t v)
+{
+  p[0] = v & 0xff;
+  p[1] = (v >> 8) & 0xff;
+  p[2] = (v >> 16) & 0xff;
+  p[3] = v >> 24;
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint32_t conn_bit(uint8_t conn)
+{
+  return conn < 32 ? 1UL << conn : 0;
+}
+
+static void respond(uint8_t conn, uint8_t op, uint8_t status, uint32_t offset, uint32_t value)
+{
+  uint8_t response[RESPONSE_LEN];
+
+  // Each connection hears its own answers, so a second one gets its BUSY
+  if (!(subscribers & conn_bit(conn))) {
+    return;
+  }
+  response[0] = op;
+  response[1] = status;
+  put32(response + 2, offset);
+  put32(response + 6, value);
+  sl_status_t sc = sl_bt_gatt_server_send_notification(conn, control_handle, sizeof(response), response);
+  if (sc == SL_STATUS_NO_MORE_RESOURCE) {
+    // Acks are cumulative, so a newer answer can take the place of one held
+    memcpy(held, response, sizeof(held));
+    held_connection = conn;
+  } else {
+    held_connection = 0xff;
+  }
+}
+
+static void forget(void)
+{
+  receiving = false;
+  verified = false;
+  memset(&progress, 0, sizeof(progress));
+  nvm3_deleteObject(nvm3_defaultHandle, DFU_NVM3_KEY);
+}
+
+static void fail(uint8_t op, uint8_t status)
+{
+  app_log_warning("DFU: transfer dropped at %lu of %lu, status %u\r\n",
+                  (unsigned long)received, (unsigned long)progress.size, status);
+  respond(connection, op, status, received, 0);
+  forget();
+}
+
+static int32_t flush(void)
+{
+  uint32_t len = received - progress.flushed;
+  uint32_t before = progress.flushed;
+
+  if (len == 0) {
+    return BOOTLOADER_OK;
+  }
+  // The slot is written in whole words; pad the image's last one
+  while (len % 4) {
+    chunk[len++] = 0xff;
+  }
+  // Consecutive writes from offset 0: the page each one runs into is erased
+  // first, so there is no separate slot erase to hold up the connection
+  int32_t rc = bootloader_eraseWriteStorage(DFU_SLOT, progress.flushed, chunk, len);
+  if (rc != BOOTLOADER_OK) {
+    return rc;
+  }
+  progress.flushed = received;
+  if (progress.flushed / DFU_SAVE_BYTES != before / DFU_SAVE_BYTES
+      || progress.flushed == progress.size) {
+    nvm3_writeData(nvm3_defaultHandle, DFU_NVM3_KEY, &progress, sizeof(progress));
+  }
+  return rc;
+}
+
+static void restart_hash(void)
+{
+  mbedtls_sha256_free(&sha);
+  mbedtls_sha256_init(&sha);
+  mbedtls_sha256_starts(&sha, 0);
+}
+
+static bool rehash(uint32_t len)
+{
+  for (uint32_t offset = 0; offset < len; offset += sizeof(chunk)) {
+    uint32_t n = len - offset < sizeof(chunk) ? len - offset : sizeof(chunk);
+    if (bootloader_readStorage(DFU_SLOT, offset, chunk, n) != BOOTLOADER_OK) {
+      return false;
+    }
+    mbedtls_sha256_update(&sha, chunk, n);
+  }
+  return true;
+}
+
+static void start(uint8_t conn, const uint8_t *value, size_t len)
+{
+  if (slot_size == 0) {
+    respond(conn, DFU_OP_START, DFU_STATUS_NO_SLOT, 0, 0);
+    return;
+  }
+  if (receiving && connection != 0xff && conn != connection) {
+    respond(conn, DFU_OP_START, DFU_STATUS_BUSY, 0, 0);
+    return;
+  }
+  uint32_t size = len >= START_LEN ? get32(value + 1) : 0;
+  if (size == 0 || size > slot_size) {
+    respond(conn, DFU_OP_START, DFU_STATUS_BAD_SIZE, 0, slot_size);
+    return;
+  }
+
+  bool same = size == progress.size && memcmp(value + 5, progress.sha256, 32) == 0;
+  if (same && receiving) {
+    // Disconnected part way: the hash and the unwritten chunk are still here
+    app_log("DFU: continuing at %lu of %lu\r\n", (unsigned long)received, (unsigned long)size);
+  } else {
+    restart_hash();
+    if (same && progress.flushed > 0 && rehash(progress.flushed)) {
+      // Reset part way: the hash is rebuilt from what reached the slot
+      received = progress.flushed;
+      app_log("DFU: continuing at %lu of %lu after reset\r\n",
+              (unsigned long)received, (unsigned long)size);
+    } else {
+      restart_hash(); // a failed rehash may have left part of the slot in it
+      progress.size = size;
+      memcpy(progress.sha256, value + 5, 32);
+      progress.flushed = 0;
+      received = 0;
+      // Saved now so progress left by another image is not taken for this one
+      nvm3_writeData(nvm3_defaultHandle, DFU_NVM3_KEY, &progress, sizeof(progress));
+      app_log("DFU: receiving %lu bytes\r\n", (unsigned long)size);
+    }
+    receiving = true;
+    verified = false;
+  }
+
+  connection = conn;
+  unacked = 0;
+  gap_reported = false;
+  writes = 0;
+  start_offset = received;
+  start_tick = sl_sleeptimer_get_tick_count();
+  last_data_tick = start_tick;
+  // Fewer, fuller connection events: the central may refuse either
+  sl_bt_connection_set_preferred_phy(conn, sl_bt_gap_phy_2m, 0xff);
+  sl_bt_connection_set_data_length(conn, DFU_LL_DATA_LEN, DFU_LL_TIME_US);
+  respond(conn, DFU_OP_START, DFU_STATUS_OK, received, DFU_WINDOW);
+}
+
+static void data(uint8_t conn, const uint8_t *value, size_t len)
+{
+  if (!receiving || conn != connection || len <= DATA_HEADER) {
+    return;
+  }
+  uint32_t offset = get32(value);
+  const uint8_t *p = value + DATA_HEADER;
+  uint32_t n = len - DATA_HEADER;
+
+  if (offset != received || n > progress.size - received) {
+    // Writes are not lost on a live link, so this is the host resending from
+    // before a resume: tell it once where to go on from
+    if (!gap_reported) {
+      gap_reported = true;
+      respond(conn, DFU_OP_ACK, DFU_STATUS_GAP, received, writes);
+    }
+    return;
+  }
+  gap_reported = false;
+
+  mbedtls_sha256_update(&sha, p, n);
+  while (n > 0) {
+    uint32_t used = received - progress.flushed;
+    uint32_t take = n < DFU_FLASH_CHUNK - used ? n : DFU_FLASH_CHUNK - used;
+    memcpy(chunk + used, p, take);
+    received += take;
+    p += take;
+    n -= take;
+    if (received - progress.flushed == DFU_FLASH_CHUNK) {
+      int32_t rc = flush();
+      if (rc != BOOTLOADER_OK) {
+        app_log_warning("DFU: slot write at %lu failed, rc=0x%lx\r\n",
+                        (unsigned long)progress.flushed, (unsigned long)rc);
+        fail(DFU_OP_ACK, DFU_STATUS_FLASH);
+        return;
+      }
+    }
+  }
+  writes++;
+  last_data_tick = sl_sleeptimer_get_tick_count();
+  if (++unacked >= DFU_WINDOW || received == progress.size) {
+    unacked = 0;
+    respond(conn, DFU_OP_ACK, DFU_STATUS_OK, received, writes);
+  }
+}
+
+static void verify(uint8_t conn)
+{
+  uint8_t digest[32];
+  mbedtls_sha256_context copy;
+
+  if (!receiving || conn != connection || received != progress.size) {
+    respond(conn, DFU_OP_VERIFY, DFU_STATUS_BAD_STATE, received, 0);
+    return;
+  }
+  int32_t rc = flush();
+  if (rc != BOOTLOADER_OK) {
+    fail(DFU_OP_VERIFY, DFU_STATUS_FLASH);
+    return;
+  }
+  // Finish a copy so VERIFY can be asked again after a lost answer
+  mbedtls_sha256_init(&copy);
+  mbedtls_sha256_clone(&copy, &sha);
+  mbedtls_sha256_finish(&copy, digest);
+  mbedtls_sha256_free(&copy);
+  if (memcmp(digest, progress.sha256, sizeof(digest)) != 0) {
+    fail(DFU_OP_VERIFY, DFU_STATUS_HASH);
+    return;
+  }
+  uint32_t verify_tick = sl_sleeptimer_get_tick_count();
+  rc = bootloader_verifyImage(DFU_SLOT, NULL);
+  if (rc == BOOTLOADER_OK) {
+    rc = bootloader_setImageToBootload(DFU_SLOT);
+  }
+  if (rc != BOOTLOADER_OK) {
+    app_log_warning("DFU: image rejected by the bootloader, rc=0x%lx\r\n", (unsigned long)rc);
+    fail(DFU_OP_VERIFY, DFU_STATUS_IMAGE);
+    return;
+  }
+  verified = true;
+
+  uint32_t now = sl_sleeptimer_get_tick_count();
+  uint32_t transfer_ms = sl_sleeptimer_tick_to_ms(last_data_tick - start_tick);
+  uint32_t verify_ms = sl_sleeptimer_tick_to_ms(now - verify_tick);
+  uint32_t total_ms = sl_sleeptimer_tick_to_ms(now - start_tick);
+  uint32_t bytes = received - start_offset;
+  uint16_t mtu = 23;
+  sl_bt_gatt_server_get_mtu(conn, &mtu);
+  app_log("DFU: %lu bytes in %lu ms = %lu B/s (%lu writes, MTU %u, from offset %lu), "
+          "verified in %lu ms, %lu ms in all\r\n",
+          (unsigned long)bytes, (unsigned long)transfer_ms,
+          (unsigned long)(transfer_ms ? (uint64_t)bytes * 1000 / transfer_ms : 0),
+          (unsigned long)writes, mtu, (unsigned long)start_offset,
+          (unsigned long)verify_ms, (unsigned long)total_ms);
+  respond(conn, DFU_OP_VERIFY, DFU_STATUS_OK, received, total_ms);
+}
+
+static void control(uint8_t conn, const uint8_t *value, size_t len)
+{
+  switch (value[0]) {
+    case DFU_OP_START:
+      start(conn, value, len);
+      break;
+
+    case DFU_OP_ABORT:
+      if (receiving && connection != 0xff && conn != connection) {
+        respond(conn, DFU_OP_ABORT, DFU_STATUS_BUSY, 0, 0);
+        break;
+      }
+      forget();
+      app_log("DFU: aborted\r\n");
+      respond(conn, DFU_OP_ABORT, DFU_STATUS_OK, 0, 0);
+      break;
+
+    case DFU_OP_VERIFY:
+      verify(conn);
+      break;
+
+    case DFU_OP_INSTALL:
+      if (!verified || conn != connection) {
+        respond(conn, DFU_OP_INSTALL, DFU_STATUS_BAD_STATE, 0, 0);
+        break;
+      }
+      // Reboot once the link is down, so the write is answered first
+      install_pending = true;
+      respond(conn, DFU_OP_INSTALL, DFU_STATUS_OK, progress.size, 0);
+      sl_bt_connection_close(conn);
+      break;
+
+    default:
+      break;
+  }
+}
+
+void dfu_process(void)
+{
+  if (held_connection == 0xff) {
+    return;
+  }
+  if (sl_bt_gatt_server_send_notification(held_connection, control_handle,
+                                          sizeof(held), held) != SL_STATUS_NO_MORE_RESOURCE) {
+    held_connection = 0xff;
+  }
+}
+
+void dfu_on_event(sl_bt_msg_t *evt)
+{
+  switch (SL_BT_MSG_ID(evt->header)) {
+    case sl_bt_evt_system_boot_id: {
+      static const gatt_service_char_t chars[] = {
+        { GATT_SERVICE_UUID(DFU_UUID_CONTROL),
+          SL_BT_GATTDB_CHARACTERISTIC_WRITE | SL_BT_GATTDB_CHARACTERISTIC_NOTIFY,
+          SL_BT_GATTDB_ENCRYPTED_WRITE, START_LEN, &control_handle },
+        { GATT_SERVICE_UUID(DFU_UUID_DATA),
+          SL_BT_GATTDB_CHARACTERISTIC_WRITE_NO_RESPONSE,
+          SL_BT_GATTDB_ENCRYPTED_WRITE, DATA_HEADER + DFU_MAX_DATA, &data_handle },
+      };
+      static const uint8_t service[] = GATT_SERVICE_UUID(DFU_UUID_SERVICE);
+      BootloaderStorageSlot_t slot;
+      sl_status_t sc = gatt_service_add(service, chars, sizeof(chars) / sizeof(chars[0]));
+      app_assert_status(sc);
+
+      mbedtls_sha256_init(&sha);
+      if (bootloader_init() == BOOTLOADER_OK
+          && bootloader_getStorageSlotInfo(DFU_SLOT, &slot) == BOOTLOADER_OK) {
+        slot_size = slot.length;
+      } else {
+        app_log_warning("DFU: no bootloader storage slot, updates disabled\r\n");
+      }
+      if (nvm3_readData(nvm3_defaultHandle, DFU_NVM3_KEY, &progress, sizeof(progress)) == ECODE_NVM3_OK
+          && progress.flushed > 0 && progress.flushed < progress.size) {
+        app_log("DFU: interrupted at %lu of %lu bytes, START it again to continue\r\n",
+                (unsigned long)progress.flushed, (unsigned long)progress.size);
+      }
+      break;
+    }
+
+    case sl_bt_evt_connection_closed_id:
+      if (evt->data.evt_connection_closed.connection == held_connection) {
+        held_connection = 0xff;
+      }
+      subscribers &= ~conn_bit(evt->data.evt_connection_closed.connection);
+      if (evt->data.evt_connection_closed.connection == connection) {
+        connection = 0xff;
+        if (install_pending) {
+          nvm3_deleteObject(nvm3_defaultHandle, DFU_NVM3_KEY);
+          app_log("DFU: rebooting to install\r\n");
+          bootloader_rebootAndInstall();
+        }
+        if (receiving && received < progress.size) {
+          app_log("DFU: disconnected at %lu of %lu bytes\r\n",
+                  (unsigned long)received, (unsigned long)progress.size);
+        }
+      }
+      break;
+
+    case sl_bt_evt_connection_phy_status_id:
+      if (evt->data.evt_connection_phy_status.connection == connection) {
+        app_log("DFU: PHY %u\r\n", evt->data.evt_connection_phy_status.phy);
+      }
+      break;
+
+    case sl_bt_evt_connection_data_length_id:
+      if (evt->data.evt_connection_data_length.connection == connection) {
+        app_log("DFU: link-layer payload %u B, %u us\r\n",
+                evt->data.evt_connection_data_length.tx_data_len,
+                evt->data.evt_connection_data_length.tx_time_us);
+      }
+      break;
+
+    case sl_bt_evt_gatt_server_characteristic_status_id:
+      if (evt->data.evt_gatt_server_characteristic_status.characteristic == control_handle
+          && evt->data.evt_gatt_server_characteristic_status.status_flags == sl_bt_gatt_server_client_config) {
+        uint8_t conn = evt->data.evt_gatt_server_characteristic_status.connection;
+        if (evt->data.evt_gatt_server_characteristic_status.client_config_flags & sl_bt_gatt_notification) {
+          subscribers |= conn_bit(conn);
+        } else {
+          subscribers &= ~conn_bit(conn);
+        }
+      }
+      break;
+
+    case sl_bt_evt_gatt_server_attribute_value_id: {
+      uint16_t attribute = evt->data.evt_gatt_server_attribute_value.attribute;
+      uint8_t conn = evt->data.evt_gatt_server_attribute_value.connection;
+      const uint8_t *value = evt->data.evt_gatt_server_attribute_value.value.data;
+      size_t len = evt->data.evt_gatt_server_attribute_value.value.len;
+      if (attribute == data_handle) {
+        data(conn, value, len);
+      } else if (attribute == control_handle && len >= 1) {
+        control(conn, value, len);
+      }
+      break;
+    }
+
+    default:
+      break;
+  }
+}
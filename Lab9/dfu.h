@@ -0,0 +1,81 @@
+/***************************************************************************//**
+ * @file
+ * @brief Firmware update over GATT into the bootloader's staging slot.
+ *
+ * Control (write, notify), u8 opcode then:
+ *   START    01  u32 size, u8 sha256[32] of the GBL file
+ *   ABORT    02  forget the transfer and its saved progress
+ *   VERIFY   03  check the hash and the image, mark it to be installed
+ *   INSTALL  04  disconnect and reboot into the bootloader to install it
+ * Every answer is a notification on control:
+ *   u8 opcode (the command's, or DFU_OP_ACK), u8 status, u32 offset, u32 value
+ *   START:  offset = where to send from, value = DFU_WINDOW
+ *   ACK:    offset = next byte expected, value = data writes this session
+ *   VERIFY: offset = image size, value = ms since START
+ * Data (write without response): u32 offset, then up to DFU_MAX_DATA bytes
+ * (MTU - 7 on a smaller MTU).
+ *
+ * Data is acked once per DFU_WINDOW writes, and at the end of the image; the
+ * host keeps at most two windows unacked. A write at any other offset than
+ * the next one is dropped and answered at once with DFU_STATUS_GAP (once,
+ * until data lines up again); the host goes back to that offset, ignoring a
+ * GAP for an offset it has already sent again since going back. START
+ * with the size and hash of an interrupted transfer carries on with it: from
+ * RAM after a disconnect, from the progress saved in NVM3 after a reset.
+ *
+ * All little-endian. Only one connection sends at a time. Both characteristics
+ * take writes over an encrypted link only: a peer that has not paired gets
+ * Insufficient Encryption on its first START and must pair before retrying,
+ * and data written without response on an open link is dropped. The hash
+ * guards the transfer; whether the image must be signed is up to the bootloader.
+ * Lab9/dfu_replay.py runs dfu.c on the host through Lab9/dfu_host.c.
+ ******************************************************************************/
+#ifndef DFU_H
+#define DFU_H
+
+#include <stdint.h>
+#include "sl_bluetooth.h"
+
+#define DFU_UUID_SERVICE  0x0500
+#define DFU_UUID_CONTROL  0x0501
+#define DFU_UUID_DATA     0x0502
+
+// NVM3 key the progress of an interrupted transfer is kept under
+#define DFU_NVM3_KEY      0x0c43
+
+#define DFU_SLOT          0          // bootloader storage slot to stage into
+#define DFU_WINDOW        16         // data writes per ack
+#define DFU_MAX_DATA      240        // 247-byte MTU less ATT and offset headers
+#define DFU_FLASH_CHUNK   1024       // bytes written to the slot at a time
+#define DFU_SAVE_BYTES    (16 * 1024) // progress saved to NVM3 this often
+// Link-layer payload and air time asked for once a transfer starts
+#define DFU_LL_DATA_LEN   251
+#define DFU_LL_TIME_US    2120       // 251 bytes on the 1M PHY
+
+typedef enum {
+  DFU_OP_START   = 0x01,
+  DFU_OP_ABORT   = 0x02,
+  DFU_OP_VERIFY  = 0x03,
+  DFU_OP_INSTALL = 0x04,
+  DFU_OP_ACK     = 0x80,
+} dfu_op_t;
+
+typedef enum {
+  DFU_STATUS_OK         = 0,
+  DFU_STATUS_BAD_STATE  = 1, // no transfer, or not complete, or not verified
+  DFU_STATUS_BAD_SIZE   = 2, // empty, larger than the slot, or a short command
+  DFU_STATUS_BUSY       = 3, // another connection is sending
+  DFU_STATUS_GAP        = 4, // data not at the expected offset, resend from there
+  DFU_STATUS_FLASH      = 5, // writing the slot failed; transfer dropped
+  DFU_STATUS_HASH       = 6, // SHA-256 differs; transfer dropped
+  DFU_STATUS_IMAGE      = 7, // the bootloader rejected the image
+  DFU_STATUS_NO_SLOT    = 8, // no bootloader with a storage slot
+} dfu_status_t;
+
+// Feed every Bluetooth event through here, from sl_bt_on_event().
+void dfu_on_event(sl_bt_msg_t *evt);
+
+// Send an answer that waited for a stack buffer; call from app_process_action().
+void dfu_process(void);
+
+#endif // DFU_H
@@ -0,0 +1,211 @@
+/***************************************************************************//**
+ * @file
+ * @brief dfu.c built for the host, for dfu_replay.py.
+ *
+ * dfu.c runs unchanged. The Bluetooth stack, the bootloader and NVM3 are the
+ * stand-ins in host/ and end up in the callbacks below, so the staging slot
+ * and NVM3 live in Python and outlive a reset. A reset is a fresh load of
+ * this library: everything dfu.c keeps in RAM starts over, as on the board.
+ *
+ *   gcc -O2 -shared -fPIC -Ihost -I. -o dfu_host.so dfu_host.c -lcrypto
+ *
+ * dfu_replay.py runs that itself.
+ ******************************************************************************/
+#include "dfu.c"
+
+// Set by dfu_replay.py through ctypes
+typedef struct {
+  int32_t (*erase_write)(uint32_t offset, const uint8_t *data, size_t length);
+  int32_t (*read)(uint32_t offset, uint8_t *data, size_t length);
+  int32_t (*verify)(void);                // bootloader_verifyImage()
+  void (*install)(void);                  // bootloader_rebootAndInstall()
+  sl_status_t (*notify)(uint8_t connection, const uint8_t *value, size_t length);
+  Ecode_t (*nvm_read)(nvm3_ObjectKey_t key, void *value, size_t length);
+  Ecode_t (*nvm_write)(nvm3_ObjectKey_t key, const void *value, size_t length);
+  void (*nvm_delete)(nvm3_ObjectKey_t key);
+  uint32_t (*ms)(void);
+} dfu_host_board_t;
+
+bool dfu_host_log = false;
+nvm3_Handle_t *nvm3_defaultHandle = NULL;
+
+static dfu_host_board_t board;
+static uint32_t board_slot_size;
+static uint16_t next_handle = 0x20;
+
+sl_status_t gatt_service_add(const uint8_t uuid[16],
+                             const gatt_service_char_t *chars, size_t num_chars)
+{
+  (void)uuid;
+  next_handle++; // the service declaration
+  for (size_t i = 0; i < num_chars; i++) {
+    // Declaration, value and, with notify, the CCCD
+    *chars[i].handle = next_handle + 1;
+    next_handle += chars[i].properties & SL_BT_GATTDB_CHARACTERISTIC_NOTIFY ? 3 : 2;
+  }
+  return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_gatt_server_send_notification(uint8_t connection, uint16_t characteristic,
+                                                size_t value_len, const uint8_t *value)
+{
+  (void)characteristic;
+  return board.notify(connection, value, value_len);
+}
+
+sl_status_t sl_bt_gatt_server_get_mtu(uint8_t connection, uint16_t *mtu)
+{
+  (void)connection;
+  *mtu = 247;
+  return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_connection_set_preferred_phy(uint8_t connection, uint8_t preferred_phy,
+                                               uint8_t accepted_phy)
+{
+  (void)connection;
+  (void)preferred_phy;
+  (void)accepted_phy;
+  return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_connection_set_data_length(uint8_t connection, uint16_t tx_data_len,
+                                             uint16_t tx_time_us)
+{
+  (void)connection;
+  (void)tx_data_len;
+  (void)tx_time_us;
+  return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_connection_close(uint8_t connection)
+{
+  // dfu_replay.py sends the closed event, as the stack would
+  (void)connection;
+  return SL_STATUS_OK;
+}
+
+int32_t bootloader_init(void)
+{
+  return BOOTLOADER_OK;
+}
+
+int32_t bootloader_getStorageSlotInfo(uint32_t slotId, BootloaderStorageSlot_t *slot)
+{
+  if (slotId != DFU_SLOT || board_slot_size == 0) {
+    return BOOTLOADER_ERROR_STORAGE_BASE;
+  }
+  slot->address = 0;
+  slot->length = board_slot_size;
+  return BOOTLOADER_OK;
+}
+
+int32_t bootloader_eraseWriteStorage(uint32_t slotId, uint32_t offset, uint8_t *buffer, size_t length)
+{
+  (void)slotId;
+  return board.erase_write(offset, buffer, length);
+}
+
+int32_t bootloader_readStorage(uint32_t slotId, uint32_t offset, uint8_t *buffer, size_t length)
+{
+  (void)slotId;
+  return board.read(offset, buffer, length);
+}
+
+int32_t bootloader_verifyImage(uint32_t slotId, BootloaderParserCallback_t metadataCallback)
+{
+  (void)slotId;
+  (void)metadataCallback;
+  return board.verify();
+}
+
+int32_t bootloader_setImageToBootload(int32_t slotId)
+{
+  (void)slotId;
+  return BOOTLOADER_OK;
+}
+
+void bootloader_rebootAndInstall(void)
+{
+  board.install();
+}
+
+Ecode_t nvm3_readData(nvm3_Handle_t *h, nvm3_ObjectKey_t key, void *value, size_t len)
+{
+  (void)h;
+  return board.nvm_read(key, value, len);
+}
+
+Ecode_t nvm3_writeData(nvm3_Handle_t *h, nvm3_ObjectKey_t key, const void *value, size_t len)
+{
+  (void)h;
+  return board.nvm_write(key, value, len);
+}
+
+Ecode_t nvm3_deleteObject(nvm3_Handle_t *h, nvm3_ObjectKey_t key)
+{
+  (void)h;
+  board.nvm_delete(key);
+  return ECODE_NVM3_OK;
+}
+
+uint32_t sl_sleeptimer_get_tick_count(void)
+{
+  return board.ms();
+}
+
+/***************************************************************************//**
+ * What dfu_replay.py calls: the events the stack would raise.
+ ******************************************************************************/
+void dfu_host_boot(const dfu_host_board_t *callbacks, uint32_t slot_length)
+{
+  sl_bt_msg_t evt = { .header = sl_bt_evt_system_boot_id };
+
+  board = *callbacks;
+  board_slot_size = slot_length;
+  dfu_on_event(&evt);
+}
+
+void dfu_host_subscribe(uint8_t conn, bool notify)
+{
+  sl_bt_msg_t evt = { .header = sl_bt_evt_gatt_server_characteristic_status_id };
+
+  evt.data.evt_gatt_server_characteristic_status.connection = conn;
+  evt.data.evt_gatt_server_characteristic_status.characteristic = control_handle;
+  evt.data.evt_gatt_server_characteristic_status.status_flags = sl_bt_gatt_server_client_config;
+  evt.data.evt_gatt_server_characteristic_status.client_config_flags =
+    notify ? sl_bt_gatt_notification : sl_bt_gatt_disable;
+  dfu_on_event(&evt);
+}
+
+void dfu_host_write(uint8_t conn, bool to_data, const uint8_t *value, size_t len)
+{
+  sl_bt_msg_t evt = { .header = sl_bt_evt_gatt_server_attribute_value_id };
+
+  if (len > sizeof(evt.data.evt_gatt_server_attribute_value.value.data)) {
+    return;
+  }
+  evt.data.evt_gatt_server_attribute_value.connection = conn;
+  evt.data.evt_gatt_server_attribute_value.attribute = to_data ? data_handle : control_handle;
+  evt.data.evt_gatt_server_attribute_value.value.len = (uint8_t)len;
+  memcpy(evt.data.evt_gatt_server_attribute_value.value.data, value, len);
+  dfu_on_event(&evt);
+}
+
+void dfu_host_close(uint8_t conn)
+{
+  sl_bt_msg_t evt = { .header = sl_bt_evt_connection_closed_id };
+
+  evt.data.evt_connection_closed.connection = conn;
+  dfu_on_event(&evt);
+}
+
+void dfu_host_process(void)
+{
+  dfu_process();
+}
+
+uint32_t dfu_host_received(void)
+{
+  return received;
+}
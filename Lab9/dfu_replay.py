@@ -0,0 +1,475 @@
+"""Replay the GATT firmware update protocol against dfu.c on the host.
+
+Board is dfu.c itself, built with dfu_host.c and the stand-ins in host/ for
+the Bluetooth stack, the bootloader and NVM3, and loaded through ctypes. The
+staging slot and NVM3 are kept here so they outlive a reset, which loads a
+fresh copy of the library. Host is what a phone or PC client does: START,
+data writes with at most two windows unacked, VERIFY. They talk over a
+modelled link, one connection event at a time, so every run also gives the
+update time for the image. Needs gcc and OpenSSL's libcrypto.
+
+Each scenario breaks the transfer a different way and checks that it still
+ends in a verified image, or fails the way it should:
+
+  clean        nothing goes wrong; INSTALL then reboots into the bootloader
+  disconnect   the link drops three times; START continues from RAM
+  reset        the board resets twice; START continues from NVM3, rehashed
+  stale        after a drop the host resends from its last ack, not from
+               what START said; the board answers GAP and the host rewinds
+  corrupt      one byte goes wrong on the host side; VERIFY reports HASH,
+               the host aborts and sends it all again
+  other-image  an update to another image comes in between; the first one
+               must start over, not trust progress the second overwrote
+  busy         a second connection sends START and ABORT mid-transfer and
+               gets BUSY; the first one carries on
+  rehash-fails after a reset a slot read fails part way through the rehash;
+               START must start over with a clean hash, sent once
+  no-buffers   every fifth notification finds the stack out of buffers and
+               goes out from dfu_process()
+  reset-at-end the board resets after the last byte, before VERIFY
+  not-gbl      right hash, but not a GBL file; the bootloader rejects it
+
+Then the full image time over a few link setups. The board logs the real
+figure ("DFU: ... bytes in ... ms") after VERIFY; --log shows dfu.c's lines.
+
+    python dfu_replay.py [--size-kib 256] [--interval-ms 15] [--per-event 6] [--log]
+"""
+import argparse
+import atexit
+import ctypes
+import hashlib
+import os
+import random
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+
+# Keep in sync with dfu.h
+OP_START, OP_ABORT, OP_VERIFY, OP_INSTALL, OP_ACK = 0x01, 0x02, 0x03, 0x04, 0x80
+OK, BAD_STATE, BAD_SIZE, BUSY, GAP, FLASH, HASH, IMAGE, NO_SLOT = range(9)
+WINDOW = 16
+MAX_DATA = 240
+FLASH_CHUNK = 1024
+NVM3_KEY = 0x0C43
+
+# Keep in sync with host/
+BOOTLOADER_OK, BOOTLOADER_ERROR = 0, 0x0400
+NO_MORE_RESOURCE = 0x19
+NVM3_KEY_NOT_FOUND = 0xF00E0016
+
+SLOT_SIZE = 472 * 1024
+GBL_TAG = bytes.fromhex("eb17a603")  # GBL header tag, what the bootloader parses first
+FLASH_PAGE = 8 * 1024
+PAGE_ERASE_MS = 12.0
+WORD_WRITE_US = 10.0
+
+LOG = False                           # dfu.c's app_log lines to stderr
+
+# dfu_host_board_t in dfu_host.c
+ERASE_WRITE = ctypes.CFUNCTYPE(ctypes.c_int32, ctypes.c_uint32, ctypes.c_void_p, ctypes.c_size_t)
+READ = ctypes.CFUNCTYPE(ctypes.c_int32, ctypes.c_uint32, ctypes.c_void_p, ctypes.c_size_t)
+VERIFY = ctypes.CFUNCTYPE(ctypes.c_int32)
+INSTALL = ctypes.CFUNCTYPE(None)
+NOTIFY = ctypes.CFUNCTYPE(ctypes.c_uint32, ctypes.c_uint8, ctypes.c_void_p, ctypes.c_size_t)
+NVM_READ = ctypes.CFUNCTYPE(ctypes.c_uint32, ctypes.c_uint32, ctypes.c_void_p, ctypes.c_size_t)
+NVM_WRITE = ctypes.CFUNCTYPE(ctypes.c_uint32, ctypes.c_uint32, ctypes.c_void_p, ctypes.c_size_t)
+NVM_DELETE = ctypes.CFUNCTYPE(None, ctypes.c_uint32)
+MS = ctypes.CFUNCTYPE(ctypes.c_uint32)
+
+
+class Callbacks(ctypes.Structure):
+    _fields_ = [("erase_write", ERASE_WRITE), ("read", READ), ("verify", VERIFY), ("install", INSTALL),
+                ("notify", NOTIFY), ("nvm_read", NVM_READ), ("nvm_write", NVM_WRITE),
+                ("nvm_delete", NVM_DELETE), ("ms", MS)]
+
+
+def build():
+    """dfu_host.c, that is dfu.c and the stand-ins in host/, as a shared library."""
+    here = os.path.dirname(os.path.abspath(__file__))
+    workdir = tempfile.mkdtemp(prefix="dfu_replay")
+    atexit.register(shutil.rmtree, workdir, True)
+    library = os.path.join(workdir, "dfu_host.so")
+    subprocess.run([os.environ.get("CC", "gcc"), "-O2", "-shared", "-fPIC",
+                    "-I" + os.path.join(here, "host"), "-I" + here, "-o", library,
+                    os.path.join(here, "dfu_host.c"), "-lcrypto"], check=True)
+    return library
+
+
+class Board:
+    """dfu.c itself, from build(); the staging slot and NVM3 are kept here."""
+
+    boots = 0
+
+    def __init__(self, library):
+        self.library = library
+        self.slot = bytearray(b"\xff" * SLOT_SIZE)
+        self.nvm = {}
+        self.flash_ms = 0.0
+        self.now_ms = 0
+        self.bad_read_from = None     # a slot read from this offset on fails, once
+        self.refuse_every = 0         # every n-th notification finds no stack buffer
+        self.notifications = 0
+        self.installed = False
+        self.boot()
+
+    def boot(self):
+        """Reset: a fresh load of dfu.c, so RAM is gone; the slot and NVM3 stay."""
+        Board.boots += 1
+        path = f"{self.library[:-3]}.{Board.boots}.so"
+        shutil.copyfile(self.library, path)
+        self.lib = ctypes.CDLL(path)
+        self.lib.dfu_host_write.argtypes = [ctypes.c_uint8, ctypes.c_bool, ctypes.c_char_p, ctypes.c_size_t]
+        self.lib.dfu_host_received.restype = ctypes.c_uint32
+        ctypes.c_bool.in_dll(self.lib, "dfu_host_log").value = LOG
+        # Kept here so ctypes does not free them while dfu.c holds them
+        self.callbacks = Callbacks(ERASE_WRITE(self.erase_write), READ(self.read), VERIFY(self.verify),
+                                   INSTALL(self.install), NOTIFY(self.notify), NVM_READ(self.nvm_read),
+                                   NVM_WRITE(self.nvm_write), NVM_DELETE(self.nvm_delete), MS(self.ms))
+        self.out = {}                 # connection: control notifications not yet read
+        self.lib.dfu_host_boot(ctypes.byref(self.callbacks), SLOT_SIZE)
+
+    # What the host side of the library calls
+
+    def erase_write(self, offset, data, length):
+        self.slot[offset : offset + length] = ctypes.string_at(data, length)
+        # Pages are erased as the writes run into them
+        start_page = offset // FLASH_PAGE
+        end_page = (offset + length - 1) // FLASH_PAGE
+        erased = end_page - start_page + (offset % FLASH_PAGE == 0)
+        self.flash_ms += erased * PAGE_ERASE_MS + length // 4 * WORD_WRITE_US / 1000
+        return BOOTLOADER_OK
+
+    def read(self, offset, data, length):
+        if self.bad_read_from is not None and offset >= self.bad_read_from:
+            self.bad_read_from = None
+            return BOOTLOADER_ERROR
+        ctypes.memmove(data, bytes(self.slot[offset : offset + length]), length)
+        return BOOTLOADER_OK
+
+    def verify(self):
+        return BOOTLOADER_OK if self.slot.startswith(GBL_TAG) else BOOTLOADER_ERROR
+
+    def install(self):
+        self.installed = True
+
+    def notify(self, conn, value, length):
+        self.notifications += 1
+        if self.refuse_every and self.notifications % self.refuse_every == 0:
+            return NO_MORE_RESOURCE
+        self.out.setdefault(conn, []).append(struct.unpack("<BBII", ctypes.string_at(value, length)))
+        return 0
+
+    def nvm_read(self, key, value, length):
+        if key not in self.nvm:
+            return NVM3_KEY_NOT_FOUND
+        ctypes.memmove(value, self.nvm[key], min(length, len(self.nvm[key])))
+        return 0
+
+    def nvm_write(self, key, value, length):
+        self.nvm[key] = ctypes.string_at(value, length)
+        return 0
+
+    def nvm_delete(self, key):
+        self.nvm.pop(key, None)
+
+    def ms(self):
+        return int(self.now_ms) & 0xFFFFFFFF
+
+    # The stack's events
+
+    def subscribe(self, conn):
+        self.lib.dfu_host_subscribe(conn, True)
+
+    def write(self, conn, value, data=False):
+        self.lib.dfu_host_write(conn, data, value, len(value))
+
+    def close(self, conn):
+        self.lib.dfu_host_close(conn)
+
+    def process(self):
+        self.lib.dfu_host_process()
+
+    def take(self, conn):
+        """Notifications sent to conn since the last take."""
+        return self.out.pop(conn, [])
+
+    @property
+    def received(self):
+        return self.lib.dfu_host_received()
+
+
+class Link:
+    """What one connection event carries, from the link setup."""
+
+    def __init__(self, phy_mbps, mtu, ll_len, interval_ms, per_event):
+        self.interval_ms = interval_ms
+        us_per_byte = 8 / phy_mbps
+        overhead = 10 if phy_mbps == 1 else 11   # preamble, address, header, CRC
+        self.data_per_write = min(mtu - 3, 4 + MAX_DATA) - 4
+        write = self.data_per_write + 4 + 3 + 4  # offset, ATT and L2CAP headers
+        self.fragments = -(-write // ll_len)
+        # Each packet is answered by an empty one, 150 us apart
+        packet_us = (min(write, ll_len) + 2 * overhead) * us_per_byte + 300
+        by_air = int(interval_ms * 1000 * 0.9 // packet_us)
+        self.packets_per_event = max(1, min(by_air, per_event))
+
+
+class Host:
+    def __init__(self, board, link, image, trust_start=True, flip_at=None, conn=1):
+        self.board, self.link, self.image = board, link, image
+        self.trust_start = trust_start
+        self.flip_at = flip_at
+        self.conn = conn
+        self.connected = False
+        self.sha256 = hashlib.sha256(image).digest()
+        self.sent = 0
+        self.events = 0
+        self.reconnects = 0
+        self.acked = 0
+
+    def connect(self):
+        """Connect and turn on control notifications; pairing is not modelled."""
+        if not self.connected:
+            self.board.subscribe(self.conn)
+            self.connected = True
+
+    def drop(self, fault):
+        if fault == "reset":
+            self.board.boot()
+        elif fault == "disconnect":
+            self.board.close(self.conn)
+        else:
+            return
+        self.connected = False
+
+    def request(self, op, payload=b""):
+        self.connect()
+        self.board.now_ms = self.time_ms()
+        self.board.take(self.conn)
+        self.board.write(self.conn, bytes([op]) + payload)
+        self.events += 2   # write request, then the notification
+        answers = self.board.take(self.conn)
+        if not answers:
+            # Held for a stack buffer, it goes out on the next main loop pass
+            self.board.process()
+            answers = self.board.take(self.conn)
+        if not answers:
+            raise AssertionError(f"no answer to {op:#04x}")
+        return answers[0]
+
+    def start(self):
+        return self.request(OP_START, struct.pack("<I", len(self.image)) + self.sha256)
+
+    def send_all(self, faults):
+        """START and stream until acked to the end; the fault that cut it short, if any."""
+        _, status, offset, window = self.start()
+        if status != OK:
+            raise AssertionError(f"START failed with status {status}")
+        if self.trust_start:
+            self.acked = offset
+        nxt = self.acked
+        budget = 0
+        idle = 0
+        rewound = None
+        while self.acked < len(self.image):
+            self.events += 1
+            self.board.process()
+            self.board.now_ms = self.time_ms()
+            # Writes split over several link-layer packets carry over to the next event
+            budget += self.link.packets_per_event
+            queued = []
+            while budget >= self.link.fragments:
+                if nxt >= len(self.image) or nxt - self.acked >= 2 * window * self.link.data_per_write:
+                    budget = min(budget, self.link.fragments)
+                    break
+                piece = bytearray(self.image[nxt : nxt + self.link.data_per_write])
+                if self.flip_at is not None and nxt <= self.flip_at < nxt + len(piece):
+                    piece[self.flip_at - nxt] ^= 0x55
+                    self.flip_at = None
+                queued.append(struct.pack("<I", nxt) + bytes(piece))
+                self.sent += len(piece)
+                nxt += len(piece)
+                budget -= self.link.fragments
+            # A fault loses whatever of this event had not reached the board yet
+            for write in queued + [None]:
+                due = [p for p in faults if p <= self.board.received]
+                if due:
+                    fault = faults.pop(min(due))
+                    self.drop(fault)
+                    return fault
+                if write is not None:
+                    self.board.write(self.conn, write, data=True)
+            # Notifications come back at the end of the event
+            before = self.acked
+            for op, status, offset, _ in self.board.take(self.conn):
+                if op != OP_ACK:
+                    continue
+                if status == GAP:
+                    # Writes sent before the last rewind draw a GAP of their
+                    # own; if that offset has been sent again since, ignore it
+                    if rewound is None or not rewound <= offset < nxt:
+                        nxt = rewound = offset
+                    self.acked = offset
+                elif status == OK:
+                    self.acked = max(self.acked, offset)
+                    nxt = max(nxt, self.acked)
+            idle = idle + 1 if self.acked == before else 0
+            if idle > 4 * window:
+                raise AssertionError(f"stalled at {self.acked}")
+        return None
+
+    def update(self, faults):
+        """The whole update, reconnecting as often as it takes."""
+        faults = dict(faults)
+        for _ in range(20):
+            fault = self.send_all(faults)
+            if fault is None:
+                _, status, _, _ = self.request(OP_VERIFY)
+                if status == HASH:
+                    self.request(OP_ABORT)
+                    self.acked = 0
+                    continue
+                return status
+            self.reconnects += 1
+        raise AssertionError("no progress after 20 connections")
+
+    def time_ms(self):
+        return self.events * self.link.interval_ms + self.board.flash_ms
+
+
+def points(size, n, seed):
+    rng = random.Random(seed)
+    return sorted(rng.sample(range(1, size), n))
+
+
+def run(name, image, library, link, seed):
+    board = Board(library)
+    size = len(image)
+    expect = OK
+
+    if name == "clean":
+        host = Host(board, link, image)
+        status = host.update({})
+        if status == OK:
+            if host.request(OP_INSTALL)[1] != OK:
+                raise AssertionError("INSTALL refused after VERIFY")
+            board.close(host.conn)
+            if not board.installed or NVM3_KEY in board.nvm:
+                raise AssertionError("no reboot into the bootloader after INSTALL")
+    elif name in ("disconnect", "reset", "stale"):
+        kind = "reset" if name == "reset" else "disconnect"
+        count = 2 if name == "reset" else 3
+        # Each fault hits once the board has received that far
+        at = {p: kind for p in points(size, count, seed)}
+        host = Host(board, link, image, trust_start=name != "stale")
+        status = host.update(at)
+    elif name == "corrupt":
+        host = Host(board, link, image, flip_at=points(size, 1, seed)[0])
+        status = host.update({})
+    elif name == "other-image":
+        half = size // 2
+        other = GBL_TAG + os.urandom(size - len(GBL_TAG))
+        Host(board, link, image).send_all({half: "disconnect"})
+        Host(board, link, other).send_all({half // 2: "disconnect"})
+        board.boot()
+        host = Host(board, link, image)
+        _, _, offset, _ = host.start()
+        if offset != 0:
+            raise AssertionError(f"took over progress of another image at {offset}")
+        status = host.update({})
+    elif name == "busy":
+        host = Host(board, link, image)
+        host.send_all({size // 2: "pause"})
+        other = Host(board, link, GBL_TAG + os.urandom(size - len(GBL_TAG)), conn=2)
+        for op, answer in (("START", other.start()), ("ABORT", other.request(OP_ABORT))):
+            if answer[1] != BUSY:
+                raise AssertionError(f"{op} from another connection answered {answer[1]} mid-transfer")
+        status = host.update({})
+    elif name == "rehash-fails":
+        Host(board, link, image).send_all({size // 2: "reset"})
+        board.bad_read_from = FLASH_CHUNK
+        host = Host(board, link, image)
+        status = host.update({})
+        if board.bad_read_from is not None:
+            raise AssertionError("START did not rehash the slot")
+        if host.sent != size:
+            raise AssertionError(f"sent {host.sent} of {size} bytes: the hash kept what the rehash read")
+    elif name == "no-buffers":
+        board.refuse_every = 5
+        host = Host(board, link, image)
+        status = host.update({})
+    elif name == "reset-at-end":
+        host = Host(board, link, image)
+        host.update({size: "reset"})
+        if board.received != size:
+            raise AssertionError("board did not come back with the whole image")
+        status = host.request(OP_VERIFY)[1]
+    elif name == "not-gbl":
+        image = b"\x00" * 4 + image[4:]
+        host = Host(board, link, image)
+        status = host.update({})
+        expect = IMAGE
+    else:
+        raise ValueError(name)
+
+    if status != expect:
+        raise AssertionError(f"VERIFY status {status}, expected {expect}")
+    if expect == OK and bytes(board.slot[:size]) != image:
+        raise AssertionError("slot differs from the image")
+    return host
+
+
+SCENARIOS = ["clean", "disconnect", "reset", "stale", "corrupt", "other-image", "busy", "rehash-fails",
+             "no-buffers", "reset-at-end", "not-gbl"]
+
+SETUPS = [
+    # name, PHY Mbit/s, ATT MTU, link-layer payload
+    ("1M, MTU 23, 27 B", 1, 23, 27),
+    ("1M, MTU 247, 27 B", 1, 247, 27),
+    ("1M, MTU 247, 251 B", 1, 247, 251),
+    ("2M, MTU 247, 251 B", 2, 247, 251),
+]
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--size-kib", type=int, default=256)
+    parser.add_argument("--interval-ms", type=float, default=15)
+    parser.add_argument("--per-event", type=int, default=6, help="link-layer packets the central allows per event")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--log", action="store_true", help="dfu.c's log lines to stderr")
+    args = parser.parse_args()
+    LOG = args.log
+    library = build()
+
+    random.seed(args.seed)
+    image = GBL_TAG + random.randbytes(args.size_kib * 1024 - len(GBL_TAG))
+    link = Link(2, 247, 251, args.interval_ms, args.per_event)
+
+    failed = 0
+    print(f"{'scenario':<13} {'result':<7} {'sent KiB':>9} {'resent':>7} {'connections':>12} {'time s':>7}")
+    for name in SCENARIOS:
+        try:
+            host = run(name, image, library, link, args.seed)
+            result = "ok"
+        except AssertionError as e:
+            failed += 1
+            print(f"{name:<13} FAILED  {e}")
+            continue
+        resent = host.sent / len(image) - 1
+        print(f"{name:<13} {result:<7} {host.sent / 1024:>9.0f} {resent:>6.0%} "
+              f"{host.reconnects + 1:>12} {host.time_ms() / 1000:>7.1f}")
+
+    print(f"\n{args.size_kib} KiB image, {args.interval_ms:g} ms interval, "
+          f"{args.per_event} packets per event at most:")
+    print(f"{'link':<20} {'packets/event':>14} {'kB/s':>7} {'time s':>7}")
+    for name, phy, mtu, ll_len in SETUPS:
+        setup = Link(phy, mtu, ll_len, args.interval_ms, args.per_event)
+        host = Host(Board(library), setup, image)
+        host.update({})
+        ms = host.time_ms()
+        print(f"{name:<20} {setup.packets_per_event:>14} {len(image) / ms:>7.1f} {ms / 1000:>7.1f}")
+
+    sys.exit(1 if failed else 0)
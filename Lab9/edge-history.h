@@ -0,0 +1,51 @@
+/***************************************************************************//**
+ * @file
+ * @brief Button edge history characteristic.
+ *
+ * Notifications carry every edge, not just the latest state:
+ *
+ *   u16 seq         index of the first edge; a gap means edges were lost
+ *   u32 tick        sl_sleeptimer tick of the first edge
+ *   u16 edge[n]     bit 15 = pin level, bits 14..0 = ticks since the
+ *                   previous edge (0 for the first, saturates at 0x7fff)
+ *
+ * All little-endian. n fills the ATT MTU of the connection. Edges go to one
+ * subscriber, the connection that most recently enabled notifications.
+ *
+ * Writing u16 count, u16 interval_us fires count software edges on the
+ * button interrupt, interval_us apart, and logs what was delivered.
+ ******************************************************************************/
+#ifndef EDGE_HISTORY_H
+#define EDGE_HISTORY_H
+
+#include <stdint.h>
+#include "sl_bluetooth.h"
+#include "edge-ring.h"
+
+#define EDGE_HISTORY_UUID_SERVICE 0x0100
+#define EDGE_HISTORY_UUID_EDGES   0x0101
+
+#define EDGE_HISTORY_MAX_MTU      247
+#define EDGE_HISTORY_MAX_PENDING  128
+// A partly filled notification waits this long for more edges
+#define EDGE_HISTORY_HOLD_MS      10
+#define EDGE_HISTORY_SIGNAL       (1UL << 2) // sl_bt_external_signal() bit
+
+/**************************************************************************//**
+ * int_mask is the GPIO interrupt flag of the button, for synthetic bursts.
+ *****************************************************************************/
+void edge_history_init(uint32_t int_mask);
+
+// Feed every Bluetooth event through here, from sl_bt_on_event().
+void edge_history_on_event(sl_bt_msg_t *evt);
+
+// Queue one edge drained from the ring.
+void edge_history_add(const edge_event_t *ev);
+
+/**************************************************************************//**
+ * Send whatever fits, from app_process_action(). Stops while the stack is
+ * out of buffers and carries on from there the next time round.
+ *****************************************************************************/
+void edge_history_process(void);
+
+#endif // EDGE_HISTORY_H
@@ -0,0 +1,90 @@
+/***************************************************************************//**
+ * @file
+ * @brief Button edges from the GPIO interrupt to the main loop.
+ ******************************************************************************/
+#include "em_core.h"
+#include "sl_sleeptimer.h"
+
+#include "edge-ring.h"
+
+// Free-running indices: head is written only by the ISR, tail only by the
+// main loop, so neither side needs to mask interrupts.
+static edge_event_t ring[EDGE_RING_SIZE];
+static volatile uint32_t head = 0;
+static volatile uint32_t tail = 0;
+// Latest level the ISR read, published even when the ring is full
+static volatile uint8_t last_state;
+
+static edge_ring_stats_t stats;
+
+void edge_ring_init(uint8_t initial_state)
+{
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  CORE_DECLARE_IRQ_STATE;
+  CORE_ENTER_ATOMIC();
+  head = 0;
+  tail = 0;
+  last_state = initial_state;
+  stats = (edge_ring_stats_t){ 0 };
+  CORE_EXIT_ATOMIC();
+}
+
+void edge_ring_push(uint8_t state)
+{
+  // Each interrupt is one edge, so reading back the level we already had
+  // means the pin went and came back before we got here.
+  if (state == last_state) {
+    stats.missed++;
+  }
+  last_state = state;
+
+  uint32_t h = head;
+  if (h - tail == EDGE_RING_SIZE) {
+    stats.lost++;
+    return;
+  }
+  ring[h % EDGE_RING_SIZE].tick = sl_sleeptimer_get_tick_count();
+  ring[h % EDGE_RING_SIZE].state = state;
+  __DMB(); // the slot must be visible before the new head
+  head = h + 1;
+  stats.edges++;
+}
+
+void edge_ring_isr_done(uint32_t start_cycles)
+{
+  uint32_t cycles = DWT->CYCCNT - start_cycles;
+  stats.isr_count++;
+  stats.isr_total_cycles += cycles;
+  if (cycles > stats.isr_max_cycles) {
+    stats.isr_max_cycles = cycles;
+  }
+}
+
+uint8_t edge_ring_level(void)
+{
+  return last_state;
+}
+
+bool edge_ring_pop(edge_event_t *ev)
+{
+  uint32_t t = tail;
+  if (t == head) {
+    return false;
+  }
+  __DMB(); // read the slot only after seeing the head that published it
+  *ev = ring[t % EDGE_RING_SIZE];
+  __DMB();
+  tail = t + 1;
+  return true;
+}
+
+void edge_ring_get_stats(edge_ring_stats_t *out)
+{
+  CORE_DECLARE_IRQ_STATE;
+  CORE_ENTER_ATOMIC();
+  *out = stats;
+  CORE_EXIT_ATOMIC();
+}
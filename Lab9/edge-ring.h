@@ -0,0 +1,62 @@
+/***************************************************************************//**
+ * @file
+ * @brief Button edges from the GPIO interrupt to the main loop.
+ ******************************************************************************/
+#ifndef EDGE_RING_H
+#define EDGE_RING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "em_device.h"
+
+#define EDGE_RING_SIZE 32 // power of two
+
+typedef struct {
+  uint32_t tick;  // sl_sleeptimer tick when the interrupt ran
+  uint8_t state;  // pin level read in the interrupt
+} edge_event_t;
+
+typedef struct {
+  uint32_t edges;         // pushed into the ring
+  uint32_t lost;          // ring was full
+  uint32_t missed;        // pin read back unchanged: it bounced back before the ISR ran
+  uint32_t isr_count;
+  uint32_t isr_max_cycles;
+  uint64_t isr_total_cycles;
+} edge_ring_stats_t;
+
+/**************************************************************************//**
+ * Reset the ring and start the DWT cycle counter used to time the ISR.
+ * initial_state is the pin level now, for telling missed edges apart.
+ *****************************************************************************/
+void edge_ring_init(uint8_t initial_state);
+
+// Cycle count to pass to edge_ring_isr_done(); read it first thing in the ISR.
+static inline uint32_t edge_ring_cycles(void)
+{
+  return DWT->CYCCNT;
+}
+
+/**************************************************************************//**
+ * Interrupt side (the single producer). Timestamps state and queues it, or
+ * counts it as lost when the main loop has fallen EDGE_RING_SIZE behind.
+ *****************************************************************************/
+void edge_ring_push(uint8_t state);
+
+// Record the ISR's execution time, from the edge_ring_cycles() taken on entry.
+void edge_ring_isr_done(uint32_t start_cycles);
+
+/**************************************************************************//**
+ * Main loop side (the single consumer). Returns false once the ring is empty.
+ *****************************************************************************/
+bool edge_ring_pop(edge_event_t *ev);
+
+/**************************************************************************//**
+ * Pin level from the most recent interrupt. Unlike the popped events it also
+ * covers edges that were lost to a full ring, so report this once settled.
+ *****************************************************************************/
+uint8_t edge_ring_level(void);
+
+void edge_ring_get_stats(edge_ring_stats_t *stats);
+
+#endif // EDGE_RING_H
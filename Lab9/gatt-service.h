@@ -0,0 +1,43 @@
+/***************************************************************************//**
+ * @file
+ * @brief Custom GATT services added to the dynamic database at boot.
+ ******************************************************************************/
+#ifndef GATT_SERVICE_H
+#define GATT_SERVICE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sl_status.h"
+
+// 128-bit UUIDs a7c3<id>-5e2b-4d8e-9f3a-2b1e5c7d9f10, in the little-endian
+// byte order the stack expects. Services use 0xNN00, their characteristics
+// 0xNN01 and up.
+#define GATT_SERVICE_UUID(id)                                    \
+  { 0x10, 0x9f, 0x7d, 0x5c, 0x1e, 0x2b, 0x3a, 0x9f, 0x8e, 0x4d, \
+    0x2b, 0x5e, (uint8_t)((id) & 0xff), (uint8_t)((id) >> 8), 0xc3, 0xa7 }
+
+typedef struct {
+  uint8_t uuid[16];
+  uint16_t properties; // SL_BT_GATTDB_CHARACTERISTIC_* flags
+  uint16_t security;   // SL_BT_GATTDB_ENCRYPTED_WRITE etc., 0 for an open link
+  uint16_t maxlen;
+  uint16_t *handle;    // receives the characteristic handle
+} gatt_service_char_t;
+
+/**************************************************************************//**
+ * Add a primary service and its characteristics in one database session.
+ * Values are variable length and kept by the stack, so writes arrive as
+ * sl_bt_evt_gatt_server_attribute_value_id carrying the written bytes.
+ * Notify and indicate get a CCCD automatically. Call after system boot.
+ *****************************************************************************/
+sl_status_t gatt_service_add(const uint8_t uuid[16],
+                             const gatt_service_char_t *chars, size_t num_chars);
+
+/**************************************************************************//**
+ * Hash of everything gatt_service_add() has added since reset. Services are
+ * added in the same order on every boot, so handles and the database stay
+ * the same and this only changes when a firmware update changes them.
+ *****************************************************************************/
+uint32_t gatt_service_fingerprint(void);
+
+#endif // GATT_SERVICE_H
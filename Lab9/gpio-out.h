@@ -0,0 +1,53 @@
+/***************************************************************************//**
+ * @file
+ * @brief Several output pins set from one GATT write.
+ *
+ * Writes to the outputs characteristic, with or without response:
+ *
+ *   u8 mask         outputs to change, bit n = output n
+ *   u8 level[k]     one per set bit, lowest first: 0 = off, 100 = full on,
+ *                   1..99 = PWM on outputs that have a timer channel
+ *
+ * Outputs without a channel are on for any level above 0.
+ ******************************************************************************/
+#ifndef GPIO_OUT_H
+#define GPIO_OUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sl_bluetooth.h"
+
+#define GPIO_OUT_UUID_SERVICE 0x0300
+#define GPIO_OUT_UUID_OUTPUTS 0x0301
+
+#define GPIO_OUT_COUNT        4   // output 0 is the LED on PA4
+#define GPIO_OUT_PWM_CHANNELS 3   // outputs 0..2 on TIMER0 CC0..CC2
+#define GPIO_OUT_PWM_FREQ_HZ  1000
+#define GPIO_OUT_STATS_INTERVAL_MS 10000
+
+/**************************************************************************//**
+ * Configure the pins and start the PWM timer with every output off.
+ *****************************************************************************/
+void gpio_out_init(void);
+
+// Feed every Bluetooth event through here, from sl_bt_on_event().
+void gpio_out_on_event(sl_bt_msg_t *evt);
+
+// Set one output, 0..100 %.
+void gpio_out_set(uint8_t index, uint8_t level);
+
+// Level last set on an output, 0..100 %.
+uint8_t gpio_out_get(uint8_t index);
+
+/**************************************************************************//**
+ * Apply a mask + levels record as described above.
+ * Returns false if it is malformed, in which case nothing is changed.
+ *****************************************************************************/
+bool gpio_out_apply(const uint8_t *value, size_t len);
+
+// Log the update rate since the last call, at most every
+// GPIO_OUT_STATS_INTERVAL_MS; call from app_process_action().
+void gpio_out_log_stats(void);
+
+#endif // GPIO_OUT_H
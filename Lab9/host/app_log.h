@@ -0,0 +1,14 @@
+// Host stand-in for the app log: to stderr when dfu_host_log is set
+#ifndef HOST_APP_LOG_H
+#define HOST_APP_LOG_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+extern bool dfu_host_log;
+
+#define app_log(...) \
+  do { if (dfu_host_log) { fprintf(stderr, __VA_ARGS__); } } while (0)
+#define app_log_warning(...) app_log(__VA_ARGS__)
+
+#endif // HOST_APP_LOG_H
@@ -0,0 +1,28 @@
+// Host stand-in for the bootloader interface; dfu_host.c keeps the slot in
+// dfu_replay.py
+#ifndef HOST_BTL_INTERFACE_H
+#define HOST_BTL_INTERFACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BOOTLOADER_OK                 0
+#define BOOTLOADER_ERROR_INIT_BASE    0x0100
+#define BOOTLOADER_ERROR_STORAGE_BASE 0x0400
+
+typedef struct {
+  uint32_t address;
+  uint32_t length;
+} BootloaderStorageSlot_t;
+
+typedef void (*BootloaderParserCallback_t)(uint32_t address, uint8_t *data, size_t length, void *context);
+
+int32_t bootloader_init(void);
+int32_t bootloader_getStorageSlotInfo(uint32_t slotId, BootloaderStorageSlot_t *slot);
+int32_t bootloader_eraseWriteStorage(uint32_t slotId, uint32_t offset, uint8_t *buffer, size_t length);
+int32_t bootloader_readStorage(uint32_t slotId, uint32_t offset, uint8_t *buffer, size_t length);
+int32_t bootloader_verifyImage(uint32_t slotId, BootloaderParserCallback_t metadataCallback);
+int32_t bootloader_setImageToBootload(int32_t slotId);
+void bootloader_rebootAndInstall(void);
+
+#endif // HOST_BTL_INTERFACE_H
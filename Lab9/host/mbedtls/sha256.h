@@ -0,0 +1,41 @@
+// Host stand-in for the mbedTLS header, backed by OpenSSL (link with -lcrypto)
+#ifndef HOST_MBEDTLS_SHA256_H
+#define HOST_MBEDTLS_SHA256_H
+
+#define OPENSSL_SUPPRESS_DEPRECATED
+#include <openssl/sha.h>
+
+typedef SHA256_CTX mbedtls_sha256_context;
+
+static inline void mbedtls_sha256_init(mbedtls_sha256_context *ctx)
+{
+  (void)ctx;
+}
+
+static inline void mbedtls_sha256_free(mbedtls_sha256_context *ctx)
+{
+  (void)ctx;
+}
+
+static inline void mbedtls_sha256_clone(mbedtls_sha256_context *dst, const mbedtls_sha256_context *src)
+{
+  *dst = *src;
+}
+
+static inline int mbedtls_sha256_starts(mbedtls_sha256_context *ctx, int is224)
+{
+  (void)is224;
+  return SHA256_Init(ctx) == 1 ? 0 : -1;
+}
+
+static inline int mbedtls_sha256_update(mbedtls_sha256_context *ctx, const unsigned char *input, size_t ilen)
+{
+  return SHA256_Update(ctx, input, ilen) == 1 ? 0 : -1;
+}
+
+static inline int mbedtls_sha256_finish(mbedtls_sha256_context *ctx, unsigned char output[32])
+{
+  return SHA256_Final(output, ctx) == 1 ? 0 : -1;
+}
+
+#endif // HOST_MBEDTLS_SHA256_H
@@ -0,0 +1,22 @@
+// Host stand-in for the NVM3 default instance; dfu_host.c keeps the objects
+// in dfu_replay.py so they outlive a reset
+#ifndef HOST_NVM3_DEFAULT_H
+#define HOST_NVM3_DEFAULT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint32_t Ecode_t;
+typedef uint32_t nvm3_ObjectKey_t;
+typedef struct nvm3_Handle nvm3_Handle_t;
+
+#define ECODE_NVM3_OK                 0
+#define ECODE_NVM3_ERR_KEY_NOT_FOUND  0xf00e0016
+
+extern nvm3_Handle_t *nvm3_defaultHandle;
+
+Ecode_t nvm3_readData(nvm3_Handle_t *h, nvm3_ObjectKey_t key, void *value, size_t len);
+Ecode_t nvm3_writeData(nvm3_Handle_t *h, nvm3_ObjectKey_t key, const void *value, size_t len);
+Ecode_t nvm3_deleteObject(nvm3_Handle_t *h, nvm3_ObjectKey_t key);
+
+#endif // HOST_NVM3_DEFAULT_H
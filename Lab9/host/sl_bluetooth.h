@@ -0,0 +1,89 @@
+// Host stand-in for the Bluetooth stack API: the events and commands dfu.c
+// uses. dfu_host.c provides the commands.
+#ifndef HOST_SL_BLUETOOTH_H
+#define HOST_SL_BLUETOOTH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sl_status.h"
+
+#define SL_BT_MSG_ID(header) ((header) & 0xffff00f8)
+
+#define sl_bt_evt_system_boot_id                         0x000100a0
+#define sl_bt_evt_connection_closed_id                   0x010600a0
+#define sl_bt_evt_connection_phy_status_id               0x040600a0
+#define sl_bt_evt_connection_data_length_id              0x070600a0
+#define sl_bt_evt_gatt_server_attribute_value_id         0x000a00a0
+#define sl_bt_evt_gatt_server_characteristic_status_id   0x030a00a0
+
+#define SL_BT_GATTDB_CHARACTERISTIC_READ               0x0002
+#define SL_BT_GATTDB_CHARACTERISTIC_WRITE_NO_RESPONSE  0x0004
+#define SL_BT_GATTDB_CHARACTERISTIC_WRITE              0x0008
+#define SL_BT_GATTDB_CHARACTERISTIC_NOTIFY             0x0010
+#define SL_BT_GATTDB_ENCRYPTED_WRITE                   0x0002
+
+typedef enum {
+  sl_bt_gap_phy_1m = 0x1,
+  sl_bt_gap_phy_2m = 0x2,
+} sl_bt_gap_phy_t;
+
+typedef enum {
+  sl_bt_gatt_server_client_config = 0x1,
+} sl_bt_gatt_server_characteristic_status_flag_t;
+
+typedef enum {
+  sl_bt_gatt_disable      = 0x0,
+  sl_bt_gatt_notification = 0x1,
+  sl_bt_gatt_indication   = 0x2,
+} sl_bt_gatt_client_config_flag_t;
+
+typedef struct {
+  uint8_t len;
+  uint8_t data[255];
+} uint8array;
+
+typedef struct {
+  uint32_t header;
+  union {
+    struct {
+      uint16_t reason;
+      uint8_t connection;
+    } evt_connection_closed;
+    struct {
+      uint8_t connection;
+      uint8_t phy;
+    } evt_connection_phy_status;
+    struct {
+      uint8_t connection;
+      uint16_t tx_data_len;
+      uint16_t tx_time_us;
+      uint16_t rx_data_len;
+      uint16_t rx_time_us;
+    } evt_connection_data_length;
+    struct {
+      uint8_t connection;
+      uint16_t characteristic;
+      uint8_t status_flags;
+      uint16_t client_config_flags;
+    } evt_gatt_server_characteristic_status;
+    struct {
+      uint8_t connection;
+      uint16_t attribute;
+      uint8_t att_opcode;
+      uint16_t offset;
+      uint8array value;
+    } evt_gatt_server_attribute_value;
+  } data;
+} sl_bt_msg_t;
+
+sl_status_t sl_bt_gatt_server_send_notification(uint8_t connection, uint16_t characteristic,
+                                                size_t value_len, const uint8_t *value);
+sl_status_t sl_bt_gatt_server_get_mtu(uint8_t connection, uint16_t *mtu);
+sl_status_t sl_bt_connection_set_preferred_phy(uint8_t connection, uint8_t preferred_phy,
+                                               uint8_t accepted_phy);
+sl_status_t sl_bt_connection_set_data_length(uint8_t connection, uint16_t tx_data_len,
+                                             uint16_t tx_time_us);
+sl_status_t sl_bt_connection_close(uint8_t connection);
+
+#endif // HOST_SL_BLUETOOTH_H
@@ -0,0 +1,14 @@
+// Host stand-in for the sleeptimer: one tick is one ms of dfu_replay.py's clock
+#ifndef HOST_SL_SLEEPTIMER_H
+#define HOST_SL_SLEEPTIMER_H
+
+#include <stdint.h>
+
+uint32_t sl_sleeptimer_get_tick_count(void);
+
+static inline uint32_t sl_sleeptimer_tick_to_ms(uint32_t tick)
+{
+  return tick;
+}
+
+#endif // HOST_SL_SLEEPTIMER_H
@@ -0,0 +1,13 @@
+// Host stand-in for the Gecko SDK header
+#ifndef HOST_SL_STATUS_H
+#define HOST_SL_STATUS_H
+
+#include <stdint.h>
+
+typedef uint32_t sl_status_t;
+
+#define SL_STATUS_OK                0x0000
+#define SL_STATUS_FAIL              0x0001
+#define SL_STATUS_NO_MORE_RESOURCE  0x0019
+
+#endif // HOST_SL_STATUS_H
@@ -0,0 +1,98 @@
+/***************************************************************************//**
+ * @file
+ * @brief Fast reconnection for bonded peers.
+ ******************************************************************************/
+#include "nvm3_default.h"
+#include "gatt_db.h"
+#include "app_log.h"
+
+#include "gatt-service.h"
+#include "conn-table.h"
+#include "reconnect.h"
+
+static uint32_t aware = 0; // bit n: bond n has seen the current database
+
+static void save_aware(void)
+{
+  nvm3_writeData(nvm3_defaultHandle, RECONNECT_NVM3_KEY_AWARE, &aware, sizeof(aware));
+}
+
+static void check_database(void)
+{
+  uint32_t fingerprint = gatt_service_fingerprint();
+  uint32_t saved;
+
+#if !defined(gattdb_database_hash) || !defined(gattdb_service_changed_char)
+  app_log_warning("GATT caching is off in the GATT configuration; peers rediscover on every connection\r\n");
+#endif
+  if (nvm3_readData(nvm3_defaultHandle, RECONNECT_NVM3_KEY_FINGERPRINT, &saved, sizeof(saved)) == ECODE_NVM3_OK
+      && saved == fingerprint) {
+    if (nvm3_readData(nvm3_defaultHandle, RECONNECT_NVM3_KEY_AWARE, &aware, sizeof(aware)) != ECODE_NVM3_OK) {
+      aware = 0;
+    }
+    return;
+  }
+
+  // New services since the bonds cached them; every bond needs telling
+  app_log("GATT database changed (fingerprint %08lx), bonded peers get Service Changed\r\n",
+          (unsigned long)fingerprint);
+  aware = 0;
+  save_aware();
+  nvm3_writeData(nvm3_defaultHandle, RECONNECT_NVM3_KEY_FINGERPRINT, &fingerprint, sizeof(fingerprint));
+}
+
+static void send_service_changed(const conn_entry_t *c)
+{
+#ifdef gattdb_service_changed_char
+  static const uint8_t all_handles[4] = { 0x01, 0x00, 0xff, 0xff };
+  sl_status_t sc = sl_bt_gatt_server_send_indication(c->handle, gattdb_service_changed_char,
+                                                     sizeof(all_handles), all_handles);
+  if (sc != SL_STATUS_OK) {
+    app_log_warning("Service Changed to %u failed, sc=0x%lx\r\n", c->handle, (unsigned long)sc);
+    return;
+  }
+#endif
+  aware |= 1UL << c->bonding;
+  save_aware();
+}
+
+void reconnect_on_event(sl_bt_msg_t *evt)
+{
+  conn_entry_t *c;
+
+  switch (SL_BT_MSG_ID(evt->header)) {
+    case sl_bt_evt_system_boot_id:
+      check_database();
+      break;
+
+    case sl_bt_evt_connection_opened_id:
+      if (evt->data.evt_connection_opened.bonding != SL_BT_INVALID_BONDING_HANDLE) {
+        // Known keys: encrypt now instead of on the first protected access
+        sl_status_t sc = sl_bt_sm_increase_security(evt->data.evt_connection_opened.connection);
+        if (sc != SL_STATUS_OK) {
+          app_log_warning("Resuming encryption with %u failed, sc=0x%lx\r\n",
+                          evt->data.evt_connection_opened.connection, (unsigned long)sc);
+        }
+      }
+      break;
+
+    case sl_bt_evt_connection_parameters_id:
+      c = conn_table_find(evt->data.evt_connection_parameters.connection);
+      if (c != NULL && c->encrypted_ms != 0 && c->bonding < 32
+          && !(aware & (1UL << c->bonding))) {
+        send_service_changed(c);
+      }
+      break;
+
+    case sl_bt_evt_sm_bonded_id:
+      // A new bond has only ever seen this database
+      if (evt->data.evt_sm_bonded.bonding < 32) {
+        aware |= 1UL << evt->data.evt_sm_bonded.bonding;
+        save_aware();
+      }
+      break;
+
+    default:
+      break;
+  }
+}
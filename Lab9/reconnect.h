@@ -0,0 +1,30 @@
+/***************************************************************************//**
+ * @file
+ * @brief Fast reconnection for bonded peers.
+ *
+ * A bonded peer gets encryption resumed from the stored keys as soon as it
+ * connects, rather than when it first touches a protected characteristic.
+ * Its subscriptions come back from the bond at the same moment, and
+ * conn-table.c picks them up so notifications resume without a CCCD write.
+ * With GATT caching enabled in the static database (Generic Attribute
+ * service with Service Changed, Database Hash and Client Supported
+ * Features), it can also keep its cached attribute table and skip service
+ * discovery. If a firmware update changes the custom services, each bonded
+ * peer gets one Service Changed indication, the next time it reconnects.
+ ******************************************************************************/
+#ifndef RECONNECT_H
+#define RECONNECT_H
+
+#include "sl_bluetooth.h"
+
+// NVM3 keys: database fingerprint, and which bonds have seen that database
+#define RECONNECT_NVM3_KEY_FINGERPRINT 0x0c41
+#define RECONNECT_NVM3_KEY_AWARE       0x0c42
+
+/**************************************************************************//**
+ * Feed every Bluetooth event through here, from sl_bt_on_event(), after
+ * every module that adds services at boot and after conn_table_on_event().
+ *****************************************************************************/
+void reconnect_on_event(sl_bt_msg_t *evt);
+
+#endif // RECONNECT_H